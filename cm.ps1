@@ -1,21 +1,32 @@
 $dir = "./src"
 
-if (-not (Test-Path -Path "./bin")){
-    $null = New-Item -Path "./bin" -ItemType "directory"
+if (-not (Test-Path -Path "./bin/obj")){
+    $null = New-Item -Path "./bin/obj" -ItemType "directory"
 }
 
-if (Test-Path -Path "$dir/main.c" -PathType Leaf){
-    $compileCommand = "gcc `"$($dir)\main.c`" -o `".\bin\yookbeer.exe`""
-    Write-Host "Compiling with command: $compileCommand"
-    
-    Invoke-Expression -Command $compileCommand -ErrorAction Stop
-
+function Invoke-Compile($command) {
+    Write-Host "Compiling with command: $command"
+    Invoke-Expression -Command $command -ErrorAction Stop
     if ($LASTEXITCODE -ne 0) {
         throw "Error compiling. Check the source code for errors."
     }
-    else {
-        Write-Host "Yookbeer compiled successfully! binary at bin/yookbeer.exe"
+}
+
+if (Test-Path -Path "$dir/main.c" -PathType Leaf){
+    # libyookbeer: every source in src/lib, shared by the static library and the dll
+    $objs = @()
+    foreach ($src in Get-ChildItem -Path "$dir\lib\*.c") {
+        $obj = ".\bin\obj\$($src.BaseName).o"
+        Invoke-Compile "gcc -c -pthread `"$($src.FullName)`" -o `"$obj`""
+        $objs += "`"$obj`""
     }
+    Invoke-Compile "ar rcs `".\bin\libyookbeer.a`" $($objs -join ' ')"
+    Invoke-Compile "gcc -shared -pthread $($objs -join ' ') -o `".\bin\yookbeer.dll`" `"-Wl,--out-implib,.\bin\libyookbeer.dll.a`""
+
+    # the interactive CLI is a thin client linked against the static library
+    Invoke-Compile "gcc `"$($dir)\main.c`" -I`"$dir`" `".\bin\libyookbeer.a`" -pthread -o `".\bin\yookbeer.exe`""
+    Write-Host "Yookbeer compiled successfully! binary at bin/yookbeer.exe"
+    Write-Host "libyookbeer at bin/libyookbeer.a and bin/yookbeer.dll, header at src/yookbeer.h"
 }
 else {
     Write-Host "File does not exist!"
@@ -1,21 +1,38 @@
 #!/bin/bash
 
 dir="./src"
-if [ ! -d "./bin" ]; then
-    mkdir -p "./bin"
+if [ ! -d "./bin/obj" ]; then
+    mkdir -p "./bin/obj"
 fi
 
-if [ -f "$dir/main.c" ]; then
-    compile_command="gcc \"$dir/main.c\" -o \"./bin/yookbeer\""
-    echo "Compiling with command: $compile_command"
-    
-    eval "$compile_command"
+run() {
+    echo "Compiling with command: $1"
+    eval "$1"
     if [ $? -ne 0 ]; then
         echo "Error compiling. Check the source code for errors." >&2
         exit 1
-    else
-        echo "Yookbeer compiled successfully! binary at bin/yookbeer"
     fi
+}
+
+if [ -f "$dir/main.c" ]; then
+    # libyookbeer: every source in src/lib, built once as position independent
+    # objects so the same objects go into both the static and shared library
+    objs=""
+    for src in "$dir"/lib/*.c; do
+        obj="./bin/obj/$(basename "${src%.c}").o"
+        run "gcc -c -fPIC -pthread \"$src\" -o \"$obj\""
+        objs="$objs \"$obj\""
+    done
+    run "ar rcs \"./bin/libyookbeer.a\" $objs"
+    run "gcc -shared -pthread $objs -o \"./bin/libyookbeer.so\""
+
+    # the interactive CLI is a thin client linked against the static library
+    run "gcc \"$dir/main.c\" -I\"$dir\" \"./bin/libyookbeer.a\" -pthread -o \"./bin/yookbeer\""
+    # replays traces captured with `yookbeer -t <file>` and reports latencies
+    run "gcc \"$dir/replay.c\" -I\"$dir\" \"./bin/libyookbeer.a\" -pthread -lm -o \"./bin/yookbeer-replay\""
+    echo "Yookbeer compiled successfully! binary at bin/yookbeer"
+    echo "trace replay at bin/yookbeer-replay"
+    echo "libyookbeer at bin/libyookbeer.a and bin/libyookbeer.so, header at src/yookbeer.h"
 else
     echo "File does not exist!"
-fi
\ No newline at end of file
+fi
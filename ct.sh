@@ -8,4 +8,6 @@ source_path="./data_template/data.csv"
 destination_path="./data/data.csv"
 
 cp -f "$source_path" "$destination_path"
+# checksums of the previous data file would report every block as changed
+rm -f "$destination_path.crc"
 echo "Test data copied to $destination_path"
\ No newline at end of file
@@ -0,0 +1,820 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * paged B+tree storage backend
+ *
+ * the whole database is one file of PAGE_SIZE pages. page 0 is the
+ * file header, every other page is a node of one of three trees:
+ *
+ * TREE_PRIMARY: packed id -> Student record
+ * TREE_EMAIL: (27 bits email hash << 37 | packed id) -> nothing
+ * TREE_NAME: (27 bits name hash << 37 | packed id) -> nothing
+ *
+ * the two secondary trees let ybAdd() check duplicate email and name
+ * with a short range scan instead of reading every row. pages are read
+ * through a fixed size LRU cache, only dirty pages are written back, so
+ * adding or removing a student touches O(log n) pages.
+ *
+ * deletes don't rebalance: a leaf may become under-full or empty and
+ * stays in the leaf chain. freed space is given back by exporting to
+ * csv and importing into a new file.
+ */
+
+#define PAGE_SIZE 4096
+#define BT_MAGIC 0x54424259u // "YBBT"
+#define BT_VERSION 1
+#define NODE_LEAF 1
+#define NODE_INTERNAL 2
+#define NODE_HEADER 8
+// max keys of an internal node: keys are 8 bytes, children 4 bytes
+#define INTERNAL_MAX ((PAGE_SIZE - NODE_HEADER - 4) / 12)
+#define ID_BITS 37
+
+enum { TREE_PRIMARY, TREE_EMAIL, TREE_NAME, TREE_COUNT };
+
+/**
+ * STRUCT: FileHeader - content of page 0
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t pageSize;
+  uint32_t recordSize;
+  uint32_t pageCount;
+  uint32_t root[TREE_COUNT];
+  uint64_t rows;
+} FileHeader;
+
+/**
+ * STRUCT: NodeHeader - first NODE_HEADER bytes of every node page
+ *
+ * - type: NODE_LEAF or NODE_INTERNAL
+ * - n: amount of keys in the node
+ * - next: leaf only, page of the next leaf in key order (0 if last)
+ *
+ * leaf layout: header, keys[cap], values[cap][valSize]
+ * internal layout: header, keys[INTERNAL_MAX], children[INTERNAL_MAX + 1]
+ */
+typedef struct {
+  uint16_t type;
+  uint16_t n;
+  uint32_t next;
+} NodeHeader;
+
+/**
+ * STRUCT: Frame - one page slot of the cache
+ *
+ * - pageNo: page held by this frame (0 = empty, page 0 is never cached)
+ * - pins: amount of users currently holding the page, never evicted if > 0
+ * - prev, next: position in the LRU list (head is most recently used)
+ * - hnext: next frame in the same hash bucket
+ */
+typedef struct {
+  uint32_t pageNo;
+  int pins;
+  int dirty;
+  int prev;
+  int next;
+  int hnext;
+  unsigned char *data;
+} Frame;
+
+struct BTree {
+  FILE *f;
+  FileHeader hdr;
+  int hdrDirty;
+  int frames;
+  Frame *fr;
+  int *bucket;
+  int nbucket;
+  int lruHead;
+  int lruTail;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/**
+ * FUNCTION: hash64 - FNV-1a hash for the secondary index keys
+ */
+static uint64_t hash64(const char *s) {
+  uint64_t h = 14695981039346656037ull;
+  for (; *s != '\0'; s++) {
+    h ^= (unsigned char)*s;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/**
+ * FUNCTION: secondaryKey - composite key of a secondary index entry
+ *
+ * EXPLAINATION:
+ * the top 27 bits are a hash of the value, the low 37 bits are the
+ * packed id. every student gets a unique key and all students with
+ * the same value are next to each other.
+ */
+static uint64_t secondaryKey(const char *value, uint64_t id) {
+  return (hash64(value) >> ID_BITS << ID_BITS) | id;
+}
+
+/**
+ * FUNCTION: lruUnlink / lruPushFront - maintain the LRU list
+ */
+static void lruUnlink(BTree *bt, int i) {
+  Frame *f = &bt->fr[i];
+  if (f->prev >= 0)
+    bt->fr[f->prev].next = f->next;
+  else
+    bt->lruHead = f->next;
+  if (f->next >= 0)
+    bt->fr[f->next].prev = f->prev;
+  else
+    bt->lruTail = f->prev;
+  f->prev = f->next = -1;
+}
+
+static void lruPushFront(BTree *bt, int i) {
+  bt->fr[i].prev = -1;
+  bt->fr[i].next = bt->lruHead;
+  if (bt->lruHead >= 0)
+    bt->fr[bt->lruHead].prev = i;
+  bt->lruHead = i;
+  if (bt->lruTail < 0)
+    bt->lruTail = i;
+}
+
+/**
+ * FUNCTION: writePage - write one frame back to the file
+ */
+static int writePage(BTree *bt, int i) {
+  Frame *f = &bt->fr[i];
+  if (fseek(bt->f, (long)f->pageNo * PAGE_SIZE, SEEK_SET) != 0 ||
+      fwrite(f->data, PAGE_SIZE, 1, bt->f) != 1)
+    return YB_ERR_IO;
+  f->dirty = 0;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: pageGet - pin a page in the cache
+ *
+ * - uint32_t pageNo: page to get
+ *
+ * EXPLAINATION:
+ * return the frame holding the page, or -1 if every frame is pinned
+ * or the page can't be read. on a miss the least recently used frame
+ * that isn't pinned is written back (if dirty) and reused. release
+ * the page with pageRelease().
+ */
+static int pageGet(BTree *bt, uint32_t pageNo) {
+  int b = pageNo % bt->nbucket;
+  for (int i = bt->bucket[b]; i >= 0; i = bt->fr[i].hnext) {
+    if (bt->fr[i].pageNo == pageNo) {
+      bt->hits++;
+      bt->fr[i].pins++;
+      lruUnlink(bt, i);
+      lruPushFront(bt, i);
+      return i;
+    }
+  }
+  bt->misses++;
+
+  int v = bt->lruTail;
+  while (v >= 0 && bt->fr[v].pins > 0)
+    v = bt->fr[v].prev;
+  if (v < 0)
+    return -1;
+  Frame *f = &bt->fr[v];
+  if (f->dirty && writePage(bt, v) != YB_OK)
+    return -1;
+
+  /** unlink the victim from its old hash bucket */
+  if (f->pageNo != 0) {
+    int *p = &bt->bucket[f->pageNo % bt->nbucket];
+    while (*p != v)
+      p = &bt->fr[*p].hnext;
+    *p = f->hnext;
+  }
+
+  memset(f->data, 0, PAGE_SIZE);
+  if (pageNo < bt->hdr.pageCount) {
+    if (fseek(bt->f, (long)pageNo * PAGE_SIZE, SEEK_SET) != 0 ||
+        fread(f->data, PAGE_SIZE, 1, bt->f) != 1) {
+      f->pageNo = 0;
+      f->hnext = -1;
+      return -1;
+    }
+  }
+  f->pageNo = pageNo;
+  f->pins = 1;
+  f->hnext = bt->bucket[b];
+  bt->bucket[b] = v;
+  lruUnlink(bt, v);
+  lruPushFront(bt, v);
+  return v;
+}
+
+/**
+ * FUNCTION: pageRelease - unpin a page from pageGet()
+ *
+ * - int dirty: 1 if the page was modified
+ */
+static void pageRelease(BTree *bt, int i, int dirty) {
+  bt->fr[i].pins--;
+  if (dirty)
+    bt->fr[i].dirty = 1;
+}
+
+/**
+ * FUNCTION: pageAlloc - append a new empty page to the file and pin it
+ *
+ * - uint32_t *pageNo: receives the new page number
+ */
+static int pageAlloc(BTree *bt, uint32_t *pageNo) {
+  *pageNo = bt->hdr.pageCount;
+  int i = pageGet(bt, *pageNo);
+  if (i < 0)
+    return -1;
+  bt->fr[i].dirty = 1;
+  bt->hdr.pageCount++;
+  bt->hdrDirty = 1;
+  return i;
+}
+
+/**
+ * FUNCTION: btFlush - write every dirty page and the header
+ */
+static int btFlush(BTree *bt) {
+  for (int i = 0; i < bt->frames; i++)
+    if (bt->fr[i].dirty && writePage(bt, i) != YB_OK)
+      return YB_ERR_IO;
+  if (bt->hdrDirty) {
+    unsigned char page[PAGE_SIZE] = {0};
+    memcpy(page, &bt->hdr, sizeof(FileHeader));
+    if (fseek(bt->f, 0, SEEK_SET) != 0 || fwrite(page, PAGE_SIZE, 1, bt->f) != 1)
+      return YB_ERR_IO;
+    bt->hdrDirty = 0;
+  }
+  return fflush(bt->f) == 0 ? YB_OK : YB_ERR_IO;
+}
+
+/**
+ * FUNCTION: node accessors - views into a page for a tree with values
+ * of valSize bytes
+ */
+static int valSizeOf(int tree) {
+  return tree == TREE_PRIMARY ? (int)sizeof(Student) : 0;
+}
+
+static int leafCap(int tree) {
+  return (PAGE_SIZE - NODE_HEADER) / (8 + valSizeOf(tree));
+}
+
+static NodeHeader *nodeHeader(unsigned char *p) { return (NodeHeader *)p; }
+
+static uint64_t *nodeKeys(unsigned char *p) {
+  return (uint64_t *)(p + NODE_HEADER);
+}
+
+static unsigned char *leafVal(unsigned char *p, int tree, int i) {
+  return p + NODE_HEADER + 8 * leafCap(tree) + i * valSizeOf(tree);
+}
+
+static uint32_t *nodeChildren(unsigned char *p) {
+  return (uint32_t *)(p + NODE_HEADER + 8 * INTERNAL_MAX);
+}
+
+/**
+ * FUNCTION: lowerBound - first position with keys[pos] >= key
+ */
+static int lowerBound(const uint64_t *keys, int n, uint64_t key) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (keys[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * FUNCTION: childIndex - child of an internal node that may hold key
+ *
+ * EXPLAINATION:
+ * keys[i] is the smallest key of children[i + 1], so go to the
+ * child after the last key <= key
+ */
+static int childIndex(const uint64_t *keys, int n, uint64_t key) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (keys[mid] <= key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * FUNCTION: insertRec - insert key/value below `page`
+ *
+ * - uint64_t *upKey, uint32_t *upPage: receive the separator and new
+ *   right sibling if this node had to split
+ *
+ * EXPLAINATION:
+ * return 0 if done, 1 if the node split, YB_ERR_DUPLICATE if the key
+ * exists, or -YB_ERR_IO if the cache failed. a leaf that is full and
+ * receives a key past its last one (ids added in order, e.g. while
+ * importing a sorted csv) keeps all its keys and the new key starts
+ * the right sibling, so bulk loads fill leaves completely.
+ */
+static int insertRec(BTree *bt, int tree, uint32_t page, uint64_t key,
+                     const void *val, uint64_t *upKey, uint32_t *upPage) {
+  int fi = pageGet(bt, page);
+  if (fi < 0)
+    return -YB_ERR_IO;
+  unsigned char *p = bt->fr[fi].data;
+  NodeHeader *h = nodeHeader(p);
+  uint64_t *keys = nodeKeys(p);
+  int vs = valSizeOf(tree);
+
+  if (h->type == NODE_LEAF) {
+    int pos = lowerBound(keys, h->n, key), cap = leafCap(tree);
+    if (pos < h->n && keys[pos] == key) {
+      pageRelease(bt, fi, 0);
+      return YB_ERR_DUPLICATE;
+    }
+    if (h->n < cap) {
+      memmove(&keys[pos + 1], &keys[pos], (h->n - pos) * 8);
+      memmove(leafVal(p, tree, pos + 1), leafVal(p, tree, pos),
+              (h->n - pos) * vs);
+      keys[pos] = key;
+      memcpy(leafVal(p, tree, pos), val, vs);
+      h->n++;
+      pageRelease(bt, fi, 1);
+      return 0;
+    }
+
+    /** leaf is full: split */
+    uint32_t rp;
+    int ri = pageAlloc(bt, &rp);
+    if (ri < 0) {
+      pageRelease(bt, fi, 0);
+      return -YB_ERR_IO;
+    }
+    unsigned char *r = bt->fr[ri].data;
+    NodeHeader *rh = nodeHeader(r);
+    uint64_t *rkeys = nodeKeys(r);
+    int mid = pos == h->n && h->next == 0 ? h->n : h->n / 2;
+    rh->type = NODE_LEAF;
+    rh->n = h->n - mid;
+    rh->next = h->next;
+    memcpy(rkeys, &keys[mid], rh->n * 8);
+    memcpy(leafVal(r, tree, 0), leafVal(p, tree, mid), rh->n * vs);
+    h->n = mid;
+    h->next = rp;
+
+    /** insert into the half the key belongs to */
+    unsigned char *t = pos <= mid && mid < cap ? p : r;
+    NodeHeader *th = nodeHeader(t);
+    uint64_t *tkeys = nodeKeys(t);
+    int tpos = t == p ? pos : pos - mid;
+    memmove(&tkeys[tpos + 1], &tkeys[tpos], (th->n - tpos) * 8);
+    memmove(leafVal(t, tree, tpos + 1), leafVal(t, tree, tpos),
+            (th->n - tpos) * vs);
+    tkeys[tpos] = key;
+    memcpy(leafVal(t, tree, tpos), val, vs);
+    th->n++;
+
+    *upKey = rkeys[0];
+    *upPage = rp;
+    pageRelease(bt, ri, 1);
+    pageRelease(bt, fi, 1);
+    return 1;
+  }
+
+  /** internal node: insert into the child, then absorb its split */
+  uint32_t *ch = nodeChildren(p);
+  int ci = childIndex(keys, h->n, key);
+  uint64_t ck;
+  uint32_t cp;
+  int r = insertRec(bt, tree, ch[ci], key, val, &ck, &cp);
+  if (r != 1) {
+    pageRelease(bt, fi, 0);
+    return r;
+  }
+  if (h->n < INTERNAL_MAX) {
+    memmove(&keys[ci + 1], &keys[ci], (h->n - ci) * 8);
+    memmove(&ch[ci + 2], &ch[ci + 1], (h->n - ci) * 4);
+    keys[ci] = ck;
+    ch[ci + 1] = cp;
+    h->n++;
+    pageRelease(bt, fi, 1);
+    return 0;
+  }
+
+  /**
+   * internal node is full: build the combined key/child list, keep
+   * the left half here, move the right half to a new node and push
+   * the middle key up
+   */
+  uint64_t tk[INTERNAL_MAX + 1];
+  uint32_t tc[INTERNAL_MAX + 2];
+  memcpy(tk, keys, ci * 8);
+  tk[ci] = ck;
+  memcpy(&tk[ci + 1], &keys[ci], (h->n - ci) * 8);
+  memcpy(tc, ch, (ci + 1) * 4);
+  tc[ci + 1] = cp;
+  memcpy(&tc[ci + 2], &ch[ci + 1], (h->n - ci) * 4);
+
+  uint32_t rp;
+  int ri = pageAlloc(bt, &rp);
+  if (ri < 0) {
+    pageRelease(bt, fi, 0);
+    return -YB_ERR_IO;
+  }
+  unsigned char *rn = bt->fr[ri].data;
+  NodeHeader *rh = nodeHeader(rn);
+  int total = INTERNAL_MAX + 1, mid = total / 2;
+  h->n = mid;
+  memcpy(keys, tk, mid * 8);
+  memcpy(ch, tc, (mid + 1) * 4);
+  rh->type = NODE_INTERNAL;
+  rh->n = total - mid - 1;
+  memcpy(nodeKeys(rn), &tk[mid + 1], rh->n * 8);
+  memcpy(nodeChildren(rn), &tc[mid + 1], (rh->n + 1) * 4);
+  *upKey = tk[mid];
+  *upPage = rp;
+  pageRelease(bt, ri, 1);
+  pageRelease(bt, fi, 1);
+  return 1;
+}
+
+/**
+ * FUNCTION: btInsert - insert a key into one of the trees
+ *
+ * EXPLAINATION:
+ * an empty tree gets a single leaf as root. if the root splits, a new
+ * internal root is created above it so the tree grows by one level.
+ */
+static int btInsert(BTree *bt, int tree, uint64_t key, const void *val) {
+  uint64_t upKey;
+  uint32_t upPage, np;
+  if (bt->hdr.root[tree] == 0) {
+    int i = pageAlloc(bt, &np);
+    if (i < 0)
+      return YB_ERR_IO;
+    nodeHeader(bt->fr[i].data)->type = NODE_LEAF;
+    pageRelease(bt, i, 1);
+    bt->hdr.root[tree] = np;
+  }
+  int r = insertRec(bt, tree, bt->hdr.root[tree], key, val, &upKey, &upPage);
+  if (r < 0)
+    return -r;
+  if (r == YB_ERR_DUPLICATE)
+    return r;
+  if (r == 1) {
+    int i = pageAlloc(bt, &np);
+    if (i < 0)
+      return YB_ERR_IO;
+    unsigned char *p = bt->fr[i].data;
+    nodeHeader(p)->type = NODE_INTERNAL;
+    nodeHeader(p)->n = 1;
+    nodeKeys(p)[0] = upKey;
+    nodeChildren(p)[0] = bt->hdr.root[tree];
+    nodeChildren(p)[1] = upPage;
+    pageRelease(bt, i, 1);
+    bt->hdr.root[tree] = np;
+  }
+  bt->hdrDirty = 1;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: findLeaf - descend to the leaf that may hold key
+ *
+ * EXPLAINATION:
+ * return the pinned frame of the leaf, -1 on error or empty tree
+ */
+static int findLeaf(BTree *bt, int tree, uint64_t key) {
+  uint32_t page = bt->hdr.root[tree];
+  if (page == 0)
+    return -1;
+  while (1) {
+    int fi = pageGet(bt, page);
+    if (fi < 0)
+      return -1;
+    unsigned char *p = bt->fr[fi].data;
+    if (nodeHeader(p)->type == NODE_LEAF)
+      return fi;
+    page = nodeChildren(p)[childIndex(nodeKeys(p), nodeHeader(p)->n, key)];
+    pageRelease(bt, fi, 0);
+  }
+}
+
+/**
+ * FUNCTION: btGet - look up a key
+ *
+ * - void *val: receives the value (may be NULL)
+ *
+ * EXPLAINATION:
+ * return 1 if found, 0 if not
+ */
+static int btGet(BTree *bt, int tree, uint64_t key, void *val) {
+  int fi = findLeaf(bt, tree, key);
+  if (fi < 0)
+    return 0;
+  unsigned char *p = bt->fr[fi].data;
+  int n = nodeHeader(p)->n, pos = lowerBound(nodeKeys(p), n, key);
+  int found = pos < n && nodeKeys(p)[pos] == key;
+  if (found && val != NULL)
+    memcpy(val, leafVal(p, tree, pos), valSizeOf(tree));
+  pageRelease(bt, fi, 0);
+  return found;
+}
+
+/**
+ * FUNCTION: btDelete - remove a key from its leaf
+ *
+ * EXPLAINATION:
+ * only the leaf is modified, separators in internal nodes stay valid
+ * as bounds even after their key is gone.
+ */
+static int btDelete(BTree *bt, int tree, uint64_t key) {
+  int fi = findLeaf(bt, tree, key);
+  if (fi < 0)
+    return 0;
+  unsigned char *p = bt->fr[fi].data;
+  NodeHeader *h = nodeHeader(p);
+  uint64_t *keys = nodeKeys(p);
+  int pos = lowerBound(keys, h->n, key), vs = valSizeOf(tree);
+  if (pos >= h->n || keys[pos] != key) {
+    pageRelease(bt, fi, 0);
+    return 0;
+  }
+  memmove(&keys[pos], &keys[pos + 1], (h->n - pos - 1) * 8);
+  memmove(leafVal(p, tree, pos), leafVal(p, tree, pos + 1),
+          (h->n - pos - 1) * vs);
+  h->n--;
+  pageRelease(bt, fi, 1);
+  return 1;
+}
+
+/**
+ * FUNCTION: btSeek / btCursorNext - ordered scan of a tree
+ *
+ * - uint32_t *leaf, int *pos: cursor position
+ *
+ * EXPLAINATION:
+ * btSeek() puts the cursor at the first key >= key. btCursorNext()
+ * reads the key (and value) under the cursor then advances, following
+ * the leaf chain and skipping empty leaves. return 1 for an entry,
+ * 0 at the end.
+ */
+static void btSeek(BTree *bt, int tree, uint64_t key, uint32_t *leaf,
+                   int *pos) {
+  int fi = findLeaf(bt, tree, key);
+  *leaf = 0;
+  *pos = 0;
+  if (fi < 0)
+    return;
+  unsigned char *p = bt->fr[fi].data;
+  *leaf = bt->fr[fi].pageNo;
+  *pos = lowerBound(nodeKeys(p), nodeHeader(p)->n, key);
+  pageRelease(bt, fi, 0);
+}
+
+static int btCursorNext(BTree *bt, int tree, uint32_t *leaf, int *pos,
+                        uint64_t *key, void *val) {
+  while (*leaf != 0) {
+    int fi = pageGet(bt, *leaf);
+    if (fi < 0)
+      return 0;
+    unsigned char *p = bt->fr[fi].data;
+    NodeHeader *h = nodeHeader(p);
+    if (*pos < h->n) {
+      *key = nodeKeys(p)[*pos];
+      if (val != NULL)
+        memcpy(val, leafVal(p, tree, *pos), valSizeOf(tree));
+      (*pos)++;
+      pageRelease(bt, fi, 0);
+      return 1;
+    }
+    *leaf = h->next;
+    *pos = 0;
+    pageRelease(bt, fi, 0);
+  }
+  return 0;
+}
+
+/**
+ * FUNCTION: btFirstLeaf - leftmost leaf of a tree (start of a full scan)
+ */
+static uint32_t btFirstLeaf(BTree *bt, int tree) {
+  uint32_t leaf;
+  int pos;
+  btSeek(bt, tree, 0, &leaf, &pos);
+  return leaf;
+}
+
+/**
+ * FUNCTION: btOpen - open or create a B+tree file
+ *
+ * - const char *path: database file, created if it doesn't exist
+ * - int cachePages: amount of pages the LRU cache holds (at least 16)
+ * - BTree **out: receives the handle
+ */
+int btOpen(const char *path, int cachePages, BTree **out) {
+  BTree *bt = calloc(1, sizeof(BTree));
+  unsigned char page[PAGE_SIZE];
+  if (bt == NULL)
+    return YB_ERR_NOMEM;
+  bt->f = fopen(path, "r+b");
+  if (bt->f == NULL) {
+    bt->f = fopen(path, "w+b");
+    if (bt->f == NULL) {
+      free(bt);
+      return YB_ERR_IO;
+    }
+    bt->hdr.magic = BT_MAGIC;
+    bt->hdr.version = BT_VERSION;
+    bt->hdr.pageSize = PAGE_SIZE;
+    bt->hdr.recordSize = sizeof(Student);
+    bt->hdr.pageCount = 1;
+    bt->hdrDirty = 1;
+  }
+  else {
+    if (fread(page, PAGE_SIZE, 1, bt->f) != 1) {
+      fclose(bt->f);
+      free(bt);
+      return YB_ERR_IO;
+    }
+    memcpy(&bt->hdr, page, sizeof(FileHeader));
+    if (bt->hdr.magic != BT_MAGIC || bt->hdr.version != BT_VERSION ||
+        bt->hdr.pageSize != PAGE_SIZE ||
+        bt->hdr.recordSize != sizeof(Student)) {
+      fclose(bt->f);
+      free(bt);
+      return YB_ERR_INVALID;
+    }
+  }
+
+  bt->frames = cachePages < 16 ? 16 : cachePages;
+  bt->nbucket = bt->frames * 2;
+  bt->fr = calloc(bt->frames, sizeof(Frame));
+  bt->bucket = malloc(bt->nbucket * sizeof(int));
+  for (int b = 0; b < bt->nbucket; b++)
+    bt->bucket[b] = -1;
+  bt->lruHead = bt->lruTail = -1;
+  for (int i = 0; i < bt->frames; i++) {
+    bt->fr[i].data = malloc(PAGE_SIZE);
+    bt->fr[i].hnext = -1;
+    bt->fr[i].prev = bt->fr[i].next = -1;
+    lruPushFront(bt, i);
+  }
+  *out = bt;
+  return btFlush(bt);
+}
+
+/**
+ * FUNCTION: btClose - flush and release a B+tree handle
+ */
+void btClose(BTree *bt) {
+  if (bt == NULL)
+    return;
+  btFlush(bt);
+  fclose(bt->f);
+  for (int i = 0; i < bt->frames; i++)
+    free(bt->fr[i].data);
+  free(bt->fr);
+  free(bt->bucket);
+  free(bt);
+}
+
+/**
+ * FUNCTION: indexHas - check a secondary index for a value
+ *
+ * - int tree: TREE_EMAIL or TREE_NAME
+ * - const char *value: email or name to look for
+ *
+ * EXPLAINATION:
+ * scan the entries sharing the value's hash and compare the real
+ * value of each student (hashes may collide). return amount of
+ * students with that value.
+ */
+static int indexHas(BTree *bt, int tree, const char *value) {
+  uint64_t from = secondaryKey(value, 0), key, id;
+  uint32_t leaf;
+  int pos, m = 0;
+  Student s;
+  btSeek(bt, tree, from, &leaf, &pos);
+  while (btCursorNext(bt, tree, &leaf, &pos, &key, NULL)) {
+    if ((key >> ID_BITS) != (from >> ID_BITS))
+      break;
+    id = key & ((1ull << ID_BITS) - 1);
+    if (btGet(bt, TREE_PRIMARY, id, &s) &&
+        strcmp(tree == TREE_EMAIL ? s.email : s.name, value) == 0)
+      m++;
+  }
+  return m;
+}
+
+/**
+ * FUNCTION: btAddStudent - insert a student into every tree
+ *
+ * EXPLAINATION:
+ * id and email have to be unique, checked with a point lookup and
+ * an index range scan.
+ *
+ * - int flush: write dirty pages now (0 when adding many at once)
+ */
+int btAddStudent(BTree *bt, const Student *x, int flush) {
+  uint64_t id = ybPackId(x->id);
+  if (btGet(bt, TREE_PRIMARY, id, NULL) || indexHas(bt, TREE_EMAIL, x->email))
+    return YB_ERR_DUPLICATE;
+  int err = btInsert(bt, TREE_PRIMARY, id, x);
+  if (err == YB_OK)
+    err = btInsert(bt, TREE_EMAIL, secondaryKey(x->email, id), NULL);
+  if (err == YB_OK)
+    err = btInsert(bt, TREE_NAME, secondaryKey(x->name, id), NULL);
+  if (err != YB_OK)
+    return err;
+  bt->hdr.rows++;
+  bt->hdrDirty = 1;
+  return flush ? btFlush(bt) : YB_OK;
+}
+
+/**
+ * FUNCTION: btRemoveStudent - remove a student from every tree
+ *
+ * - int flush: write dirty pages now (0 when removing many at once)
+ */
+int btRemoveStudent(BTree *bt, const char id[], Student *removed, int flush) {
+  uint64_t k = ybPackId(id);
+  Student s;
+  if (!btGet(bt, TREE_PRIMARY, k, &s))
+    return YB_ERR_NOT_FOUND;
+  btDelete(bt, TREE_PRIMARY, k);
+  btDelete(bt, TREE_EMAIL, secondaryKey(s.email, k));
+  btDelete(bt, TREE_NAME, secondaryKey(s.name, k));
+  if (removed != NULL)
+    *removed = s;
+  bt->hdr.rows--;
+  bt->hdrDirty = 1;
+  return flush ? btFlush(bt) : YB_OK;
+}
+
+/**
+ * FUNCTION: btCommit - flush after a batch of btAddStudent() / btRemoveStudent() with flush 0
+ */
+int btCommit(BTree *bt) { return btFlush(bt); }
+
+/**
+ * FUNCTION: btCheckDuplicate - ybCheckDuplicate() using the indexes
+ */
+void btCheckDuplicate(BTree *bt, const Student *x, CheckDuplicateResponse *r) {
+  r->id = btGet(bt, TREE_PRIMARY, ybPackId(x->id), NULL);
+  r->email = indexHas(bt, TREE_EMAIL, x->email);
+  r->name = indexHas(bt, TREE_NAME, x->name);
+}
+
+/**
+ * FUNCTION: btGetStudent - point lookup by packed id
+ */
+int btGetStudent(BTree *bt, uint64_t id, Student *out) {
+  return btGet(bt, TREE_PRIMARY, id, out);
+}
+
+/**
+ * FUNCTION: btRows - amount of students stored
+ */
+long long btRows(BTree *bt) { return (long long)bt->hdr.rows; }
+
+/**
+ * FUNCTION: btScanStart / btScanNext - read students in id order
+ */
+void btScanStart(BTree *bt, uint32_t *leaf, int *pos) {
+  *leaf = btFirstLeaf(bt, TREE_PRIMARY);
+  *pos = 0;
+}
+
+int btScanNext(BTree *bt, uint32_t *leaf, int *pos, Student *out) {
+  uint64_t key;
+  return btCursorNext(bt, TREE_PRIMARY, leaf, pos, &key, out);
+}
+
+/**
+ * FUNCTION: btStats - cache statistics
+ */
+void btStats(BTree *bt, YbCacheStats *s) {
+  s->hits = bt->hits;
+  s->misses = bt->misses;
+  s->frames = bt->frames;
+  s->pages = bt->hdr.pageCount;
+}
@@ -0,0 +1,600 @@
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32) && !defined(__MINGW32__)
+#include <unistd.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * FUNCTION: ybApiVersion - version of the API this library was built with
+ *
+ * EXPLAINATION:
+ * callers can compare this with YB_API_VERSION from the header they
+ * compiled against to catch a mismatched shared library
+ */
+int ybApiVersion(void) { return YB_API_VERSION; }
+
+/**
+ * FUNCTION: ybStrError - human readable message for a YbStatus
+ */
+const char *ybStrError(int status) {
+  switch (status) {
+  case YB_OK:
+    return "success";
+  case YB_ERR_IO:
+    return "cannot read or write data file";
+  case YB_ERR_INVALID:
+    return "invalid input";
+  case YB_ERR_NOT_FOUND:
+    return "not found";
+  case YB_ERR_DUPLICATE:
+    return "already exist";
+  case YB_ERR_NOMEM:
+    return "out of memory";
+  case YB_ERR_READONLY:
+    return "read-only replica";
+  }
+  return "unknown error";
+}
+
+/**
+ * FUNTCION: ybCourseName - convert course value in data file from int to its name
+ *
+ * - int course: course value
+ */
+const char *ybCourseName(int course) {
+  static const char *names[] = {"REG", "INTER", "HDS", "RC"};
+  return course >= 0 && course <= 3 ? names[course] : "?";
+}
+
+/**
+ * FUNCTION: ybPackId - pack an 11 digits id string into an integer
+ *
+ * - char id[]: id string
+ *
+ * EXPLAINATION:
+ * every id is exactly 11 ascii digits, so its numeric value (< 10^11)
+ * fits in 37 bits and compares the same way strcmp() would compare the
+ * strings. anything that isn't 11 digits gets the biggest key so it
+ * sorts to the end instead of breaking the order of valid rows.
+ */
+uint64_t ybPackId(const char id[]) {
+  uint64_t k = 0;
+  for (int j = 0; j < 11; j++) {
+    if (id[j] < '0' || id[j] > '9')
+      return UINT64_MAX;
+    k = k * 10 + (uint64_t)(id[j] - '0');
+  }
+  return id[11] == '\0' ? k : UINT64_MAX;
+}
+
+/**
+ * FUNCTION: ybValidId / ybValidEmail / ybValidPhone - validate user input
+ *
+ * EXPLAINATION:
+ * id: exactly 11 digits
+ * email: exactly one '@' and at most 60 characters
+ * phone: exactly 10 characters
+ */
+int ybValidId(const char id[]) { return ybPackId(id) != UINT64_MAX; }
+
+int ybValidEmail(const char email[]) {
+  int at = 0;
+  for (int i = 0; email[i] != '\0'; i++) {
+    if (email[i] == '@')
+      at++;
+    if (email[i] == ',')
+      return 0;
+  }
+  return at == 1 && strlen(email) <= 60;
+}
+
+int ybValidPhone(const char phone[]) {
+  return strlen(phone) == 10 && strchr(phone, ',') == NULL;
+}
+
+/**
+ * FUNCTION: utf8Next - decode the character at p
+ *
+ * - int *cp: receives the code point, -1 for a byte that doesn't start a
+ *   valid sequence (it is then taken as a character of its own)
+ *
+ * EXPLAINATION:
+ * returns amount of bytes of the character, 0 at the end of the string
+ */
+static int utf8Next(const unsigned char *p, int *cp) {
+  if (p[0] == 0)
+    return 0;
+  if (p[0] < 0x80) {
+    *cp = p[0];
+    return 1;
+  }
+  int n = p[0] >= 0xF0 ? 4 : p[0] >= 0xE0 ? 3 : p[0] >= 0xC0 ? 2 : 1;
+  int c = p[0] & (0x7F >> n);
+  for (int j = 1; j < n; j++) {
+    if ((p[j] & 0xC0) != 0x80) {
+      *cp = -1;
+      return 1;
+    }
+    c = c << 6 | (p[j] & 0x3F);
+  }
+  *cp = n == 1 ? -1 : c;
+  return n;
+}
+
+/**
+ * FUNCTION: utf8Put - encode a code point, return amount of bytes written
+ */
+static int utf8Put(char *out, int cp) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = 0xC0 | cp >> 6;
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  }
+  out[0] = 0xE0 | cp >> 12;
+  out[1] = 0x80 | (cp >> 6 & 0x3F);
+  out[2] = 0x80 | (cp & 0x3F);
+  return 3;
+}
+
+/**
+ * FUNCTION: upperCp - uppercase of a code point
+ *
+ * EXPLAINATION:
+ * covers ascii, latin-1, latin extended-A, greek and cyrillic, the
+ * scripts names in the roster are written in besides thai (which has
+ * no case). every mapping keeps the utf-8 length of the character so
+ * strings can be uppercased in place, which leaves out the dotless i
+ * (its uppercase is ascii I, see ybFoldKey()).
+ */
+static int upperCp(int c) {
+  if (c >= 'a' && c <= 'z')
+    return c - 32;
+  if (c < 0xE0)
+    return c;
+  if (c <= 0xFE)
+    return c == 0xF7 ? c : c - 0x20;
+  if (c == 0xFF)
+    return 0x178;
+  // latin extended-A: upper/lower pairs, upper on even or odd code points
+  if ((c >= 0x100 && c <= 0x137 && c != 0x131) || (c >= 0x14A && c <= 0x177))
+    return c & ~1;
+  if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E))
+    return c % 2 == 0 ? c - 1 : c;
+  if (c == 0x3C2) // final sigma
+    return 0x3A3;
+  if (c == 0x3AC || c == 0x3CC) // greek vowels with tonos
+    return c == 0x3AC ? 0x386 : 0x38C;
+  if ((c >= 0x3AD && c <= 0x3AF) || (c >= 0x3CD && c <= 0x3CE))
+    return c - (c <= 0x3AF ? 0x25 : 0x3F);
+  // alpha .. omega, then iota and upsilon with dialytika
+  if ((c >= 0x3B1 && c <= 0x3CB) || (c >= 0x430 && c <= 0x44F))
+    return c - 0x20;
+  if (c >= 0x450 && c <= 0x45F)
+    return c - 0x50;
+  return c;
+}
+
+/**
+ * FUNCTION: ybToUpper - shift every lowercase letter to uppercase
+ *
+ * EXPLAINATION:
+ * s is utf-8, see upperCp() for the letters covered. the length of s
+ * doesn't change.
+ */
+void ybToUpper(char s[]) {
+  unsigned char *p = (unsigned char *)s;
+  int cp, n;
+  while ((n = utf8Next(p, &cp)) > 0) {
+    if (cp >= 0 && upperCp(cp) != cp)
+      utf8Put((char *)p, upperCp(cp));
+    p += n;
+  }
+}
+
+/**
+ * FUNCTION: ybTruncate - cut s to at most max bytes without splitting a
+ * utf-8 character
+ */
+void ybTruncate(char s[], int max) {
+  if ((int)strlen(s) <= max)
+    return;
+  while (max > 0 && ((unsigned char)s[max] & 0xC0) == 0x80)
+    max--;
+  s[max] = '\0';
+}
+
+/**
+ * FUNCTION: ybFoldKey - normalized form of a name for prefix search
+ *
+ * - const char *s, int len: utf-8 text (stops early at '\0')
+ * - char *out: receives the key, at least len + 1 bytes (a key is
+ *   never longer than its text)
+ *
+ * EXPLAINATION:
+ * letters are uppercased with upperCp(), and the dotless i becomes a
+ * plain I (one byte shorter). thai has no case, instead:
+ *  - tone marks (mai ek .. mai chattawa) are dropped, they are often
+ *    typed differently or left out
+ *  - nikhahit + sara aa, how some keyboards type sara am, becomes sara am
+ *  - thai digits become ascii digits
+ * returns the length of the key
+ */
+int ybFoldKey(const char *s, int len, char *out) {
+  const unsigned char *p = (const unsigned char *)s;
+  const unsigned char *end = p + len;
+  int o = 0, last = 0, cp, n;
+  while (p < end && (n = utf8Next(p, &cp)) > 0) {
+    if (p + n > end)
+      break;
+    if (cp < 0 || n == 4) { // invalid byte or outside the bmp, copied as is
+      memcpy(out + o, p, n);
+      o += n;
+      last = 0;
+    }
+    else if (cp >= 0xE48 && cp <= 0xE4B) {
+      // tone mark, skipped
+    }
+    else if (cp == 0x131) {
+      out[o++] = 'I';
+      last = cp;
+    }
+    else if (cp == 0xE32 && last == 0xE4D) {
+      o -= 3;
+      o += utf8Put(out + o, 0xE33);
+      last = 0xE33;
+    }
+    else {
+      if (cp >= 0xE50 && cp <= 0xE59)
+        cp = '0' + cp - 0xE50;
+      o += utf8Put(out + o, upperCp(cp));
+      last = cp;
+    }
+    p += n;
+  }
+  out[o] = '\0';
+  return o;
+}
+
+/**
+ * FUNCTION: ybOpen - open a data file
+ *
+ * - const char *path: path of data file
+ * - YbDb **db: receives the handle, free it with ybClose()
+ *
+ * EXPLAINATION:
+ * the file has to exist (an empty file is fine). nothing is loaded,
+ * every operation reads the file when it needs to.
+ */
+int ybOpen(const char *path, YbDb **db) {
+  *db = NULL;
+  if (strlen(path) >= sizeof((*db)->path))
+    return YB_ERR_INVALID;
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return YB_ERR_IO;
+  fclose(f);
+
+  YbDb *d = calloc(1, sizeof(YbDb));
+  if (d == NULL)
+    return YB_ERR_NOMEM;
+  strcpy(d->path, path);
+  sprintf(d->tmpPath, "%s.tmp", path);
+  d->memBudget = (long long)DEFAULT_MEM_BUDGET_MB * 1024 * 1024;
+  *db = d;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybOpenBtree - open or create a B+tree database file
+ *
+ * - const char *path: path of database file, created if missing
+ * - int cachePages: size of the page cache in 4KB pages
+ * - YbDb **db: receives the handle, free it with ybClose()
+ *
+ * EXPLAINATION:
+ * every function taking a YbDb works with either backend. use
+ * ybImportCsv() / ybExportCsv() to move data from/to a csv file.
+ */
+int ybOpenBtree(const char *path, int cachePages, YbDb **db) {
+  *db = NULL;
+  if (strlen(path) >= sizeof((*db)->path))
+    return YB_ERR_INVALID;
+  YbDb *d = calloc(1, sizeof(YbDb));
+  if (d == NULL)
+    return YB_ERR_NOMEM;
+  int err = btOpen(path, cachePages, &d->bt);
+  if (err != YB_OK) {
+    free(d);
+    return err;
+  }
+  strcpy(d->path, path);
+  sprintf(d->tmpPath, "%s.tmp", path);
+  d->memBudget = (long long)DEFAULT_MEM_BUDGET_MB * 1024 * 1024;
+  *db = d;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybClose - release a handle from any of the ybOpen*() functions
+ */
+void ybClose(YbDb *db) {
+  if (db == NULL)
+    return;
+  replStop(db);
+  btClose(db->bt);
+  resFree(db->mem);
+  free(db);
+}
+
+/**
+ * FUNCTION: ybPath - path of the data file behind a handle
+ */
+const char *ybPath(YbDb *db) { return db->path; }
+
+/**
+ * FUNCTION: ybSetMemBudget - memory budget for bulk operations (sorting)
+ *
+ * - long long bytes: budget in bytes
+ */
+void ybSetMemBudget(YbDb *db, long long bytes) {
+  if (bytes > 0)
+    db->memBudget = bytes;
+}
+
+/**
+ * FUNTCION: ybRowCount - count each line of data file
+ *
+ * - int *len: pointer to integer to store line count
+ *
+ *  explanation: 
+ *  read the file in big chunks and count '\n' with memchr(), a last
+ *  line without '\n' counts too.
+ */
+int ybRowCount(YbDb *db, int *len) {
+  char buf[65536];
+  size_t n;
+  int last = '\n';
+  *len = 0;
+  if (db->bt != NULL) {
+    *len = btRows(db->bt);
+    return YB_OK;
+  }
+  if (db->mem != NULL) {
+    int err = resEnsure(db);
+    *len = resRows(db);
+    return err;
+  }
+  FILE *f = fopen(db->path, "rb");
+  if (f == NULL)
+    return YB_ERR_IO;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    for (char *p = buf; (p = memchr(p, '\n', buf + n - p)) != NULL; p++)
+      (*len)++;
+    last = buf[n - 1];
+  }
+  if (last != '\n')
+    (*len)++;
+  fclose(f);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybParseLine - parse one data line into a Student
+ *
+ * - const char *line: data line, with or without trailing '\n'
+ * - Student *s: receives the row
+ *
+ * EXPLAINATION:
+ * return 1 if the line has all 6 columns, 0 otherwise
+ */
+int ybParseLine(const char *line, Student *s) {
+  return sscanf(line, "%11[^,],%54[^,],%20[^,],%d,%60[^,],%10[^,\r\n]",
+                s->id, s->name, s->nick, &s->course, s->email,
+                s->phone) == 6;
+}
+
+/**
+ * FUNCTION: ybWriteLine - write one Student as a data line
+ */
+void ybWriteLine(FILE *f, const Student *s) {
+  fprintf(f, "%s,%s,%s,%d,%s,%s\n", s->id, s->name, s->nick, s->course,
+          s->email, s->phone);
+}
+
+/**
+ * FUNCTION: ybReplaceFile - replace data file with the freshly written temp file
+ *
+ * EXPLAINATION:
+ * rename() replaces the destination in one step on POSIX systems, but
+ * on windows it fails if the destination exists so remove it first.
+ * a resident handle loads the new file before its next read. if it
+ * was behind the file (an outside edit not picked up yet), the edit is
+ * in the new file too and a primary's replicas start over after that
+ * load. the block checksums checked by ybVerify() are recorded for the
+ * new file.
+ */
+int ybReplaceFile(YbDb *db) {
+  int outside = db->mem != NULL && resChanged(db);
+  int err = ybReplaceFileKeep(db);
+  if (err == YB_OK && db->mem != NULL)
+    resStale(db, outside);
+  return err;
+}
+
+/**
+ * FUNCTION: ybReplaceFileKeep - ybReplaceFile() without reloading a
+ * resident handle
+ *
+ * EXPLAINATION:
+ * for single row writes, the caller applies the same change to the rows
+ * in memory (resAdded() / resRemoved())
+ */
+int ybReplaceFileKeep(YbDb *db) {
+#if defined(_WIN32) || defined(__MINGW32__)
+  remove(db->path);
+#endif
+  if (rename(db->tmpPath, db->path) != 0) {
+    remove(db->tmpPath);
+    return YB_ERR_IO;
+  }
+  ybWriteChecksums(db);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybIterOpen - start reading every row of the data file
+ *
+ * - YbIter **it: receives the iterator, free it with ybIterClose()
+ *
+ * EXPLAINATION:
+ * on an in-memory handle (resident or replica) the rows are locked
+ * until ybIterClose(), so don't add or remove through the same handle
+ * while an iterator is open.
+ */
+int ybIterOpen(YbDb *db, YbIter **it) {
+  *it = calloc(1, sizeof(YbIter));
+  if (*it == NULL)
+    return YB_ERR_NOMEM;
+  (*it)->db = db;
+  if (db->bt != NULL) {
+    btScanStart(db->bt, &(*it)->leaf, &(*it)->pos);
+    return YB_OK;
+  }
+  if (db->mem != NULL) {
+    int err = resEnsure(db);
+    if (err != YB_OK) {
+      free(*it);
+      *it = NULL;
+      return err;
+    }
+    resReadLock(db);
+    return YB_OK;
+  }
+  (*it)->f = fopen(db->path, "r");
+  if ((*it)->f == NULL) {
+    free(*it);
+    *it = NULL;
+    return YB_ERR_IO;
+  }
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybIterNext - read the next row, skipping lines that can't be parsed
+ *
+ * - Student *out: receives the row
+ *
+ * EXPLAINATION:
+ * return 1 if a row was read, 0 at the end of the data file
+ */
+int ybIterNext(YbIter *it, Student *out) {
+  if (it->snap != NULL)
+    return snapNext(it->snap, out) == 1;
+  if (it->db->bt != NULL)
+    return btScanNext(it->db->bt, &it->leaf, &it->pos, out);
+  if (it->db->mem != NULL)
+    return resRowAt(it->db, it->pos++, out);
+  while (fgets(it->line, sizeof(it->line), it->f)) {
+    if (ybParseLine(it->line, out))
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * FUNCTION: ybIterClose - release an iterator from ybIterOpen()
+ */
+void ybIterClose(YbIter *it) {
+  if (it == NULL)
+    return;
+  if (it->f != NULL)
+    fclose(it->f);
+  if (it->db != NULL && it->db->mem != NULL)
+    resUnlock(it->db);
+  snapClose(it->snap);
+  free(it);
+}
+
+/**
+ * FUNCTION: ybThreadCount - amount of worker threads for bulk operations
+ */
+int ybThreadCount(void) {
+#if defined(_WIN32) || defined(__MINGW32__)
+  int n = 4;
+#else
+  int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+/**
+ * FUNCTION: ybCacheStats - page cache statistics of the B+tree backend
+ *
+ * EXPLAINATION:
+ * hit rate is hits / (hits + misses). if it is low for your workload,
+ * reopen with more cachePages. csv handles have no cache.
+ */
+int ybCacheStats(YbDb *db, YbCacheStats *s) {
+  memset(s, 0, sizeof(YbCacheStats));
+  if (db->bt == NULL)
+    return YB_ERR_INVALID;
+  btStats(db->bt, s);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybImportCsv - add every row of a csv file to a B+tree database
+ *
+ * - const char *csvPath: csv file in the data file format
+ * - int *imported: receives amount of added students
+ * - int *skipped: receives amount of rows that were invalid or duplicate
+ *
+ * EXPLAINATION:
+ * rows are inserted one by one and dirty pages are written once at the
+ * end. a csv sorted by id fills every leaf completely since each new id
+ * goes past the last leaf.
+ */
+int ybImportCsv(YbDb *db, const char *csvPath, int *imported, int *skipped) {
+  char line[LINE_MAX_LEN];
+  Student s;
+  *imported = *skipped = 0;
+  if (db->bt == NULL)
+    return YB_ERR_INVALID;
+  FILE *f = fopen(csvPath, "r");
+  if (f == NULL)
+    return YB_ERR_IO;
+  while (fgets(line, sizeof(line), f)) {
+    if (ybParseLine(line, &s) && btAddStudent(db->bt, &s, 0) == YB_OK)
+      (*imported)++;
+    else if (line[0] != '\n')
+      (*skipped)++;
+  }
+  fclose(f);
+  return btCommit(db->bt);
+}
+
+/**
+ * FUNCTION: ybExportCsv - write every student to a csv file in id order
+ */
+int ybExportCsv(YbDb *db, const char *csvPath) {
+  YbIter *it;
+  Student s;
+  int err = ybIterOpen(db, &it);
+  if (err != YB_OK)
+    return err;
+  FILE *f = fopen(csvPath, "w");
+  if (f == NULL) {
+    ybIterClose(it);
+    return YB_ERR_IO;
+  }
+  while (ybIterNext(it, &s))
+    ybWriteLine(f, &s);
+  ybIterClose(it);
+  return fclose(f) == 0 ? YB_OK : YB_ERR_IO;
+}
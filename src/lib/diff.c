@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * roster diff: compare the database with another roster in a single
+ * merge pass over both (they are sorted by id) and apply the result as
+ * one batched update.
+ *
+ * diff file: one line per difference, in id order
+ *   +,<row>   student only in the other roster
+ *   -,<row>   student only in the database
+ *   ~,<row>   same id but another field differs, row from the other roster
+ */
+
+#define DIFF_ADDED '+'
+#define DIFF_REMOVED '-'
+#define DIFF_CHANGED '~'
+
+/**
+ * STRUCT: Side - one roster being merged
+ *
+ * - cur, key: current row and its packed id
+ * - more: 0 once the roster is exhausted
+ */
+typedef struct {
+  YbIter *it;
+  Student cur;
+  uint64_t key;
+  int more;
+} Side;
+
+/**
+ * FUNCTION: sideNext - move a roster to its next row with a valid id
+ *
+ * - long long *skipped: incremented for every row with an invalid id
+ *
+ * EXPLAINATION:
+ * returns YB_ERR_INVALID when the ids don't go up, the merge only
+ * works on rosters sorted by id without duplicates.
+ */
+static int sideNext(Side *s, long long *skipped) {
+  uint64_t prev = s->key;
+  int had = s->more;
+  while ((s->more = ybIterNext(s->it, &s->cur))) {
+    s->key = ybPackId(s->cur.id);
+    if (s->key != UINT64_MAX)
+      break;
+    (*skipped)++;
+  }
+  if (s->more && had && s->key <= prev)
+    return YB_ERR_INVALID;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: sameStudent - compare every field of two students
+ */
+static int sameStudent(const Student *a, const Student *b) {
+  return a->course == b->course && strcmp(a->id, b->id) == 0 &&
+         strcmp(a->name, b->name) == 0 && strcmp(a->nick, b->nick) == 0 &&
+         strcmp(a->email, b->email) == 0 && strcmp(a->phone, b->phone) == 0;
+}
+
+static void writeOp(FILE *f, char op, const Student *s) {
+  fputc(op, f);
+  fputc(',', f);
+  ybWriteLine(f, s);
+}
+
+/**
+ * FUNCTION: ybDiff - compare the database with another roster
+ *
+ * - const char *otherPath: csv roster, e.g. a new export from the registrar
+ * - const char *diffPath: diff file to write
+ * - YbDiffStats *st: receives amount of added, removed, changed and
+ *   unchanged students, skipped = rows of the other roster with an
+ *   invalid id
+ *
+ * EXPLAINATION:
+ * both rosters are read once, row by row, like the merge step of a
+ * merge sort: the smaller id is only in its roster, equal ids are
+ * compared field by field. memory use doesn't depend on the size of
+ * either roster. the other roster has to be sorted by id (ybIsSorted()
+ * / ybSort() on it), YB_ERR_INVALID is returned as soon as it isn't.
+ */
+int ybDiff(YbDb *db, const char *otherPath, const char *diffPath,
+           YbDiffStats *st) {
+  YbDb *other;
+  Side a = {0}, b = {0};
+  long long ignored = 0;
+  memset(st, 0, sizeof(*st));
+  int err = ybOpen(otherPath, &other);
+  if (err != YB_OK)
+    return err;
+  if ((err = ybIterOpen(db, &a.it)) != YB_OK) {
+    ybClose(other);
+    return err;
+  }
+  if ((err = ybIterOpen(other, &b.it)) != YB_OK) {
+    ybIterClose(a.it);
+    ybClose(other);
+    return err;
+  }
+  FILE *out = fopen(diffPath, "w");
+  if (out == NULL)
+    err = YB_ERR_IO;
+
+  if (err == YB_OK)
+    err = sideNext(&a, &ignored);
+  if (err == YB_OK)
+    err = sideNext(&b, &st->skipped);
+  while (err == YB_OK && (a.more || b.more)) {
+    if (!b.more || (a.more && a.key < b.key)) {
+      writeOp(out, DIFF_REMOVED, &a.cur);
+      st->removed++;
+      err = sideNext(&a, &ignored);
+    }
+    else if (!a.more || b.key < a.key) {
+      writeOp(out, DIFF_ADDED, &b.cur);
+      st->added++;
+      err = sideNext(&b, &st->skipped);
+    }
+    else {
+      if (sameStudent(&a.cur, &b.cur)) {
+        st->unchanged++;
+      }
+      else {
+        writeOp(out, DIFF_CHANGED, &b.cur);
+        st->changed++;
+      }
+      err = sideNext(&a, &ignored);
+      if (err == YB_OK)
+        err = sideNext(&b, &st->skipped);
+    }
+  }
+
+  ybIterClose(a.it);
+  ybIterClose(b.it);
+  ybClose(other);
+  if (out != NULL && fclose(out) != 0 && err == YB_OK)
+    err = YB_ERR_IO;
+  if (err != YB_OK && out != NULL)
+    remove(diffPath);
+  return err;
+}
+
+/**
+ * STRUCT: DiffReader - reads a diff file one operation at a time
+ */
+typedef struct {
+  FILE *f;
+  char line[LINE_MAX_LEN];
+  char op;
+  Student s;
+  uint64_t key;
+  int more;
+} DiffReader;
+
+/**
+ * FUNCTION: diffNext - read the next operation of a diff file
+ *
+ * EXPLAINATION:
+ * lines that aren't an operation count as skipped. like sideNext()
+ * YB_ERR_INVALID is returned when the ids don't go up.
+ */
+static int diffNext(DiffReader *d, long long *skipped) {
+  uint64_t prev = d->key;
+  int had = d->more;
+  d->more = 0;
+  while (fgets(d->line, sizeof(d->line), d->f)) {
+    char op = d->line[0];
+    if ((op == DIFF_ADDED || op == DIFF_REMOVED || op == DIFF_CHANGED) &&
+        d->line[1] == ',' && ybParseLine(d->line + 2, &d->s) &&
+        (d->key = ybPackId(d->s.id)) != UINT64_MAX) {
+      d->op = op;
+      d->more = 1;
+      break;
+    }
+    if (d->line[0] != '\n')
+      (*skipped)++;
+  }
+  if (d->more && had && d->key <= prev)
+    return YB_ERR_INVALID;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: applyBtree - ybDiffApply() for the B+tree backend
+ *
+ * EXPLAINATION:
+ * every operation is a point update, dirty pages are written once at
+ * the end. a changed row whose new email is taken keeps its old row.
+ */
+static int applyBtree(YbDb *db, DiffReader *d, YbDiffStats *st) {
+  Student old;
+  int err = diffNext(d, &st->skipped);
+  while (err == YB_OK && d->more) {
+    if (d->op != DIFF_REMOVED && !ybValidStudent(&d->s)) {
+      st->skipped++;
+    }
+    else if (d->op == DIFF_ADDED) {
+      if (btAddStudent(db->bt, &d->s, 0) == YB_OK)
+        st->added++;
+      else
+        st->skipped++;
+    }
+    else if (btRemoveStudent(db->bt, d->s.id, &old, 0) != YB_OK) {
+      st->skipped++;
+    }
+    else if (d->op == DIFF_REMOVED) {
+      st->removed++;
+    }
+    else if (btAddStudent(db->bt, &d->s, 0) == YB_OK) {
+      st->changed++;
+    }
+    else {
+      btAddStudent(db->bt, &old, 0);
+      st->skipped++;
+    }
+    err = diffNext(d, &st->skipped);
+  }
+  int cerr = btCommit(db->bt);
+  return err != YB_OK ? err : cerr;
+}
+
+/**
+ * FUNCTION: ybDiffApply - apply a diff file written by ybDiff()
+ *
+ * - const char *diffPath: diff file
+ * - YbDiffStats *st: receives amount of added, removed and changed
+ *   students, skipped = operations that didn't fit the current data
+ *   (adding an id that exists, removing or changing one that doesn't)
+ *   or had an invalid row
+ *
+ * EXPLAINATION:
+ * csv backend: the data file and the diff are merged into the temp file
+ * in a single pass and the data file is replaced once, no matter how
+ * many rows changed. rows the diff doesn't touch are copied as is.
+ * unlike ybAdd() emails aren't checked against the rest of the data,
+ * that would need a second pass. the diff comes from a whole roster,
+ * so keeping emails unique is up to whoever made that roster.
+ */
+int ybDiffApply(YbDb *db, const char *diffPath, YbDiffStats *st) {
+  DiffReader d = {0};
+  char line[LINE_MAX_LEN];
+  Student cur;
+  uint64_t k;
+  memset(st, 0, sizeof(*st));
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  d.f = fopen(diffPath, "r");
+  if (d.f == NULL)
+    return YB_ERR_IO;
+  if (db->bt != NULL) {
+    int err = applyBtree(db, &d, st);
+    fclose(d.f);
+    return err;
+  }
+
+  FILE *in = fopen(db->path, "r");
+  FILE *out = fopen(db->tmpPath, "w");
+  if (in == NULL || out == NULL) {
+    if (in != NULL)
+      fclose(in);
+    if (out != NULL)
+      fclose(out);
+    fclose(d.f);
+    return YB_ERR_IO;
+  }
+
+  int err = diffNext(&d, &st->skipped);
+  while (err == YB_OK && fgets(line, sizeof(line), in)) {
+    if (!ybParseLine(line, &cur) || (k = ybPackId(cur.id)) == UINT64_MAX) {
+      fputs(line, out);
+      continue;
+    }
+    /** operations before this row can only be additions */
+    while (err == YB_OK && d.more && d.key < k) {
+      if (d.op == DIFF_ADDED && ybValidStudent(&d.s)) {
+        ybWriteLine(out, &d.s);
+        st->added++;
+      }
+      else {
+        st->skipped++;
+      }
+      err = diffNext(&d, &st->skipped);
+    }
+    if (err != YB_OK || !d.more || d.key != k) {
+      fputs(line, out);
+      continue;
+    }
+    if (d.op == DIFF_REMOVED) {
+      st->removed++;
+    }
+    else if (d.op == DIFF_CHANGED && ybValidStudent(&d.s)) {
+      ybWriteLine(out, &d.s);
+      st->changed++;
+    }
+    else {
+      fputs(line, out);
+      st->skipped++;
+    }
+    err = diffNext(&d, &st->skipped);
+  }
+  /** whatever is left comes after the last row */
+  while (err == YB_OK && d.more) {
+    if (d.op == DIFF_ADDED && ybValidStudent(&d.s)) {
+      ybWriteLine(out, &d.s);
+      st->added++;
+    }
+    else {
+      st->skipped++;
+    }
+    err = diffNext(&d, &st->skipped);
+  }
+
+  fclose(in);
+  fclose(d.f);
+  if (fclose(out) != 0 && err == YB_OK)
+    err = YB_ERR_IO;
+  if (err != YB_OK) {
+    remove(db->tmpPath);
+    return err;
+  }
+  err = ybReplaceFile(db);
+  if (err == YB_OK)
+    replReset(db);
+  return err;
+}
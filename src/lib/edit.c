@@ -0,0 +1,313 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * FUNCTION: ybValidStudent - check every field of a student before writing it
+ *
+ * EXPLAINATION:
+ * a comma anywhere would break the data file, so it isn't allowed
+ */
+int ybValidStudent(const Student *x) {
+  if (!ybValidId(x->id) || x->course < 0 || x->course > 3 ||
+      !ybValidEmail(x->email) || !ybValidPhone(x->phone))
+    return 0;
+  if (x->name[0] == '\0' || x->nick[0] == '\0' || strchr(x->name, ',') ||
+      strchr(x->nick, ','))
+    return 0;
+  return 1;
+}
+
+/**
+ * FUNCTION: ybAdd - add one student to the data file
+ *
+ * - const Student *x: student to add
+ *
+ * EXPLAINATION:
+ * copy the data file into the temp file, writing x right before the
+ * first row with a bigger id so the file stays sorted, then replace
+ * the data file. if a row with the same id or email is found on the
+ * way the temp file is thrown away and YB_ERR_DUPLICATE is returned.
+ * a duplicate name is allowed, check with ybCheckDuplicate() first
+ * if that matters.
+ */
+int ybAdd(YbDb *db, const Student *x) {
+  char line[LINE_MAX_LEN];
+  Student cur;
+  int written = 0, err = YB_OK;
+  uint64_t key = ybPackId(x->id);
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  if (!ybValidStudent(x))
+    return YB_ERR_INVALID;
+  if (db->bt != NULL)
+    return btAddStudent(db->bt, x, 1);
+
+  /** a resident handle in sync with the file adds x to memory too */
+  int patch = db->mem != NULL && resCurrent(db);
+  FILE *in = fopen(db->path, "r");
+  FILE *out = fopen(db->tmpPath, "w");
+  if (in == NULL || out == NULL) {
+    if (in != NULL)
+      fclose(in);
+    if (out != NULL)
+      fclose(out);
+    return YB_ERR_IO;
+  }
+  while (err == YB_OK && fgets(line, sizeof(line), in)) {
+    if (ybParseLine(line, &cur)) {
+      if (strcmp(cur.id, x->id) == 0 || strcmp(cur.email, x->email) == 0)
+        err = YB_ERR_DUPLICATE;
+      if (!written && ybPackId(cur.id) > key) {
+        ybWriteLine(out, x);
+        written = 1;
+      }
+    }
+    fputs(line, out);
+  }
+  if (!written)
+    ybWriteLine(out, x);
+  fclose(in);
+  if (fclose(out) != 0 && err == YB_OK)
+    err = YB_ERR_IO;
+  if (err != YB_OK) {
+    remove(db->tmpPath);
+    return err;
+  }
+  err = patch ? ybReplaceFileKeep(db) : ybReplaceFile(db);
+  if (err == YB_OK && patch)
+    resAdded(db, x);
+  if (err == YB_OK)
+    replAdded(db, x);
+  return err;
+}
+
+/**
+ * FUNCTION: ybRemove - remove one student from the data file
+ *
+ * - const char id[]: full 11 digits id
+ * - Student *removed: receives the removed row (may be NULL)
+ *
+ * EXPLAINATION:
+ * copy every row except the specified student into the temp file
+ * and replace the data file with it. rows that can't be parsed are
+ * copied as is.
+ */
+int ybRemove(YbDb *db, const char id[], Student *removed) {
+  char line[LINE_MAX_LEN];
+  Student cur;
+  int fnd = 0;
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  if (!ybValidId(id))
+    return YB_ERR_INVALID;
+  if (db->bt != NULL)
+    return btRemoveStudent(db->bt, id, removed, 1);
+
+  int patch = db->mem != NULL && resCurrent(db);
+  FILE *in = fopen(db->path, "r");
+  FILE *out = fopen(db->tmpPath, "w");
+  if (in == NULL || out == NULL) {
+    if (in != NULL)
+      fclose(in);
+    if (out != NULL)
+      fclose(out);
+    return YB_ERR_IO;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    if (strncmp(line, id, 11) == 0 && line[11] == ',' &&
+        ybParseLine(line, &cur)) {
+      if (removed != NULL && !fnd)
+        *removed = cur;
+      fnd = 1;
+      continue;
+    }
+    fputs(line, out);
+  }
+  fclose(in);
+  if (fclose(out) != 0 || !fnd) {
+    remove(db->tmpPath);
+    return fnd ? YB_ERR_IO : YB_ERR_NOT_FOUND;
+  }
+  int err = patch ? ybReplaceFileKeep(db) : ybReplaceFile(db);
+  if (err == YB_OK && patch)
+    resRemoved(db, id);
+  if (err == YB_OK)
+    replRemoved(db, id);
+  return err;
+}
+
+/**
+ * FUNCTION: compareIdString - comparator for qsort() and bsearch() on id strings
+ */
+static int compareIdString(const void *a, const void *b) {
+  return strcmp((const char *)a, (const char *)b);
+}
+
+/**
+ * FUNCTION: ybFilterLoadIds - read an id list file into a filter
+ *
+ * - YbFilter *f: filter to store the id list in, free with ybFilterFree()
+ * - const char *path: path of id file (one 11 digits id per line)
+ * - int *skipped: receives amount of lines that aren't a valid id
+ *
+ * EXPLAINATION:
+ * the list is sorted so matching a row is a binary search instead
+ * of a scan through the whole list.
+ */
+int ybFilterLoadIds(YbFilter *f, const char *path, int *skipped) {
+  char line[LINE_MAX_LEN], id[20];
+  int cap = 1024;
+  *skipped = 0;
+  FILE *in = fopen(path, "r");
+  if (in == NULL)
+    return YB_ERR_IO;
+
+  f->idCount = 0;
+  f->ids = malloc(cap * sizeof(*f->ids));
+  while (fgets(line, sizeof(line), in)) {
+    if (sscanf(line, "%19s", id) != 1)
+      continue;
+    if (!ybValidId(id)) {
+      (*skipped)++;
+      continue;
+    }
+    if (f->idCount == cap) {
+      cap *= 2;
+      f->ids = realloc(f->ids, cap * sizeof(*f->ids));
+    }
+    strcpy(f->ids[f->idCount++], id);
+  }
+  fclose(in);
+  qsort(f->ids, f->idCount, sizeof(*f->ids), compareIdString);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybFilterFree - release the id list of a filter
+ */
+void ybFilterFree(YbFilter *f) {
+  free(f->ids);
+  f->ids = NULL;
+  f->idCount = 0;
+}
+
+/**
+ * FUNCTION: ybFilterMatch - check if a student match a filter
+ */
+int ybFilterMatch(const YbFilter *f, const Student *s) {
+  if (f->ids != NULL)
+    return bsearch(s->id, f->ids, f->idCount, sizeof(*f->ids),
+                   compareIdString) != NULL;
+  if (f->prefix[0] != '\0' &&
+      strncmp(s->id, f->prefix, strlen(f->prefix)) != 0)
+    return 0;
+  if (f->course >= 0 && s->course != f->course)
+    return 0;
+  return 1;
+}
+
+/**
+ * FUNCTION: ybCountWhere - count students matching a filter (dry run)
+ */
+int ybCountWhere(YbDb *db, const YbFilter *f, int *matched) {
+  YbIter *it;
+  Student cur;
+  *matched = 0;
+  int err = ybIterOpen(db, &it);
+  if (err != YB_OK)
+    return err;
+  while (ybIterNext(it, &cur))
+    if (ybFilterMatch(f, &cur))
+      (*matched)++;
+  ybIterClose(it);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: removeWhereBtree - ybRemoveWhere() for the B+tree backend
+ *
+ * EXPLAINATION:
+ * collect the matching ids first (removing while scanning would move
+ * the cursor), then remove each one and flush dirty pages once.
+ */
+static int removeWhereBtree(YbDb *db, const YbFilter *f, int *removed) {
+  YbIter *it;
+  Student cur;
+  int n = 0, cap = 1024, err = ybIterOpen(db, &it);
+  if (err != YB_OK)
+    return err;
+  char (*ids)[12] = malloc(cap * sizeof(*ids));
+  while (ybIterNext(it, &cur)) {
+    if (!ybFilterMatch(f, &cur))
+      continue;
+    if (n == cap) {
+      cap *= 2;
+      ids = realloc(ids, cap * sizeof(*ids));
+    }
+    strcpy(ids[n++], cur.id);
+  }
+  ybIterClose(it);
+  for (int j = 0; j < n; j++)
+    if (btRemoveStudent(db->bt, ids[j], NULL, 0) == YB_OK)
+      (*removed)++;
+  free(ids);
+  return btCommit(db->bt);
+}
+
+/**
+ * FUNCTION: ybRemoveWhere - remove every student matching a filter
+ *
+ * - int *removed: receives amount of removed students
+ *
+ * EXPLAINATION:
+ * a single pass copying every row that doesn't match into the temp
+ * file, then the data file is replaced once no matter how many
+ * students got removed. rows that can't be parsed are copied as is
+ * so nothing is lost by accident. on a primary the removed ids are
+ * kept to send them to the replicas once the file is replaced.
+ */
+int ybRemoveWhere(YbDb *db, const YbFilter *f, int *removed) {
+  char line[LINE_MAX_LEN];
+  Student cur;
+  char (*gone)[12] = NULL;
+  int goneCap = 0;
+  *removed = 0;
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  if (db->bt != NULL)
+    return removeWhereBtree(db, f, removed);
+
+  FILE *in = fopen(db->path, "r");
+  FILE *out = fopen(db->tmpPath, "w");
+  if (in == NULL || out == NULL) {
+    if (in != NULL)
+      fclose(in);
+    if (out != NULL)
+      fclose(out);
+    return YB_ERR_IO;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    if (ybParseLine(line, &cur) && ybFilterMatch(f, &cur)) {
+      if (db->repl != NULL) {
+        if (*removed == goneCap) {
+          goneCap = goneCap ? goneCap * 2 : 1024;
+          gone = realloc(gone, goneCap * sizeof(*gone));
+        }
+        strcpy(gone[*removed], cur.id);
+      }
+      (*removed)++;
+      continue;
+    }
+    fputs(line, out);
+  }
+  fclose(in);
+  int err = fclose(out) != 0 ? YB_ERR_IO : ybReplaceFile(db);
+  if (err != YB_OK)
+    remove(db->tmpPath);
+  for (int j = 0; err == YB_OK && j < *removed && gone != NULL; j++)
+    replRemoved(db, gone[j]);
+  free(gone);
+  return err;
+}
@@ -0,0 +1,468 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * bulk export to JSON Lines, TSV or a paged HTML yearbook
+ *
+ * rows are read in batches of (threads x EXPORT_BLOCK_ROWS). each
+ * thread formats one block into its own buffer with plain byte copies
+ * (no printf), then the buffers are written in order with one fwrite()
+ * each. the buffers are kept between batches, so after the first batch
+ * nothing is allocated anymore.
+ *
+ * id order streams straight from the data (the data file is sorted by
+ * id), other orders load the matching rows and sort them first.
+ */
+
+#define EXPORT_BLOCK_ROWS 4096
+// markup around one row, the longest is the HTML one plus a page break
+#define EXPORT_MARKUP_MAX 512
+// an escaped byte takes at most 6 bytes ("\u001f" or "&quot;")
+#define EXPORT_ESCAPE_MAX 6
+// html groups: the 4 courses, then rows with an unknown course
+#define EXPORT_GROUPS 5
+
+static const char *programName[EXPORT_GROUPS] = {
+    "Regular Program", "International Program", "Health Data Science Program",
+    "Residential College Program", "Other"};
+
+/**
+ * STRUCT: FormatTask - one block of rows formatted by one thread
+ *
+ * - rows, n: rows of this block
+ * - first: position of rows[0] in its group, pages start every pageSize rows
+ * - pageBase: pages before this group (html page numbers)
+ * - group: html group of the rows
+ * - buf, cap, len: output buffer, reused between batches
+ */
+typedef struct {
+  const YbExportOptions *o;
+  const Student *rows;
+  int n;
+  long long first;
+  long long pageBase;
+  int group;
+  char *buf;
+  size_t cap;
+  size_t len;
+} FormatTask;
+
+static char *putStr(char *p, const char *s) {
+  size_t n = strlen(s);
+  memcpy(p, s, n);
+  return p + n;
+}
+
+static char *putInt(char *p, long long v) {
+  char tmp[24];
+  int n = 0;
+  if (v < 0) {
+    *p++ = '-';
+    v = -v;
+  }
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0);
+  while (n > 0)
+    *p++ = tmp[--n];
+  return p;
+}
+
+/**
+ * FUNCTION: putJson - write a JSON string (with quotes)
+ *
+ * EXPLAINATION:
+ * bytes >= 0x80 are copied as is, the data file is UTF-8 already
+ */
+static char *putJson(char *p, const char *s) {
+  static const char hex[] = "0123456789abcdef";
+  *p++ = '"';
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      *p++ = '\\';
+      *p++ = c;
+    }
+    else if (c < 0x20) {
+      p = putStr(p, "\\u00");
+      *p++ = hex[c >> 4];
+      *p++ = hex[c & 15];
+    }
+    else {
+      *p++ = c;
+    }
+  }
+  *p++ = '"';
+  return p;
+}
+
+/**
+ * FUNCTION: putTsv - write a TSV field, tabs and control characters become spaces
+ */
+static char *putTsv(char *p, const char *s) {
+  for (; *s; s++)
+    *p++ = (unsigned char)*s < 0x20 ? ' ' : *s;
+  return p;
+}
+
+static char *putHtml(char *p, const char *s) {
+  for (; *s; s++) {
+    switch (*s) {
+    case '&':
+      p = putStr(p, "&amp;");
+      break;
+    case '<':
+      p = putStr(p, "&lt;");
+      break;
+    case '>':
+      p = putStr(p, "&gt;");
+      break;
+    case '"':
+      p = putStr(p, "&quot;");
+      break;
+    default:
+      *p++ = *s;
+    }
+  }
+  return p;
+}
+
+static char *formatJson(char *p, const Student *s) {
+  p = putStr(p, "{\"id\":");
+  p = putJson(p, s->id);
+  p = putStr(p, ",\"name\":");
+  p = putJson(p, s->name);
+  p = putStr(p, ",\"nick\":");
+  p = putJson(p, s->nick);
+  p = putStr(p, ",\"course\":");
+  p = putInt(p, s->course);
+  p = putStr(p, ",\"email\":");
+  p = putJson(p, s->email);
+  p = putStr(p, ",\"phone\":");
+  p = putJson(p, s->phone);
+  return putStr(p, "}\n");
+}
+
+static char *formatTsv(char *p, const Student *s) {
+  p = putTsv(p, s->id);
+  *p++ = '\t';
+  p = putTsv(p, s->name);
+  *p++ = '\t';
+  p = putTsv(p, s->nick);
+  *p++ = '\t';
+  p = putInt(p, s->course);
+  *p++ = '\t';
+  p = putTsv(p, s->email);
+  *p++ = '\t';
+  p = putTsv(p, s->phone);
+  *p++ = '\n';
+  return p;
+}
+
+/**
+ * FUNCTION: formatHtml - one yearbook entry, opening a new page when needed
+ *
+ * - long long pos: position of the row in its group
+ */
+static char *formatHtml(char *p, const Student *s, const FormatTask *t,
+                        long long pos) {
+  int ps = t->o->pageSize;
+  if (pos % ps == 0) {
+    if (pos > 0)
+      p = putStr(p, "</section>\n");
+    p = putStr(p, "<section class=\"page\"><header>");
+    p = putStr(p, programName[t->group]);
+    p = putStr(p, "<span>page ");
+    p = putInt(p, t->pageBase + pos / ps + 1);
+    p = putStr(p, "</span></header>\n");
+  }
+  p = putStr(p, "<div class=\"entry\"><div class=\"photo\"></div><h3>");
+  p = putHtml(p, s->name);
+  p = putStr(p, "</h3><p class=\"nick\">");
+  p = putHtml(p, s->nick);
+  p = putStr(p, "</p><p>");
+  p = putHtml(p, s->id);
+  p = putStr(p, "</p><p>");
+  p = putHtml(p, s->email);
+  p = putStr(p, "</p><p>");
+  p = putHtml(p, s->phone);
+  return putStr(p, "</p></div>\n");
+}
+
+/**
+ * FUNCTION: formatWorker - thread entry, format one block into its buffer
+ *
+ * EXPLAINATION:
+ * the buffer is grown (rarely) to the worst case of this block before
+ * formatting, so the row formatters never check for space.
+ */
+static void *formatWorker(void *arg) {
+  FormatTask *t = arg;
+  size_t need = 0;
+  for (int j = 0; j < t->n; j++) {
+    const Student *s = &t->rows[j];
+    need += EXPORT_MARKUP_MAX +
+            EXPORT_ESCAPE_MAX * (strlen(s->id) + strlen(s->name) +
+                                 strlen(s->nick) + strlen(s->email) +
+                                 strlen(s->phone));
+  }
+  if (need > t->cap) {
+    free(t->buf);
+    t->cap = need;
+    t->buf = malloc(need);
+  }
+  char *p = t->buf;
+  for (int j = 0; j < t->n; j++) {
+    if (t->o->format == YB_EXPORT_JSONL)
+      p = formatJson(p, &t->rows[j]);
+    else if (t->o->format == YB_EXPORT_TSV)
+      p = formatTsv(p, &t->rows[j]);
+    else
+      p = formatHtml(p, &t->rows[j], t, t->first + j);
+  }
+  t->len = p - t->buf;
+  return NULL;
+}
+
+/**
+ * STRUCT: Exporter - state shared by the batches of one export
+ *
+ * - batch: rows of the current batch (threads x EXPORT_BLOCK_ROWS)
+ * - sorted, sortedN: every matching row in output order (non id order)
+ */
+typedef struct {
+  YbDb *db;
+  const YbExportOptions *o;
+  FILE *out;
+  int nt;
+  FormatTask *tasks;
+  Student *batch;
+  Student *sorted;
+  long long sortedN;
+} Exporter;
+
+/**
+ * FUNCTION: inGroup - check if a row belongs to an html group (-1 = any)
+ */
+static int inGroup(const Student *s, int group) {
+  if (group < 0)
+    return 1;
+  if (group < 4)
+    return s->course == group;
+  return s->course < 0 || s->course > 3;
+}
+
+static int matches(const Exporter *e, const Student *s, int group) {
+  return inGroup(s, group) &&
+         (e->o->filter == NULL || ybFilterMatch(e->o->filter, s));
+}
+
+/**
+ * FUNCTION: exportGroup - format and write every row of a group
+ *
+ * - int group: html group, -1 for every row
+ * - const char *heading: written before the first row, NULL for none
+ * - long long pageBase: pages written before this group
+ * - long long *rows: receives amount of rows written
+ */
+static int exportGroup(Exporter *e, int group, const char *heading,
+                       long long pageBase, long long *rows) {
+  YbIter *it = NULL;
+  long long pos = 0, next = 0;
+  int cap = e->nt * EXPORT_BLOCK_ROWS, more = 1, err = YB_OK;
+  *rows = 0;
+  if (e->sorted == NULL && (err = ybIterOpen(e->db, &it)) != YB_OK)
+    return err;
+
+  while (more) {
+    /** fill a batch */
+    int n = 0;
+    while (n < cap) {
+      if (it != NULL) {
+        if (!(more = ybIterNext(it, &e->batch[n])))
+          break;
+        if (matches(e, &e->batch[n], group))
+          n++;
+      }
+      else {
+        if (!(more = next < e->sortedN))
+          break;
+        if (inGroup(&e->sorted[next], group))
+          e->batch[n++] = e->sorted[next];
+        next++;
+      }
+    }
+    if (n == 0)
+      break;
+
+    /** format blocks in parallel, then write them in order */
+    int blocks = (n + EXPORT_BLOCK_ROWS - 1) / EXPORT_BLOCK_ROWS;
+    pthread_t th[MAX_THREADS];
+    int threaded[MAX_THREADS];
+    if (pos == 0 && heading != NULL)
+      fputs(heading, e->out);
+    for (int t = 0; t < blocks; t++) {
+      FormatTask *ft = &e->tasks[t];
+      ft->rows = e->batch + t * EXPORT_BLOCK_ROWS;
+      ft->n = t == blocks - 1 ? n - t * EXPORT_BLOCK_ROWS : EXPORT_BLOCK_ROWS;
+      ft->first = pos + t * EXPORT_BLOCK_ROWS;
+      ft->pageBase = pageBase;
+      ft->group = group < 0 ? 0 : group;
+      threaded[t] =
+          blocks > 1 && pthread_create(&th[t], NULL, formatWorker, ft) == 0;
+      if (!threaded[t]) // a single block, or no thread available
+        formatWorker(ft);
+    }
+    for (int t = 0; t < blocks; t++) {
+      if (threaded[t])
+        pthread_join(th[t], NULL);
+      if (fwrite(e->tasks[t].buf, 1, e->tasks[t].len, e->out) != e->tasks[t].len)
+        err = YB_ERR_IO;
+    }
+    pos += n;
+    if (err != YB_OK)
+      break;
+  }
+  ybIterClose(it);
+  *rows = pos;
+  return err;
+}
+
+/**
+ * FUNCTION: compareName / compareNick - orders for ybExport()
+ *
+ * EXPLAINATION:
+ * ties are broken by id so the output doesn't depend on qsort()
+ */
+static int compareName(const void *a, const void *b) {
+  const Student *x = a, *y = b;
+  int c = strcmp(x->name, y->name);
+  return c != 0 ? c : strcmp(x->id, y->id);
+}
+
+static int compareNick(const void *a, const void *b) {
+  const Student *x = a, *y = b;
+  int c = strcmp(x->nick, y->nick);
+  return c != 0 ? c : strcmp(x->id, y->id);
+}
+
+/**
+ * FUNCTION: loadSorted - read every matching row and sort them
+ */
+static int loadSorted(Exporter *e) {
+  YbIter *it;
+  long long cap = 1024;
+  int err = ybIterOpen(e->db, &it);
+  if (err != YB_OK)
+    return err;
+  e->sorted = malloc(cap * sizeof(Student));
+  e->sortedN = 0;
+  while (e->sorted != NULL && ybIterNext(it, &e->sorted[e->sortedN])) {
+    if (!matches(e, &e->sorted[e->sortedN], -1))
+      continue;
+    if (++e->sortedN == cap) {
+      cap *= 2;
+      Student *grown = realloc(e->sorted, cap * sizeof(Student));
+      if (grown == NULL) {
+        free(e->sorted);
+        e->sorted = NULL;
+      }
+      e->sorted = grown;
+    }
+  }
+  ybIterClose(it);
+  if (e->sorted == NULL)
+    return YB_ERR_NOMEM;
+  qsort(e->sorted, e->sortedN, sizeof(Student),
+        e->o->order == YB_ORDER_NAME ? compareName : compareNick);
+  return YB_OK;
+}
+
+static const char *htmlHead =
+    "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">"
+    "<title>Yearbook</title>\n<style>\n"
+    "body{font-family:sans-serif;margin:0}\n"
+    "h1{margin:24px}\n"
+    ".page{display:flex;flex-wrap:wrap;gap:12px;padding:24px;"
+    "page-break-after:always}\n"
+    ".page header{width:100%;font-weight:bold;display:flex;"
+    "justify-content:space-between}\n"
+    ".entry{width:180px;border:1px solid #ccc;padding:8px}\n"
+    ".entry h3{margin:4px 0;font-size:14px}\n"
+    ".entry p{margin:2px 0;font-size:12px}\n"
+    ".photo{width:100%;height:160px;background:#eee}\n"
+    ".nick{font-style:italic}\n"
+    "</style></head><body>\n";
+
+/**
+ * FUNCTION: ybExport - write the roster in a machine or yearbook format
+ *
+ * - const char *path: output file
+ * - const YbExportOptions *o: format, order, filter and html page size
+ * - long long *rows: receives amount of exported students
+ *
+ * EXPLAINATION:
+ * YB_EXPORT_JSONL: one JSON object per line
+ * YB_EXPORT_TSV: header line, then one row per line
+ * YB_EXPORT_HTML: one section per course, split into pages of
+ * pageSize entries with page numbers running through the document,
+ * courses without students are left out. in id order each course is
+ * one more pass over the data instead of holding the rows in memory.
+ */
+int ybExport(YbDb *db, const char *path, const YbExportOptions *o,
+             long long *rows) {
+  Exporter e = {db, o, NULL, ybThreadCount(), NULL, NULL, NULL, 0};
+  int err = YB_OK;
+  *rows = 0;
+  if (o->format < YB_EXPORT_JSONL || o->format > YB_EXPORT_HTML ||
+      o->order < YB_ORDER_ID || o->order > YB_ORDER_NICK ||
+      (o->format == YB_EXPORT_HTML && o->pageSize < 1))
+    return YB_ERR_INVALID;
+  if (o->order != YB_ORDER_ID && (err = loadSorted(&e)) != YB_OK)
+    return err;
+
+  e.out = fopen(path, "wb");
+  e.tasks = calloc(e.nt, sizeof(FormatTask));
+  e.batch = malloc((size_t)e.nt * EXPORT_BLOCK_ROWS * sizeof(Student));
+  if (e.out == NULL || e.tasks == NULL || e.batch == NULL)
+    err = e.out == NULL ? YB_ERR_IO : YB_ERR_NOMEM;
+  for (int t = 0; e.tasks != NULL && t < e.nt; t++)
+    e.tasks[t].o = o;
+
+  if (err == YB_OK && o->format == YB_EXPORT_TSV)
+    fputs("id\tname\tnick\tcourse\temail\tphone\n", e.out);
+  if (err == YB_OK && o->format != YB_EXPORT_HTML) {
+    err = exportGroup(&e, -1, NULL, 0, rows);
+  }
+  else if (err == YB_OK) {
+    long long pages = 0, n;
+    fputs(htmlHead, e.out);
+    for (int g = 0; g < EXPORT_GROUPS && err == YB_OK; g++) {
+      char heading[64];
+      snprintf(heading, sizeof(heading), "<h1>%s</h1>\n", programName[g]);
+      err = exportGroup(&e, g, heading, pages, &n);
+      if (n > 0)
+        fputs("</section>\n", e.out);
+      pages += (n + o->pageSize - 1) / o->pageSize;
+      *rows += n;
+    }
+    fputs("</body></html>\n", e.out);
+  }
+
+  if (e.out != NULL) {
+    if (fclose(e.out) != 0 && err == YB_OK)
+      err = YB_ERR_IO;
+    if (err != YB_OK)
+      remove(path);
+  }
+  for (int t = 0; e.tasks != NULL && t < e.nt; t++)
+    free(e.tasks[t].buf);
+  free(e.tasks);
+  free(e.batch);
+  free(e.sorted);
+  return err;
+}
@@ -0,0 +1,116 @@
+/**
+ * private definitions shared by the libyookbeer sources.
+ * not installed, callers only see yookbeer.h
+ */
+#ifndef YOOKBEER_INTERNAL_H
+#define YOOKBEER_INTERNAL_H
+
+#include <stdio.h>
+
+#include "../yookbeer.h"
+
+// default memory budget for sorting, see ybSetMemBudget()
+#define DEFAULT_MEM_BUDGET_MB 256
+// maximum amount of sorted runs merged at once by the external sort
+#define MERGE_FANIN 64
+// upper bound for worker threads used by bulk operations
+#define MAX_THREADS 16
+// longest data line we accept (a valid row is at most 170 characters)
+#define LINE_MAX_LEN 256
+// bytes covered by each checksum of `<data file>.crc`, see ybWriteChecksums()
+#define VERIFY_BLOCK (1 << 20)
+
+typedef struct BTree BTree;
+typedef struct SnapReader SnapReader;
+typedef struct Resident Resident;
+typedef struct Repl Repl;
+
+/**
+ * - bt: B+tree backend, NULL when the data file is a csv
+ * - mem: rows kept in memory, see ybOpenResident() (csv only) and
+ *   ybOpenReplica()
+ * - repl: primary or replica side of replication, NULL otherwise. a
+ *   replica has no data file, path is the primary's socket
+ */
+struct YbDb {
+  char path[256];
+  char tmpPath[264];
+  long long memBudget;
+  BTree *bt;
+  Resident *mem;
+  Repl *repl;
+};
+
+/**
+ * - f, line: csv backend
+ * - db, leaf, pos: B+tree backend cursor (resident: pos in id order)
+ * - snap: snapshot reader, see ybSnapshotIterOpen() (db is NULL then)
+ */
+struct YbIter {
+  FILE *f;
+  char line[LINE_MAX_LEN];
+  YbDb *db;
+  uint32_t leaf;
+  int pos;
+  SnapReader *snap;
+};
+
+int ybParseLine(const char *line, Student *s);
+void ybWriteLine(FILE *f, const Student *s);
+int ybReplaceFile(YbDb *db);
+int ybReplaceFileKeep(YbDb *db);
+int ybValidStudent(const Student *x);
+void ybRadixSortIndex(uint64_t *keys, int *idx, int n);
+int ybThreadCount(void);
+uint32_t ybCrc32c(uint32_t crc, const void *data, size_t n);
+const char *ybMapFile(const char *path, size_t *size, int *mapped);
+void ybUnmapFile(const char *buf, size_t size, int mapped);
+int ybFoldKey(const char *s, int len, char *out);
+int ybSearchKey(const Student *s, YbSearchField field, char *out);
+
+// B+tree backend (btree.c)
+int btOpen(const char *path, int cachePages, BTree **out);
+void btClose(BTree *bt);
+int btAddStudent(BTree *bt, const Student *x, int flush);
+int btRemoveStudent(BTree *bt, const char id[], Student *removed, int flush);
+int btCommit(BTree *bt);
+void btCheckDuplicate(BTree *bt, const Student *x, CheckDuplicateResponse *r);
+int btGetStudent(BTree *bt, uint64_t id, Student *out);
+long long btRows(BTree *bt);
+void btScanStart(BTree *bt, uint32_t *leaf, int *pos);
+int btScanNext(BTree *bt, uint32_t *leaf, int *pos, Student *out);
+void btStats(BTree *bt, YbCacheStats *s);
+
+// resident mode (resident.c)
+int resEnsure(YbDb *db);
+void resStale(YbDb *db, int outside);
+int resChanged(YbDb *db);
+int resCurrent(YbDb *db);
+void resAdded(YbDb *db, const Student *x);
+void resRemoved(YbDb *db, const char id[]);
+int resRows(YbDb *db);
+int resRowAt(YbDb *db, int pos, Student *out);
+int resGet(YbDb *db, uint64_t key, Student *out);
+void resReadLock(YbDb *db);
+void resWriteLock(YbDb *db);
+void resUnlock(YbDb *db);
+int resCreate(YbDb *db);
+void resClear(YbDb *db);
+void resPut(YbDb *db, const Student *s);
+void resDelete(YbDb *db, const char id[]);
+void resFree(Resident *m);
+int resSearch(YbDb *db, const YbQuery *q, YbRowFn fn, void *ctx, int *total);
+
+// replication (replica.c), the repl* hooks do nothing unless db is a primary
+void replAdded(YbDb *db, const Student *x);
+void replRemoved(YbDb *db, const char id[]);
+void replReset(YbDb *db);
+void replStop(YbDb *db);
+int replReadOnly(YbDb *db);
+
+// snapshot reader (snapshot.c)
+int snapOpen(const char *path, SnapReader **out);
+int snapNext(SnapReader *s, Student *out);
+void snapClose(SnapReader *s);
+
+#endif
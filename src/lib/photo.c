@@ -0,0 +1,841 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32) || defined(__MINGW32__)
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * photo store: portraits attached to student ids
+ *
+ * photos are content addressed, a photo is stored once under its
+ * SHA-256 no matter how many students (or uploads) use it. the bytes go
+ * into large append-only segment files, `photos.idx` is an append-only
+ * log of fixed size records saying where each blob is and which blob
+ * belongs to which student. opening the store reads the log into hash
+ * tables, reading a photo is then a pointer into the mmap of its
+ * segment (fread into a buffer where mmap isn't available).
+ *
+ * thumbnails are made on first use, stored as blobs like the photos and
+ * remembered in the log, so they are only ever made once per photo.
+ * thumbnails need the photo as a binary PPM (P6) or PGM (P5).
+ */
+
+// a segment is closed once it reaches this size
+#define PHOTO_SEG_MAX (64L << 20)
+// longest side of a thumbnail in pixels
+#define PHOTO_THUMB_SIDE 96
+#define PHOTO_LOG "photos.idx"
+
+#define REC_BLOB 'B'
+#define REC_STUDENT 'S'
+#define REC_THUMB 'T'
+
+/**
+ * STRUCT: PhotoRec - one record of the log
+ *
+ * - B: blob `a` is in segment seg at off, len bytes long
+ * - S: student with packed id off now has photo `a` (all zero: removed)
+ * - T: thumbnail of photo `a` is blob `b`
+ */
+typedef struct {
+  uint8_t type;
+  uint8_t pad[3];
+  uint32_t seg;
+  uint64_t off;
+  uint64_t len;
+  uint8_t a[32];
+  uint8_t b[32];
+} PhotoRec;
+
+/**
+ * - thumb: blob index of the thumbnail, -1 until it is made
+ */
+typedef struct {
+  uint8_t hash[32];
+  uint32_t seg;
+  uint64_t off;
+  uint64_t len;
+  int thumb;
+} Blob;
+
+/**
+ * - size: bytes written so far
+ * - map, mapLen: read only mapping, remapped when a blob lies past mapLen
+ */
+typedef struct {
+  FILE *f;
+  long size;
+  uint8_t *map;
+  size_t mapLen;
+} Segment;
+
+/**
+ * - slots: blob hash -> blob index, open addressing, -1 = empty
+ * - ids, photo: packed student id -> blob index (-1 = removed), empty
+ *   slots have id UINT64_MAX
+ * - buf: fread fallback and work buffer for thumbnails
+ */
+struct YbPhotos {
+  char dir[256];
+  FILE *log;
+  Blob *blobs;
+  int nBlobs, capBlobs;
+  int *slots;
+  int slotCap;
+  uint64_t *ids;
+  int *photo;
+  int idCap, idUsed;
+  Segment *segs;
+  int nSegs;
+  uint8_t *buf;
+  size_t bufCap;
+};
+
+/**
+ * SHA-256 (FIPS 180-4)
+ */
+static const uint32_t shaK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void shaBlock(uint32_t h[8], const uint8_t *p) {
+  uint32_t w[64];
+  for (int j = 0; j < 16; j++)
+    w[j] = (uint32_t)p[4 * j] << 24 | (uint32_t)p[4 * j + 1] << 16 |
+           (uint32_t)p[4 * j + 2] << 8 | p[4 * j + 3];
+  for (int j = 16; j < 64; j++) {
+    uint32_t s0 = ROR(w[j - 15], 7) ^ ROR(w[j - 15], 18) ^ (w[j - 15] >> 3);
+    uint32_t s1 = ROR(w[j - 2], 17) ^ ROR(w[j - 2], 19) ^ (w[j - 2] >> 10);
+    w[j] = w[j - 16] + s0 + w[j - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+  for (int j = 0; j < 64; j++) {
+    uint32_t t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) +
+                  ((e & f) ^ (~e & g)) + shaK[j] + w[j];
+    uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+                  ((a & b) ^ (a & c) ^ (b & c));
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a, h[1] += b, h[2] += c, h[3] += d;
+  h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+
+static void sha256(const void *data, size_t len, uint8_t out[32]) {
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  const uint8_t *p = data;
+  uint8_t tail[128] = {0};
+  size_t full = len & ~(size_t)63, rest = len - full;
+  for (size_t off = 0; off < full; off += 64)
+    shaBlock(h, p + off);
+  /** padding: 0x80, zeros, then the length in bits, in one or two blocks */
+  memcpy(tail, p + full, rest);
+  tail[rest] = 0x80;
+  size_t tailLen = rest < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)len * 8;
+  for (int j = 0; j < 8; j++)
+    tail[tailLen - 1 - j] = (uint8_t)(bits >> (8 * j));
+  for (size_t off = 0; off < tailLen; off += 64)
+    shaBlock(h, tail + off);
+  for (int j = 0; j < 8; j++) {
+    out[4 * j] = h[j] >> 24;
+    out[4 * j + 1] = h[j] >> 16;
+    out[4 * j + 2] = h[j] >> 8;
+    out[4 * j + 3] = h[j];
+  }
+}
+
+/**
+ * FUNCTION: findBlob - blob index of a hash, -1 if it isn't stored
+ *
+ * EXPLAINATION:
+ * the hash is already uniformly distributed, its first 4 bytes are used
+ * as the slot directly
+ */
+static int findBlob(const YbPhotos *ps, const uint8_t hash[32]) {
+  if (ps->slotCap == 0)
+    return -1;
+  uint32_t at;
+  memcpy(&at, hash, sizeof(at));
+  for (at &= ps->slotCap - 1; ps->slots[at] >= 0; at = (at + 1) & (ps->slotCap - 1))
+    if (memcmp(ps->blobs[ps->slots[at]].hash, hash, 32) == 0)
+      return ps->slots[at];
+  return -1;
+}
+
+static void slotInsert(YbPhotos *ps, int blob) {
+  uint32_t at;
+  memcpy(&at, ps->blobs[blob].hash, sizeof(at));
+  for (at &= ps->slotCap - 1; ps->slots[at] >= 0; at = (at + 1) & (ps->slotCap - 1))
+    ;
+  ps->slots[at] = blob;
+}
+
+/**
+ * FUNCTION: addBlob - remember where a blob is, returns its index or -1
+ */
+static int addBlob(YbPhotos *ps, const uint8_t hash[32], uint32_t seg,
+                   uint64_t off, uint64_t len) {
+  if (ps->nBlobs == ps->capBlobs) {
+    int cap = ps->capBlobs ? ps->capBlobs * 2 : 256;
+    Blob *grown = realloc(ps->blobs, cap * sizeof(Blob));
+    if (grown == NULL)
+      return -1;
+    ps->blobs = grown;
+    ps->capBlobs = cap;
+  }
+  /** keep the hash table at most half full */
+  if (2 * (ps->nBlobs + 1) > ps->slotCap) {
+    int cap = ps->slotCap ? ps->slotCap * 2 : 512;
+    int *slots = malloc(cap * sizeof(int));
+    if (slots == NULL)
+      return -1;
+    free(ps->slots);
+    ps->slots = slots;
+    ps->slotCap = cap;
+    memset(slots, 0xff, cap * sizeof(int));
+    for (int j = 0; j < ps->nBlobs; j++)
+      slotInsert(ps, j);
+  }
+  Blob *b = &ps->blobs[ps->nBlobs];
+  memcpy(b->hash, hash, 32);
+  b->seg = seg;
+  b->off = off;
+  b->len = len;
+  b->thumb = -1;
+  slotInsert(ps, ps->nBlobs);
+  return ps->nBlobs++;
+}
+
+/**
+ * FUNCTION: idSlot - slot of a packed id in the student table
+ *
+ * EXPLAINATION:
+ * returns the empty slot the id would go to when it isn't there,
+ * the table always has an empty slot (it is kept at most half full)
+ */
+static int idSlot(const YbPhotos *ps, uint64_t id) {
+  uint64_t h = id * 0x9e3779b97f4a7c15ULL;
+  int at = (int)(h >> 32) & (ps->idCap - 1);
+  while (ps->ids[at] != UINT64_MAX && ps->ids[at] != id)
+    at = (at + 1) & (ps->idCap - 1);
+  return at;
+}
+
+static int setPhoto(YbPhotos *ps, uint64_t id, int blob) {
+  if (2 * (ps->idUsed + 1) > ps->idCap) {
+    int oldCap = ps->idCap, cap = oldCap ? oldCap * 2 : 1024;
+    uint64_t *oldIds = ps->ids;
+    int *oldPhoto = ps->photo;
+    ps->ids = malloc(cap * sizeof(uint64_t));
+    ps->photo = malloc(cap * sizeof(int));
+    if (ps->ids == NULL || ps->photo == NULL) {
+      free(ps->ids);
+      free(ps->photo);
+      ps->ids = oldIds;
+      ps->photo = oldPhoto;
+      return YB_ERR_NOMEM;
+    }
+    ps->idCap = cap;
+    memset(ps->ids, 0xff, cap * sizeof(uint64_t));
+    for (int j = 0; j < oldCap; j++) {
+      if (oldIds[j] == UINT64_MAX)
+        continue;
+      int at = idSlot(ps, oldIds[j]);
+      ps->ids[at] = oldIds[j];
+      ps->photo[at] = oldPhoto[j];
+    }
+    free(oldIds);
+    free(oldPhoto);
+  }
+  int at = idSlot(ps, id);
+  if (ps->ids[at] == UINT64_MAX)
+    ps->idUsed++;
+  ps->ids[at] = id;
+  ps->photo[at] = blob;
+  return YB_OK;
+}
+
+static int getPhoto(const YbPhotos *ps, const char id[]) {
+  uint64_t k = ybPackId(id);
+  if (k == UINT64_MAX || ps->idCap == 0)
+    return -1;
+  int at = idSlot(ps, k);
+  return ps->ids[at] == k ? ps->photo[at] : -1;
+}
+
+static int ensureBuf(YbPhotos *ps, size_t len) {
+  if (len <= ps->bufCap)
+    return YB_OK;
+  uint8_t *grown = realloc(ps->buf, len);
+  if (grown == NULL)
+    return YB_ERR_NOMEM;
+  ps->buf = grown;
+  ps->bufCap = len;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: openSegment - open segment number n, creating it if asked to
+ */
+static int openSegment(YbPhotos *ps, int n, int create) {
+  char path[300];
+  snprintf(path, sizeof(path), "%s/seg%06d.ybp", ps->dir, n);
+  FILE *f = fopen(path, "r+b");
+  if (f == NULL && create)
+    f = fopen(path, "w+b");
+  if (f == NULL)
+    return YB_ERR_NOT_FOUND;
+  Segment *grown = realloc(ps->segs, (n + 1) * sizeof(Segment));
+  if (grown == NULL) {
+    fclose(f);
+    return YB_ERR_NOMEM;
+  }
+  ps->segs = grown;
+  fseek(f, 0, SEEK_END);
+  ps->segs[n].f = f;
+  ps->segs[n].size = ftell(f);
+  ps->segs[n].map = NULL;
+  ps->segs[n].mapLen = 0;
+  ps->nSegs = n + 1;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: readBlob - get the bytes of a blob
+ *
+ * EXPLAINATION:
+ * the pointer is into the segment mapping, or into ps->buf when the
+ * segment can't be mapped. either way it is only valid until the next
+ * call on the store: a later read may remap the segment or reuse buf.
+ */
+static int readBlob(YbPhotos *ps, const Blob *b, const uint8_t **data) {
+  Segment *s = &ps->segs[b->seg];
+#if !defined(_WIN32) && !defined(__MINGW32__)
+  if (b->off + b->len > s->mapLen) {
+    /** the segment grew since it was mapped (it is the one being appended to) */
+    if (s->map != NULL)
+      munmap(s->map, s->mapLen);
+    s->map = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fileno(s->f), 0);
+    s->mapLen = s->size;
+    if (s->map == MAP_FAILED) {
+      s->map = NULL;
+      s->mapLen = 0;
+    }
+  }
+  if (s->map != NULL) {
+    *data = s->map + b->off;
+    return YB_OK;
+  }
+#endif
+  if (ensureBuf(ps, b->len) != YB_OK)
+    return YB_ERR_NOMEM;
+  if (fseek(s->f, (long)b->off, SEEK_SET) != 0 ||
+      fread(ps->buf, 1, b->len, s->f) != b->len)
+    return YB_ERR_IO;
+  *data = ps->buf;
+  return YB_OK;
+}
+
+static int appendRec(YbPhotos *ps, const PhotoRec *r) {
+  if (fwrite(r, sizeof(*r), 1, ps->log) != 1 || fflush(ps->log) != 0)
+    return YB_ERR_IO;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: storeBlob - store bytes once, returns the blob index in *blob
+ *
+ * - int *dup: set to 1 when the same bytes were already stored
+ *
+ * EXPLAINATION:
+ * the bytes are flushed to the segment before the log record is written,
+ * a crash in between leaves unused bytes in the segment but never a log
+ * record pointing at missing bytes.
+ */
+static int storeBlob(YbPhotos *ps, const void *data, size_t len, int *blob,
+                     int *dup) {
+  uint8_t hash[32];
+  sha256(data, len, hash);
+  *blob = findBlob(ps, hash);
+  *dup = *blob >= 0;
+  if (*dup)
+    return YB_OK;
+
+  int err;
+  Segment *s = ps->nSegs > 0 ? &ps->segs[ps->nSegs - 1] : NULL;
+  if (s == NULL || (s->size > 0 && s->size + (long)len > PHOTO_SEG_MAX)) {
+    if ((err = openSegment(ps, ps->nSegs, 1)) != YB_OK)
+      return err;
+    s = &ps->segs[ps->nSegs - 1];
+  }
+  if (fseek(s->f, s->size, SEEK_SET) != 0 ||
+      fwrite(data, 1, len, s->f) != len || fflush(s->f) != 0)
+    return YB_ERR_IO;
+
+  PhotoRec r = {.type = REC_BLOB};
+  r.seg = ps->nSegs - 1;
+  r.off = s->size;
+  r.len = len;
+  memcpy(r.a, hash, 32);
+  s->size += len;
+  if ((err = appendRec(ps, &r)) != YB_OK)
+    return err;
+  *blob = addBlob(ps, hash, r.seg, r.off, r.len);
+  return *blob >= 0 ? YB_OK : YB_ERR_NOMEM;
+}
+
+/**
+ * FUNCTION: loadLog - rebuild the hash tables from the log
+ *
+ * EXPLAINATION:
+ * a torn record at the end (crash while appending) is cut off so new
+ * records start at a record boundary again.
+ */
+static int loadLog(YbPhotos *ps) {
+  PhotoRec r;
+  long good = 0;
+  fseek(ps->log, 0, SEEK_SET);
+  while (fread(&r, sizeof(r), 1, ps->log) == 1) {
+    if (r.type == REC_BLOB) {
+      if (r.seg >= (uint32_t)ps->nSegs ||
+          r.off + r.len > (uint64_t)ps->segs[r.seg].size)
+        break;
+      if (findBlob(ps, r.a) < 0 && addBlob(ps, r.a, r.seg, r.off, r.len) < 0)
+        return YB_ERR_NOMEM;
+    }
+    else if (r.type == REC_STUDENT) {
+      static const uint8_t none[32];
+      int blob = memcmp(r.a, none, 32) == 0 ? -1 : findBlob(ps, r.a);
+      if (setPhoto(ps, r.off, blob) != YB_OK)
+        return YB_ERR_NOMEM;
+    }
+    else if (r.type == REC_THUMB) {
+      int photo = findBlob(ps, r.a), thumb = findBlob(ps, r.b);
+      if (photo >= 0 && thumb >= 0)
+        ps->blobs[photo].thumb = thumb;
+    }
+    else {
+      break;
+    }
+    good += sizeof(r);
+  }
+  fseek(ps->log, good, SEEK_SET);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybPhotosOpen - open (or create) a photo store
+ *
+ * - const char *dir: directory of the store, created when missing
+ *
+ * EXPLAINATION:
+ * a store is used by one thread at a time, like a YbDb
+ */
+int ybPhotosOpen(const char *dir, YbPhotos **out) {
+  char path[300];
+  *out = NULL;
+  if (strlen(dir) >= sizeof(((YbPhotos *)0)->dir))
+    return YB_ERR_INVALID;
+#if defined(_WIN32) || defined(__MINGW32__)
+  _mkdir(dir);
+#else
+  mkdir(dir, 0755);
+#endif
+  YbPhotos *ps = calloc(1, sizeof(YbPhotos));
+  if (ps == NULL)
+    return YB_ERR_NOMEM;
+  strcpy(ps->dir, dir);
+  snprintf(path, sizeof(path), "%s/%s", dir, PHOTO_LOG);
+  ps->log = fopen(path, "r+b");
+  if (ps->log == NULL)
+    ps->log = fopen(path, "w+b");
+  if (ps->log == NULL) {
+    free(ps);
+    return YB_ERR_IO;
+  }
+  while (openSegment(ps, ps->nSegs, 0) == YB_OK)
+    ;
+  int err = loadLog(ps);
+  if (err != YB_OK) {
+    ybPhotosClose(ps);
+    return err;
+  }
+  *out = ps;
+  return YB_OK;
+}
+
+void ybPhotosClose(YbPhotos *ps) {
+  if (ps == NULL)
+    return;
+  for (int j = 0; j < ps->nSegs; j++) {
+#if !defined(_WIN32) && !defined(__MINGW32__)
+    if (ps->segs[j].map != NULL)
+      munmap(ps->segs[j].map, ps->segs[j].mapLen);
+#endif
+    fclose(ps->segs[j].f);
+  }
+  fclose(ps->log);
+  free(ps->segs);
+  free(ps->blobs);
+  free(ps->slots);
+  free(ps->ids);
+  free(ps->photo);
+  free(ps->buf);
+  free(ps);
+}
+
+/**
+ * FUNCTION: ybPhotoPut - attach a photo to a student
+ *
+ * - const void *data, size_t len: the image file as is
+ * - int *dup: set to 1 when the same image was stored before, it isn't
+ *   stored again
+ *
+ * EXPLAINATION:
+ * the student replaces its previous photo, if any. the previous photo
+ * stays in its segment (segments are append only).
+ */
+int ybPhotoPut(YbPhotos *ps, const char id[], const void *data, size_t len,
+               int *dup) {
+  int blob, err;
+  *dup = 0;
+  if (!ybValidId(id) || len == 0 || len > PHOTO_SEG_MAX)
+    return YB_ERR_INVALID;
+  if ((err = storeBlob(ps, data, len, &blob, dup)) != YB_OK)
+    return err;
+  PhotoRec r = {.type = REC_STUDENT};
+  r.off = ybPackId(id);
+  memcpy(r.a, ps->blobs[blob].hash, 32);
+  if ((err = appendRec(ps, &r)) != YB_OK)
+    return err;
+  return setPhoto(ps, r.off, blob);
+}
+
+/**
+ * FUNCTION: ybPhotoPutFile - ybPhotoPut() with the image read from a file
+ */
+int ybPhotoPutFile(YbPhotos *ps, const char id[], const char *path, int *dup) {
+  *dup = 0;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return YB_ERR_IO;
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (len <= 0 || len > PHOTO_SEG_MAX) {
+    fclose(f);
+    return YB_ERR_INVALID;
+  }
+  uint8_t *data = malloc(len);
+  int err = data == NULL ? YB_ERR_NOMEM : YB_OK;
+  if (err == YB_OK && fread(data, 1, len, f) != (size_t)len)
+    err = YB_ERR_IO;
+  fclose(f);
+  if (err == YB_OK)
+    err = ybPhotoPut(ps, id, data, len, dup);
+  free(data);
+  return err;
+}
+
+/**
+ * FUNCTION: ybPhotoRemove - detach the photo of a student
+ */
+int ybPhotoRemove(YbPhotos *ps, const char id[]) {
+  if (getPhoto(ps, id) < 0)
+    return YB_ERR_NOT_FOUND;
+  PhotoRec r = {.type = REC_STUDENT};
+  r.off = ybPackId(id);
+  int err = appendRec(ps, &r);
+  return err != YB_OK ? err : setPhoto(ps, r.off, -1);
+}
+
+/**
+ * FUNCTION: ybPhotoGet - the photo of a student
+ *
+ * - const void **data, size_t *len: receive the image, valid until the
+ *   next call on the store
+ */
+int ybPhotoGet(YbPhotos *ps, const char id[], const void **data,
+               size_t *len) {
+  const uint8_t *p;
+  int blob = getPhoto(ps, id);
+  if (blob < 0)
+    return YB_ERR_NOT_FOUND;
+  int err = readBlob(ps, &ps->blobs[blob], &p);
+  *data = p;
+  *len = ps->blobs[blob].len;
+  return err;
+}
+
+/**
+ * FUNCTION: pnmHeader - parse the header of a binary PPM / PGM
+ *
+ * - int *channels: 3 for PPM, 1 for PGM
+ * - int *maxval: value of a full intensity sample (1 - 255)
+ *
+ * EXPLAINATION:
+ * returns the offset of the pixels, 0 when it isn't a PPM / PGM with
+ * 8 bit samples or the pixels don't fit in len
+ */
+static size_t pnmHeader(const uint8_t *p, size_t len, int *w, int *h,
+                        int *channels, int *maxval) {
+  int v[3];
+  size_t at = 2;
+  if (len < 2 || p[0] != 'P' || (p[1] != '5' && p[1] != '6'))
+    return 0;
+  *channels = p[1] == '6' ? 3 : 1;
+  for (int j = 0; j < 3; j++) {
+    /** whitespace and comments before each number */
+    while (at < len && (p[at] == ' ' || p[at] == '\t' || p[at] == '\n' ||
+                        p[at] == '\r' || p[at] == '#')) {
+      if (p[at] == '#')
+        while (at < len && p[at] != '\n')
+          at++;
+      else
+        at++;
+    }
+    if (at >= len || p[at] < '0' || p[at] > '9')
+      return 0;
+    for (v[j] = 0; at < len && p[at] >= '0' && p[at] <= '9'; at++)
+      if ((v[j] = v[j] * 10 + (p[at] - '0')) > 65535)
+        return 0;
+  }
+  /** exactly one whitespace byte between maxval and the pixels */
+  at++;
+  *w = v[0];
+  *h = v[1];
+  *maxval = v[2];
+  if (*w < 1 || *h < 1 || v[2] < 1 || v[2] > 255 ||
+      at + (size_t)*w * *h * *channels > len)
+    return 0;
+  return at;
+}
+
+/**
+ * FUNCTION: makeThumb - scale an image down into ps->buf
+ *
+ * EXPLAINATION:
+ * every thumbnail pixel is the average of the box of photo pixels it
+ * covers, so every photo pixel is read once. the thumbnail keeps the
+ * format (PPM / PGM) and maxval of the photo.
+ */
+static int makeThumb(YbPhotos *ps, const uint8_t *p, size_t len,
+                     size_t *outLen) {
+  int w, h, ch, maxval;
+  size_t at = pnmHeader(p, len, &w, &h, &ch, &maxval);
+  if (at == 0)
+    return YB_ERR_INVALID;
+  int tw = w, th = h;
+  if (w >= h && w > PHOTO_THUMB_SIDE) {
+    tw = PHOTO_THUMB_SIDE;
+    th = h * PHOTO_THUMB_SIDE / w > 0 ? h * PHOTO_THUMB_SIDE / w : 1;
+  }
+  else if (h > w && h > PHOTO_THUMB_SIDE) {
+    th = PHOTO_THUMB_SIDE;
+    tw = w * PHOTO_THUMB_SIDE / h > 0 ? w * PHOTO_THUMB_SIDE / h : 1;
+  }
+  const uint8_t *px = p + at;
+  /** the sums are taken before ps->buf is reused, p may point into it */
+  uint32_t *sum = calloc((size_t)tw * th * ch, sizeof(uint32_t));
+  uint32_t *cnt = calloc((size_t)tw * th, sizeof(uint32_t));
+  if (sum == NULL || cnt == NULL) {
+    free(sum);
+    free(cnt);
+    return YB_ERR_NOMEM;
+  }
+  for (int y = 0; y < h; y++) {
+    int ty = (int)((long long)y * th / h);
+    for (int x = 0; x < w; x++) {
+      int tx = (int)((long long)x * tw / w), t = ty * tw + tx;
+      for (int c = 0; c < ch; c++)
+        sum[t * ch + c] += px[((size_t)y * w + x) * ch + c];
+      cnt[t]++;
+    }
+  }
+  char head[40];
+  int hl = snprintf(head, sizeof(head), "P%c\n%d %d\n%d\n", ch == 3 ? '6' : '5',
+                    tw, th, maxval);
+  *outLen = hl + (size_t)tw * th * ch;
+  int err = ensureBuf(ps, *outLen);
+  if (err == YB_OK) {
+    memcpy(ps->buf, head, hl);
+    for (int t = 0; t < tw * th; t++)
+      for (int c = 0; c < ch; c++)
+        ps->buf[hl + t * ch + c] = (uint8_t)(sum[t * ch + c] / cnt[t]);
+  }
+  free(sum);
+  free(cnt);
+  return err;
+}
+
+/**
+ * FUNCTION: ybPhotoThumb - the thumbnail of a student's photo
+ *
+ * - const void **data, size_t *len: receive a PPM / PGM of at most
+ *   PHOTO_THUMB_SIDE pixels per side, valid until the next call on the store
+ *
+ * EXPLAINATION:
+ * the first call for a photo makes the thumbnail and stores it, later
+ * calls (for any student with the same photo) only read it. returns
+ * YB_ERR_INVALID when the photo isn't a binary PPM / PGM.
+ */
+int ybPhotoThumb(YbPhotos *ps, const char id[], const void **data,
+                 size_t *len) {
+  const uint8_t *p;
+  int blob = getPhoto(ps, id), err;
+  if (blob < 0)
+    return YB_ERR_NOT_FOUND;
+  if (ps->blobs[blob].thumb < 0) {
+    size_t tlen;
+    int thumb, dup;
+    if ((err = readBlob(ps, &ps->blobs[blob], &p)) != YB_OK ||
+        (err = makeThumb(ps, p, ps->blobs[blob].len, &tlen)) != YB_OK)
+      return err;
+    /** storeBlob() doesn't touch ps->buf, the thumbnail is still there */
+    if ((err = storeBlob(ps, ps->buf, tlen, &thumb, &dup)) != YB_OK)
+      return err;
+    PhotoRec r = {.type = REC_THUMB};
+    memcpy(r.a, ps->blobs[blob].hash, 32);
+    memcpy(r.b, ps->blobs[thumb].hash, 32);
+    if ((err = appendRec(ps, &r)) != YB_OK)
+      return err;
+    ps->blobs[blob].thumb = thumb;
+  }
+  const Blob *t = &ps->blobs[ps->blobs[blob].thumb];
+  err = readBlob(ps, t, &p);
+  *data = p;
+  *len = t->len;
+  return err;
+}
+
+/**
+ * FUNCTION: ybPhotoSheet - contact sheet of the thumbnails of a cohort
+ *
+ * - const YbFilter *f: students to put on the sheet, NULL for everyone
+ * - int perRow: thumbnails per row
+ * - const char *path: PPM file to write
+ * - int *count: receives amount of thumbnails on the sheet
+ *
+ * EXPLAINATION:
+ * students are placed in id order, each in a cell of PHOTO_THUMB_SIDE
+ * pixels. students without a photo or with a photo that isn't a
+ * PPM / PGM are left out.
+ */
+int ybPhotoSheet(YbPhotos *ps, YbDb *db, const YbFilter *f, int perRow,
+                 const char *path, int *count) {
+  YbIter *it;
+  Student cur;
+  const void *data;
+  size_t len;
+  int cells = 0, cap = 64, err, side = PHOTO_THUMB_SIDE;
+  *count = 0;
+  if (perRow < 1)
+    return YB_ERR_INVALID;
+  /** thumbnails of a row are collected first, the sheet is written row by row */
+  uint8_t *row = malloc((size_t)side * side * perRow * 3);
+  char (*ids)[12] = malloc(cap * sizeof(*ids));
+  if (row == NULL || ids == NULL) {
+    free(row);
+    free(ids);
+    return YB_ERR_NOMEM;
+  }
+  if ((err = ybIterOpen(db, &it)) != YB_OK) {
+    free(row);
+    free(ids);
+    return err;
+  }
+  while (ybIterNext(it, &cur)) {
+    if ((f != NULL && !ybFilterMatch(f, &cur)) || getPhoto(ps, cur.id) < 0)
+      continue;
+    if (ybPhotoThumb(ps, cur.id, &data, &len) != YB_OK)
+      continue;
+    if (cells == cap) {
+      char(*grown)[12] = realloc(ids, 2 * cap * sizeof(*ids));
+      if (grown == NULL) {
+        err = YB_ERR_NOMEM;
+        break;
+      }
+      ids = grown;
+      cap *= 2;
+    }
+    strcpy(ids[cells++], cur.id);
+  }
+  ybIterClose(it);
+
+  FILE *out = err == YB_OK ? fopen(path, "wb") : NULL;
+  if (err == YB_OK && out == NULL)
+    err = YB_ERR_IO;
+  if (err == YB_OK && cells > 0) {
+    int rows = (cells + perRow - 1) / perRow, sw = perRow * side;
+    fprintf(out, "P6\n%d %d\n255\n", sw, rows * side);
+    for (int r = 0; r < rows && err == YB_OK; r++) {
+      memset(row, 0xff, (size_t)side * sw * 3);
+      for (int c = 0; c < perRow && r * perRow + c < cells; c++) {
+        int w, h, ch, maxval;
+        if (ybPhotoThumb(ps, ids[r * perRow + c], &data, &len) != YB_OK)
+          continue;
+        const uint8_t *p = data;
+        size_t at = pnmHeader(p, len, &w, &h, &ch, &maxval);
+        /** centered in its cell, samples scaled to the sheet's 255 */
+        int x0 = c * side + (side - w) / 2, y0 = (side - h) / 2;
+        for (int y = 0; at > 0 && y < h; y++)
+          for (int x = 0; x < w; x++)
+            for (int k = 0; k < 3; k++)
+              row[((size_t)(y0 + y) * sw + x0 + x) * 3 + k] =
+                  p[at + ((size_t)y * w + x) * ch + (ch == 3 ? k : 0)] * 255 /
+                  maxval;
+      }
+      if (fwrite(row, 1, (size_t)side * sw * 3, out) != (size_t)side * sw * 3)
+        err = YB_ERR_IO;
+    }
+  }
+  if (out != NULL && fclose(out) != 0 && err == YB_OK)
+    err = YB_ERR_IO;
+  if (out != NULL && (err != YB_OK || cells == 0))
+    remove(path);
+  free(row);
+  free(ids);
+  *count = err == YB_OK ? cells : 0;
+  return err;
+}
+
+/**
+ * FUNCTION: ybPhotoStats - size of the store
+ */
+int ybPhotoStats(YbPhotos *ps, YbPhotoStats *st) {
+  memset(st, 0, sizeof(*st));
+  st->blobs = ps->nBlobs;
+  st->segments = ps->nSegs;
+  for (int j = 0; j < ps->nSegs; j++)
+    st->bytes += ps->segs[j].size;
+  for (int j = 0; j < ps->nBlobs; j++)
+    st->thumbs += ps->blobs[j].thumb >= 0;
+  for (int j = 0; j < ps->idCap; j++)
+    st->students += ps->ids[j] != UINT64_MAX && ps->photo[j] >= 0;
+  return YB_OK;
+}
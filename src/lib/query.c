@@ -0,0 +1,600 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * FUNCTION: ybSearchKey - search key of a student for a name field
+ *
+ * - YbSearchField field: YB_BY_FIRSTNAME, YB_BY_SURNAME or YB_BY_NICK
+ * - char *out: receives the key, at least sizeof(Student.name) bytes
+ *
+ * EXPLAINATION:
+ * the first name is the name up to the first space, the surname the
+ * rest. the key is folded with ybFoldKey() so it can be compared with
+ * a query byte by byte. returns the length of the key.
+ */
+int ybSearchKey(const Student *s, YbSearchField field, char *out) {
+  if (field == YB_BY_NICK)
+    return ybFoldKey(s->nick, strlen(s->nick), out);
+  const char *sp = strchr(s->name, ' ');
+  if (field == YB_BY_FIRSTNAME)
+    return ybFoldKey(s->name, sp != NULL ? sp - s->name : (int)strlen(s->name),
+                     out);
+  if (sp == NULL) {
+    out[0] = '\0';
+    return 0;
+  }
+  return ybFoldKey(sp + 1, strlen(sp + 1), out);
+}
+
+/**
+ * FUNCTION: ybQueryInit - prepare a search
+ *
+ * - YbQuery *q: query to fill
+ * - YbSearchField field: column to search
+ * - const char *text: user's query
+ *
+ * EXPLAINATION:
+ * id queries have to be a full id (11 digits) or the last 4 digits.
+ * name queries are folded once here (see ybFoldKey()) so matching a
+ * row is just a prefix compare with its search key.
+ */
+int ybQueryInit(YbQuery *q, YbSearchField field, const char *text) {
+  int len = strlen(text);
+  if (len == 0 || len >= (int)sizeof(q->text))
+    return YB_ERR_INVALID;
+  if (field < YB_BY_ID || field > YB_BY_SURNAME)
+    return YB_ERR_INVALID;
+  if (field == YB_BY_ID &&
+      ((len != 11 && len != 4) || (int)strspn(text, "0123456789") != len))
+    return YB_ERR_INVALID;
+  q->field = field;
+  if (field == YB_BY_ID) {
+    q->len = len;
+    strcpy(q->text, text);
+  }
+  else
+    q->len = ybFoldKey(text, len, q->text);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybQueryMatch - check if a student match a prepared query
+ *
+ * EXPLAINATION:
+ * id: whole id, or last 4 digits of the id for a 4 digits query
+ * firstname, surname, nick: search key starts with query
+ */
+int ybQueryMatch(const YbQuery *q, const Student *s) {
+  char key[sizeof(s->name)];
+  if (q->field == YB_BY_ID) {
+    if (q->len == 4)
+      return strlen(s->id) == 11 && memcmp(s->id + 7, q->text, 4) == 0;
+    return strcmp(s->id, q->text) == 0;
+  }
+  int kl = ybSearchKey(s, q->field, key);
+  return kl >= q->len && memcmp(key, q->text, q->len) == 0;
+}
+
+/**
+ * FUNCTION: ybSearchEach - call fn for every student matching a query
+ *
+ * - const YbQuery *q: prepared query
+ * - YbRowFn fn, void *ctx: called with each match (and ctx), in id order
+ * - int *total: receives the amount of matches
+ *
+ * EXPLAINATION:
+ * on a resident handle fn runs with the rows locked, so it must not
+ * add or remove through db.
+ */
+int ybSearchEach(YbDb *db, const YbQuery *q, YbRowFn fn, void *ctx,
+                 int *total) {
+  YbIter *it;
+  Student cur;
+  *total = 0;
+
+  /** a full id on the B+tree backend is a single point lookup */
+  if (db->bt != NULL && q->field == YB_BY_ID && q->len == 11) {
+    if (btGetStudent(db->bt, ybPackId(q->text), &cur)) {
+      fn(&cur, ctx);
+      *total = 1;
+    }
+    return YB_OK;
+  }
+  /** same on a resident handle with its hash index */
+  if (db->mem != NULL && q->field == YB_BY_ID && q->len == 11) {
+    int err = resEnsure(db);
+    if (err == YB_OK && resGet(db, ybPackId(q->text), &cur)) {
+      fn(&cur, ctx);
+      *total = 1;
+    }
+    return err;
+  }
+  /** name searches on a resident handle compare the keys kept in memory */
+  if (db->mem != NULL && q->field != YB_BY_ID) {
+    int err = resEnsure(db);
+    return err == YB_OK ? resSearch(db, q, fn, ctx, total) : err;
+  }
+  int err = ybIterOpen(db, &it);
+  if (err != YB_OK)
+    return err;
+  while (ybIterNext(it, &cur)) {
+    if (ybQueryMatch(q, &cur)) {
+      fn(&cur, ctx);
+      (*total)++;
+    }
+  }
+  ybIterClose(it);
+  return YB_OK;
+}
+
+/**
+ * STRUCT: Collect - buffer filled by collectRow() for ybSearch()
+ */
+typedef struct {
+  Student *out;
+  int cap;
+  int n;
+} Collect;
+
+static void collectRow(const Student *s, void *ctx) {
+  Collect *c = ctx;
+  if (c->n < c->cap)
+    c->out[c->n] = *s;
+  c->n++;
+}
+
+/**
+ * FUNCTION: ybSearch - search into a buffer, see ybSearchEach()
+ *
+ * - const YbQuery *q: prepared query
+ * - Student *out: buffer for matches (may be NULL if cap is 0)
+ * - int cap: size of out
+ * - int *total: receives the amount of matches, which may be more than cap
+ */
+int ybSearch(YbDb *db, const YbQuery *q, Student *out, int cap, int *total) {
+  Collect c = {out, cap, 0};
+  return ybSearchEach(db, q, collectRow, &c, total);
+}
+
+/**
+ * FUNCTION: ybCount - count students of each course
+ *
+ * EXPLAINATION:
+ * only the course column is parsed (on the B+tree backend and a
+ * resident handle every record is read with an iterator instead).
+ * 0: Regular program
+ * 1: International program
+ * 2: Health Data Science program
+ * 3: Residential College program
+ */
+int ybCount(YbDb *db, Count *c) {
+  char line[LINE_MAX_LEN];
+  int cur;
+  memset(c, 0, sizeof(Count));
+  if (db->bt != NULL || db->mem != NULL) {
+    YbIter *it;
+    Student s;
+    int err = ybIterOpen(db, &it);
+    if (err != YB_OK)
+      return err;
+    while (ybIterNext(it, &s)) {
+      if (s.course == 0)
+        c->reg++;
+      else if (s.course == 1)
+        c->inter++;
+      else if (s.course == 2)
+        c->hds++;
+      else if (s.course == 3)
+        c->rc++;
+    }
+    ybIterClose(it);
+    return YB_OK;
+  }
+  FILE *f = fopen(db->path, "r");
+  if (f == NULL)
+    return YB_ERR_IO;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%*[^,],%*[^,],%*[^,],%d", &cur) == 1) {
+      if (cur == 0)
+        c->reg++;
+      else if (cur == 1)
+        c->inter++;
+      else if (cur == 2)
+        c->hds++;
+      else if (cur == 3)
+        c->rc++;
+    }
+  }
+  fclose(f);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybCheckDuplicate - count rows sharing id, name or email with x
+ *
+ * EXPLAINATION:
+ * used before adding a student. id and email have to be unique, a
+ * duplicate name is allowed but the caller may want to confirm it.
+ */
+int ybCheckDuplicate(YbDb *db, const Student *x, CheckDuplicateResponse *r) {
+  YbIter *it;
+  Student cur;
+  memset(r, 0, sizeof(CheckDuplicateResponse));
+  if (db->bt != NULL) {
+    btCheckDuplicate(db->bt, x, r);
+    return YB_OK;
+  }
+  int err = ybIterOpen(db, &it);
+  if (err != YB_OK)
+    return err;
+  while (ybIterNext(it, &cur)) {
+    if (strcmp(cur.id, x->id) == 0)
+      r->id++;
+    if (strcmp(cur.name, x->name) == 0)
+      r->name++;
+    if (strcmp(cur.email, x->email) == 0)
+      r->email++;
+  }
+  ybIterClose(it);
+  return YB_OK;
+}
+
+/**
+ * STRUCT: GroupEntry / GroupTable - open addressing hash table used by
+ * ybGroupBy() to count rows per derived key
+ *
+ * - off, len: group key inside the table's `arena` (count 0: empty slot)
+ * - hash: cached hash of key
+ * - count: amount of rows in this group
+ *
+ * EXPLAINATION:
+ * a key is copied into the arena the first time it is seen, so the
+ * table doesn't depend on the row it came from staying around
+ */
+typedef struct {
+  int off;
+  int len;
+  uint32_t hash;
+  int count;
+} GroupEntry;
+
+typedef struct {
+  GroupEntry *e;
+  int cap;
+  int size;
+  char *arena;
+  int arenaLen;
+  int arenaCap;
+} GroupTable;
+
+#define GROUP_INVALID 255
+// a slice smaller than this is not worth a thread (about 4096 rows)
+#define GROUP_MIN_BYTES (256 * 1024)
+
+/**
+ * STRUCT: AggTask - one thread's share of the rows and its partial aggregate
+ *
+ * - buf, size: csv backend, the mapped data file
+ * - from, to: byte range of buf (csv) or positions in id order (resident)
+ * - it: any other backend, the only task reads every row from it
+ * - rows: amount of rows aggregated
+ * - threaded: ran on its own thread, which has to be joined
+ */
+typedef struct {
+  YbDb *db;
+  const char *buf;
+  size_t size;
+  size_t from;
+  size_t to;
+  YbIter *it;
+  YbGroupKey mode;
+  int rows;
+  int threaded;
+  int cc[100][4];
+  GroupTable t;
+} AggTask;
+
+/**
+ * FUNCTION: hashKey - FNV-1a hash of a group key
+ */
+static uint32_t hashKey(const char *k, int len) {
+  uint32_t h = 2166136261u;
+  for (int j = 0; j < len; j++) {
+    h ^= (unsigned char)k[j];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/**
+ * FUNCTION: groupTableAdd - add `count` rows to the group of `key`
+ *
+ * EXPLAINATION:
+ * linear probing, the table doubles when it is more than half full.
+ * entries keep their arena offsets when the table grows.
+ */
+static void groupTableAdd(GroupTable *t, const char *key, int len,
+                          uint32_t hash, int count) {
+  if (t->size * 2 >= t->cap) {
+    GroupEntry *e = calloc(t->cap * 2, sizeof(GroupEntry));
+    for (int j = 0; j < t->cap; j++) {
+      if (t->e[j].count == 0)
+        continue;
+      int i = t->e[j].hash & (t->cap * 2 - 1);
+      while (e[i].count != 0)
+        i = (i + 1) & (t->cap * 2 - 1);
+      e[i] = t->e[j];
+    }
+    free(t->e);
+    t->e = e;
+    t->cap *= 2;
+  }
+  int j = hash & (t->cap - 1);
+  while (t->e[j].count != 0) {
+    if (t->e[j].hash == hash && t->e[j].len == len &&
+        memcmp(t->arena + t->e[j].off, key, len) == 0) {
+      t->e[j].count += count;
+      return;
+    }
+    j = (j + 1) & (t->cap - 1);
+  }
+  while (t->arenaLen + len > t->arenaCap) {
+    t->arenaCap = t->arenaCap ? t->arenaCap * 2 : 4096;
+    t->arena = realloc(t->arena, t->arenaCap);
+  }
+  memcpy(t->arena + t->arenaLen, key, len);
+  t->e[j] = (GroupEntry){t->arenaLen, len, hash, count};
+  t->arenaLen += len;
+  t->size++;
+}
+
+static void groupTableFree(GroupTable *t) {
+  free(t->e);
+  free(t->arena);
+}
+
+/**
+ * FUNCTION: deriveGroupKey - get the group key of one row
+ *
+ * - const Student *cur: the row
+ * - YbGroupKey mode: email domain, nickname initial or full name
+ * - int *len: length of the key
+ *
+ * EXPLAINATION:
+ * nickname initial is the first character, which may be more
+ * than one byte if the nickname is UTF-8
+ */
+static const char *deriveGroupKey(const Student *cur, YbGroupKey mode,
+                                  int *len) {
+  if (mode == YB_GROUP_EMAIL_DOMAIN) {
+    const char *at = strchr(cur->email, '@');
+    const char *k = at != NULL ? at + 1 : "";
+    *len = strlen(k);
+    return k;
+  }
+  if (mode == YB_GROUP_NICK_INITIAL) {
+    unsigned char b = cur->nick[0];
+    *len = b < 0x80 ? 1 : b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : 2;
+    if (*len > (int)strlen(cur->nick))
+      *len = strlen(cur->nick);
+    return cur->nick;
+  }
+  *len = strlen(cur->name);
+  return cur->name;
+}
+
+/**
+ * FUNCTION: aggregateRow - count one row in a task's partial aggregate
+ *
+ * EXPLAINATION:
+ * course x cohort only touches a small counter array (rows with a
+ * course or an id that has no cohort are counted as rows only), other
+ * modes hash their string key into the task's own table
+ */
+static void aggregateRow(AggTask *a, const Student *s) {
+  a->rows++;
+  if (a->mode == YB_GROUP_COURSE_COHORT) {
+    int course = s->course >= 0 && s->course <= 3 ? s->course : GROUP_INVALID;
+    int cohort = s->id[0] >= '0' && s->id[0] <= '9' && s->id[1] >= '0' &&
+                         s->id[1] <= '9'
+                     ? (s->id[0] - '0') * 10 + (s->id[1] - '0')
+                     : GROUP_INVALID;
+    if (cohort < 100 && course < 4)
+      a->cc[cohort][course]++;
+    return;
+  }
+  int len;
+  const char *k = deriveGroupKey(s, a->mode, &len);
+  groupTableAdd(&a->t, k, len, hashKey(k, len), 1);
+}
+
+/**
+ * FUNCTION: aggregateWorker - thread entry, aggregate one share of rows
+ *
+ * EXPLAINATION:
+ * a csv range starts at the first line starting at or after `from` and
+ * ends with the line that contains `to - 1`, like the ranges of
+ * ybVerify(), so the lines are parsed by the threads themselves.
+ * resident rows are already parsed and read under the read lock held
+ * by ybGroupBy(). nothing is shared between threads until the merge.
+ */
+static void *aggregateWorker(void *arg) {
+  AggTask *a = arg;
+  char line[LINE_MAX_LEN];
+  Student s;
+  a->t.cap = 1024;
+  a->t.e = calloc(a->t.cap, sizeof(GroupEntry));
+  if (a->it != NULL) {
+    while (ybIterNext(a->it, &s))
+      aggregateRow(a, &s);
+    return NULL;
+  }
+  if (a->buf == NULL) {
+    for (size_t pos = a->from; pos < a->to && resRowAt(a->db, pos, &s); pos++)
+      aggregateRow(a, &s);
+    return NULL;
+  }
+
+  size_t at = a->from;
+  if (at > 0) {
+    const char *nl = memchr(a->buf + at - 1, '\n', a->size - at + 1);
+    at = nl == NULL ? a->size : (size_t)(nl - a->buf) + 1;
+  }
+  while (at < a->to && at < a->size) {
+    const char *p = a->buf + at, *nl = memchr(p, '\n', a->size - at);
+    size_t len = nl == NULL ? a->size - at : (size_t)(nl - p);
+    at += len + 1;
+    if (len >= LINE_MAX_LEN)
+      continue;
+    memcpy(line, p, len);
+    line[len] = '\0';
+    if (ybParseLine(line, &s))
+      aggregateRow(a, &s);
+  }
+  return NULL;
+}
+
+/**
+ * FUNCTION: compareGroup - order groups by count desc then key
+ */
+static int compareGroup(const void *a, const void *b) {
+  const YbGroup *x = a, *y = b;
+  if (x->count != y->count)
+    return y->count - x->count;
+  return strcmp(x->key, y->key);
+}
+
+/**
+ * FUNCTION: ybGroupBy - count students grouped by a derived key
+ *
+ * - YbGroupKey key: how to group
+ * - YbGroup **out: receives the groups ordered by count, free with ybFreeGroups()
+ * - int *groups: receives amount of groups (= distinct keys)
+ * - int *rows: receives amount of rows aggregated
+ *
+ * EXPLAINATION:
+ * the rows are split between threads where they are: a csv data file
+ * is mapped and split into byte ranges that every thread parses and
+ * aggregates itself, a resident handle (or replica) is split by
+ * position over the rows already in memory. the B+tree is read by one
+ * thread. each thread builds its own partial aggregate (a counter
+ * array or a hash table) and the partials are merged at the end, so
+ * no locking is needed while scanning.
+ */
+int ybGroupBy(YbDb *db, YbGroupKey key, YbGroup **out, int *groups,
+              int *rows) {
+  const char *buf = NULL;
+  size_t size = 0, n = 0;
+  int mapped = 0, err;
+  YbIter *it = NULL;
+  *out = NULL;
+  *groups = 0;
+  *rows = 0;
+  if (key < YB_GROUP_COURSE_COHORT || key > YB_GROUP_DUP_NAME)
+    return YB_ERR_INVALID;
+
+  /**
+   * split the rows evenly between threads and run them. the iterator
+   * of a resident handle holds its read lock until the merge is done.
+   */
+  int nt = ybThreadCount();
+  if (db->bt == NULL && db->mem == NULL) {
+    buf = ybMapFile(db->path, &size, &mapped);
+    if (buf == NULL)
+      return YB_ERR_IO;
+    n = size;
+    if (size < (size_t)nt * GROUP_MIN_BYTES)
+      nt = 1;
+  }
+  else {
+    if ((err = ybIterOpen(db, &it)) != YB_OK)
+      return err;
+    if (db->mem == NULL)
+      nt = 1;
+    else if ((n = resRows(db)) < (size_t)nt * 4096)
+      nt = 1;
+  }
+  AggTask *tasks = calloc(nt, sizeof(AggTask));
+  pthread_t th[MAX_THREADS];
+  if (tasks == NULL) {
+    if (buf != NULL)
+      ybUnmapFile(buf, size, mapped);
+    ybIterClose(it);
+    return YB_ERR_NOMEM;
+  }
+  for (int t = 0; t < nt; t++) {
+    tasks[t].db = db;
+    tasks[t].buf = buf;
+    tasks[t].size = size;
+    tasks[t].from = n * t / nt;
+    tasks[t].to = n * (t + 1) / nt;
+    tasks[t].it = db->bt != NULL ? it : NULL;
+    tasks[t].mode = key;
+    tasks[t].threaded =
+        nt > 1 && pthread_create(&th[t], NULL, aggregateWorker, &tasks[t]) == 0;
+    if (!tasks[t].threaded) // a single share, or no thread available
+      aggregateWorker(&tasks[t]);
+  }
+  for (int t = 0; t < nt; t++)
+    if (tasks[t].threaded)
+      pthread_join(th[t], NULL);
+  for (int t = 0; t < nt; t++)
+    *rows += tasks[t].rows;
+
+  /**
+   * merge partial aggregates into the output array
+   */
+  if (key == YB_GROUP_COURSE_COHORT) {
+    *out = malloc(100 * 4 * sizeof(YbGroup));
+    for (int y = 0; y < 100; y++) {
+      for (int k = 0; k < 4; k++) {
+        int sum = 0;
+        for (int t = 0; t < nt; t++)
+          sum += tasks[t].cc[y][k];
+        if (sum == 0)
+          continue;
+        sprintf((*out)[*groups].key, "%02d / %s", y, ybCourseName(k));
+        (*out)[(*groups)++].count = sum;
+      }
+    }
+  } 
+  else {
+    /** the first task's table takes the groups of the others */
+    GroupTable g = tasks[0].t;
+    for (int t = 1; t < nt; t++) {
+      GroupTable *p = &tasks[t].t;
+      for (int j = 0; j < p->cap; j++)
+        if (p->e[j].count != 0)
+          groupTableAdd(&g, p->arena + p->e[j].off, p->e[j].len,
+                        p->e[j].hash, p->e[j].count);
+    }
+    *out = malloc((g.size > 0 ? g.size : 1) * sizeof(YbGroup));
+    for (int j = 0; j < g.cap; j++) {
+      GroupEntry *e = &g.e[j];
+      if (e->count == 0 || (key == YB_GROUP_DUP_NAME && e->count < 2))
+        continue;
+      int kl = e->len < 63 ? e->len : 63;
+      memcpy((*out)[*groups].key, g.arena + e->off, kl);
+      (*out)[*groups].key[kl] = '\0';
+      (*out)[(*groups)++].count = e->count;
+    }
+    tasks[0].t = g;
+    qsort(*out, *groups, sizeof(YbGroup), compareGroup);
+  }
+
+  for (int t = 0; t < nt; t++)
+    groupTableFree(&tasks[t].t);
+  free(tasks);
+  if (buf != NULL)
+    ybUnmapFile(buf, size, mapped);
+  ybIterClose(it);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: ybFreeGroups - release groups returned by ybGroupBy()
+ */
+void ybFreeGroups(YbGroup *groups) { free(groups); }
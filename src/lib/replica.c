@@ -0,0 +1,616 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(_WIN32) && !defined(__MINGW32__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * log shipping read replicas over a unix socket
+ *
+ * the primary is a normal csv handle (plain or resident) with a
+ * background thread that accepts replicas on a socket. every add and
+ * remove done through the handle is given a sequence number and sent
+ * to every replica. a replica is an in-memory handle (see resident.c)
+ * without a file, filled and kept up to date by its own background
+ * thread, serving reads only.
+ *
+ * protocol, one text line per message:
+ *   S <seq>                  full copy follows: csv rows, then "E"
+ *   A <seq> <ms> <csv row>   add (or replace) a student
+ *   R <seq> <ms> <id>        remove a student
+ *   H <seq> <ms>             heartbeat, also tells the latest seq
+ * <ms> is when the primary published the change (same machine, same
+ * clock), so the replica can tell how far behind it is.
+ *
+ * a replica connecting gets a full copy first and then the changes
+ * after it. a change that is already in the copy may be sent again,
+ * add and remove are idempotent so that is harmless. bulk rewrites
+ * (diff apply, snapshot restore) aren't sent row by row, the primary
+ * drops its replicas instead and they come back for a fresh copy.
+ */
+
+#define REPL_HEARTBEAT_MS 1000
+#define REPL_RETRY_MS 500
+#define REPL_SEND_CHUNK 65536
+
+/**
+ * - lock: protects everything below that both threads touch
+ * - running: the background thread was started
+ * - seq: primary: last published change, replica: last applied one
+ *
+ * primary:
+ * - listenFd, wake: listening socket and a pipe to wake the thread up
+ *   when a change is published
+ * - fds, nfds: connected replicas
+ * - out, outLen: published messages not sent yet
+ * - reset: drop every replica (bulk rewrite)
+ *
+ * replica:
+ * - fd, in, connected: connection to the primary
+ * - primarySeq: latest seq the primary told about
+ * - lagMs: publish to apply delay of the last applied change
+ * - heardMs: when the primary was last heard from
+ */
+struct Repl {
+  YbReplRole role;
+  YbDb *db;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int running;
+  int stop;
+  uint64_t seq;
+
+  int listenFd;
+  int wake[2];
+  int *fds;
+  int nfds;
+  char *out;
+  size_t outLen;
+  size_t outCap;
+  int reset;
+
+  int fd;
+  FILE *in;
+  int connected;
+  uint64_t primarySeq;
+  long long lagMs;
+  long long heardMs;
+};
+
+static long long nowMs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  return (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+#if !defined(_WIN32) && !defined(__MINGW32__)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+ * FUNCTION: sendAll - write a whole buffer to a socket
+ *
+ * EXPLAINATION:
+ * MSG_NOSIGNAL so a replica going away is an error here instead of
+ * a SIGPIPE killing the primary
+ */
+static int sendAll(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w <= 0)
+      return -1;
+    p += w;
+    n -= (size_t)w;
+  }
+  return 0;
+}
+
+/**
+ * FUNCTION: appendOut - add a message to the primary's send buffer (lock held)
+ */
+static void appendOut(Repl *r, const char *msg, size_t n) {
+  if (r->outLen + n > r->outCap) {
+    while (r->outLen + n > r->outCap)
+      r->outCap = r->outCap ? r->outCap * 2 : 4096;
+    r->out = realloc(r->out, r->outCap);
+  }
+  memcpy(r->out + r->outLen, msg, n);
+  r->outLen += n;
+}
+
+static int formatRow(char *dst, size_t cap, const Student *s) {
+  return snprintf(dst, cap, "%s,%s,%s,%d,%s,%s\n", s->id, s->name, s->nick,
+                  s->course, s->email, s->phone);
+}
+
+/**
+ * FUNCTION: sendCopy - send a full copy of the data to a new replica
+ *
+ * EXPLAINATION:
+ * the seq is taken before reading the rows, so every change up to it
+ * is in the copy. changes published while copying are sent afterwards
+ * and may already be in the copy, which is fine (see top of file).
+ */
+static int sendCopy(Repl *r, int fd) {
+  YbIter *it;
+  Student s;
+  char *buf = malloc(REPL_SEND_CHUNK + LINE_MAX_LEN);
+  size_t n;
+  int err = 0;
+  pthread_mutex_lock(&r->lock);
+  n = (size_t)sprintf(buf, "S %llu\n", (unsigned long long)r->seq);
+  pthread_mutex_unlock(&r->lock);
+  if (ybIterOpen(r->db, &it) != YB_OK) {
+    free(buf);
+    return -1;
+  }
+  while (!err && ybIterNext(it, &s)) {
+    n += (size_t)formatRow(buf + n, LINE_MAX_LEN, &s);
+    if (n >= REPL_SEND_CHUNK) {
+      err = sendAll(fd, buf, n);
+      n = 0;
+    }
+  }
+  ybIterClose(it);
+  n += (size_t)sprintf(buf + n, "E\n");
+  if (!err)
+    err = sendAll(fd, buf, n);
+  free(buf);
+  return err;
+}
+
+/**
+ * FUNCTION: primaryLoop - background thread of the primary
+ *
+ * EXPLAINATION:
+ * waits for a new replica, a published change or the heartbeat time.
+ * pending messages are taken out under the lock and sent without it
+ * so publishing never waits for a slow replica.
+ */
+static void *primaryLoop(void *arg) {
+  Repl *r = arg;
+  char *batch = NULL, tmp[64];
+  size_t batchCap = 0, batchLen;
+  long long lastBeat = 0;
+  while (1) {
+    struct pollfd p[2] = {{r->listenFd, POLLIN, 0}, {r->wake[0], POLLIN, 0}};
+    poll(p, 2, REPL_HEARTBEAT_MS);
+    while (read(r->wake[0], tmp, sizeof(tmp)) > 0)
+      ;
+    if (p[0].revents & POLLIN) {
+      int c = accept(r->listenFd, NULL, NULL);
+      if (c >= 0 && sendCopy(r, c) == 0) {
+        pthread_mutex_lock(&r->lock);
+        r->fds = realloc(r->fds, (r->nfds + 1) * sizeof(int));
+        r->fds[r->nfds++] = c;
+        pthread_mutex_unlock(&r->lock);
+      }
+      else if (c >= 0) {
+        close(c);
+      }
+    }
+
+    /** take the pending messages, swapping buffers to avoid a copy */
+    pthread_mutex_lock(&r->lock);
+    int stop = r->stop, reset = r->reset;
+    char *t = r->out;
+    size_t tc = r->outCap;
+    r->out = batch;
+    r->outCap = batchCap;
+    batch = t;
+    batchCap = tc;
+    batchLen = r->outLen;
+    r->outLen = 0;
+    r->reset = 0;
+    if (nowMs() - lastBeat >= REPL_HEARTBEAT_MS) {
+      lastBeat = nowMs();
+      int n = sprintf(tmp, "H %llu %lld\n", (unsigned long long)r->seq, lastBeat);
+      if (batchLen + n > batchCap) {
+        batchCap = batchLen + n;
+        batch = realloc(batch, batchCap);
+      }
+      memcpy(batch + batchLen, tmp, n);
+      batchLen += n;
+    }
+    pthread_mutex_unlock(&r->lock);
+    if (stop)
+      break;
+
+    for (int j = 0; j < r->nfds; j++) {
+      if (!reset && sendAll(r->fds[j], batch, batchLen) == 0)
+        continue;
+      close(r->fds[j]);
+      pthread_mutex_lock(&r->lock);
+      r->fds[j--] = r->fds[--r->nfds];
+      pthread_mutex_unlock(&r->lock);
+    }
+  }
+  free(batch);
+  return NULL;
+}
+
+/**
+ * FUNCTION: publish - queue a change for every replica
+ */
+static void publish(YbDb *db, const char *fmt, const char *arg) {
+  Repl *r = db->repl;
+  char msg[LINE_MAX_LEN + 64];
+  if (r == NULL || r->role != YB_ROLE_PRIMARY)
+    return;
+  pthread_mutex_lock(&r->lock);
+  r->seq++;
+  int n = snprintf(msg, sizeof(msg), fmt, (unsigned long long)r->seq,
+                   nowMs(), arg);
+  appendOut(r, msg, (size_t)n);
+  pthread_mutex_unlock(&r->lock);
+  if (write(r->wake[1], "x", 1) < 0) {
+    // pipe full, the thread is awake anyway
+  }
+}
+
+void replAdded(YbDb *db, const Student *x) {
+  char row[LINE_MAX_LEN];
+  if (db->repl == NULL)
+    return;
+  formatRow(row, sizeof(row), x);
+  publish(db, "A %llu %lld %s", row);
+}
+
+void replRemoved(YbDb *db, const char id[]) {
+  if (db->repl != NULL)
+    publish(db, "R %llu %lld %s\n", id);
+}
+
+/**
+ * FUNCTION: replReset - the data was rewritten in bulk, replicas start over
+ */
+void replReset(YbDb *db) {
+  Repl *r = db->repl;
+  if (r == NULL || r->role != YB_ROLE_PRIMARY)
+    return;
+  pthread_mutex_lock(&r->lock);
+  r->seq++;
+  r->reset = 1;
+  pthread_mutex_unlock(&r->lock);
+  if (write(r->wake[1], "x", 1) < 0) {
+    // pipe full, the thread is awake anyway
+  }
+}
+
+/**
+ * FUNCTION: ybServePrimary - accept read replicas on a unix socket
+ *
+ * - const char *sockPath: socket file to create (replaced if it exists)
+ *
+ * EXPLAINATION:
+ * from now on every ybAdd() / ybRemove() / ybRemoveWhere() through
+ * db is sent to the replicas. only csv handles can be a primary, the
+ * B+tree page cache can't be read from a second thread.
+ */
+int ybServePrimary(YbDb *db, const char *sockPath) {
+  struct sockaddr_un addr;
+  if (db->bt != NULL || db->repl != NULL ||
+      strlen(sockPath) >= sizeof(addr.sun_path))
+    return YB_ERR_INVALID;
+  Repl *r = calloc(1, sizeof(Repl));
+  if (r == NULL)
+    return YB_ERR_NOMEM;
+  r->role = YB_ROLE_PRIMARY;
+  r->db = db;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockPath);
+  unlink(sockPath);
+  r->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (r->listenFd < 0 ||
+      bind(r->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(r->listenFd, 16) != 0 || pipe(r->wake) != 0) {
+    if (r->listenFd >= 0)
+      close(r->listenFd);
+    free(r);
+    return YB_ERR_IO;
+  }
+  fcntl(r->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(r->wake[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&r->lock, NULL);
+  db->repl = r;
+  if (pthread_create(&r->thread, NULL, primaryLoop, r) != 0) {
+    replStop(db);
+    return YB_ERR_NOMEM;
+  }
+  r->running = 1;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: connectPrimary - connect to the primary's socket, -1 on failure
+ */
+static int connectPrimary(const char *sockPath) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sockPath);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * FUNCTION: receiveCopy - read the full copy the primary starts with
+ *
+ * EXPLAINATION:
+ * readers wait (write lock) until the copy is complete, so they never
+ * see half of it.
+ */
+static int receiveCopy(Repl *r, FILE *in) {
+  char line[LINE_MAX_LEN];
+  unsigned long long seq;
+  Student s;
+  int done = 0;
+  if (!fgets(line, sizeof(line), in) || sscanf(line, "S %llu", &seq) != 1)
+    return YB_ERR_IO;
+  resClear(r->db);
+  while (fgets(line, sizeof(line), in)) {
+    if (line[0] == 'E' && line[1] == '\n') {
+      done = 1;
+      break;
+    }
+    if (ybParseLine(line, &s))
+      resPut(r->db, &s);
+  }
+  resUnlock(r->db);
+  if (!done)
+    return YB_ERR_IO;
+  pthread_mutex_lock(&r->lock);
+  r->seq = r->primarySeq = seq;
+  r->lagMs = 0;
+  r->heardMs = nowMs();
+  r->connected = 1;
+  pthread_mutex_unlock(&r->lock);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: applyChange - apply one message from the primary
+ */
+static void applyChange(Repl *r, const char *line) {
+  unsigned long long seq;
+  long long ms;
+  int off = 0;
+  Student s;
+  char id[12];
+  if (sscanf(line + 1, " %llu %lld %n", &seq, &ms, &off) < 2)
+    return;
+  if (line[0] == 'A' && off > 0 && ybParseLine(line + 1 + off, &s)) {
+    resWriteLock(r->db);
+    resPut(r->db, &s);
+    resUnlock(r->db);
+  }
+  else if (line[0] == 'R' && off > 0 && sscanf(line + 1 + off, "%11s", id) == 1) {
+    resWriteLock(r->db);
+    resDelete(r->db, id);
+    resUnlock(r->db);
+  }
+  else if (line[0] != 'H') {
+    return;
+  }
+  pthread_mutex_lock(&r->lock);
+  long long now = nowMs();
+  if (line[0] != 'H') {
+    r->seq = seq;
+    r->lagMs = now - ms;
+  }
+  if (seq > r->primarySeq)
+    r->primarySeq = seq;
+  r->heardMs = now;
+  pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * FUNCTION: replicaLoop - background thread of a replica
+ *
+ * EXPLAINATION:
+ * apply changes as they come. when the primary goes away (or drops
+ * the replica after a bulk rewrite) keep serving the rows we have and
+ * reconnect every REPL_RETRY_MS for a fresh copy.
+ */
+static void *replicaLoop(void *arg) {
+  Repl *r = arg;
+  char line[LINE_MAX_LEN + 64];
+  FILE *in = r->in;
+  while (1) {
+    pthread_mutex_lock(&r->lock);
+    int stop = r->stop;
+    pthread_mutex_unlock(&r->lock);
+    if (stop)
+      break;
+    if (in == NULL) {
+      struct timespec ts = {0, REPL_RETRY_MS * 1000000L};
+      nanosleep(&ts, NULL);
+      int fd = connectPrimary(r->db->path);
+      if (fd < 0)
+        continue;
+      pthread_mutex_lock(&r->lock);
+      r->fd = fd;
+      pthread_mutex_unlock(&r->lock);
+      in = fdopen(fd, "r");
+      if (in != NULL && receiveCopy(r, in) == YB_OK)
+        continue;
+    }
+    else if (fgets(line, sizeof(line), in)) {
+      applyChange(r, line);
+      continue;
+    }
+    /** connection lost, closed only once replStop() can't see it */
+    pthread_mutex_lock(&r->lock);
+    int fd = r->fd;
+    r->connected = 0;
+    r->fd = -1;
+    pthread_mutex_unlock(&r->lock);
+    if (in != NULL)
+      fclose(in);
+    else if (fd >= 0)
+      close(fd);
+    in = NULL;
+  }
+  if (in != NULL)
+    fclose(in);
+  return NULL;
+}
+
+/**
+ * FUNCTION: ybOpenReplica - open a read-only copy of a primary's data
+ *
+ * - const char *sockPath: socket of a primary, see ybServePrimary()
+ * - YbDb **db: receives the handle, free it with ybClose()
+ *
+ * EXPLAINATION:
+ * the first full copy is received before returning, so the handle is
+ * ready to be read. after that changes are applied in the background.
+ * every read function works, writes return YB_ERR_READONLY.
+ */
+int ybOpenReplica(const char *sockPath, YbDb **db) {
+  *db = NULL;
+  if (strlen(sockPath) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+    return YB_ERR_INVALID;
+  YbDb *d = calloc(1, sizeof(YbDb));
+  Repl *r = calloc(1, sizeof(Repl));
+  if (d == NULL || r == NULL || resCreate(d) != YB_OK) {
+    free(d);
+    free(r);
+    return YB_ERR_NOMEM;
+  }
+  strcpy(d->path, sockPath);
+  d->memBudget = (long long)DEFAULT_MEM_BUDGET_MB * 1024 * 1024;
+  r->role = YB_ROLE_REPLICA;
+  r->db = d;
+  pthread_mutex_init(&r->lock, NULL);
+  d->repl = r;
+
+  r->fd = connectPrimary(sockPath);
+  r->in = r->fd >= 0 ? fdopen(r->fd, "r") : NULL;
+  int err = r->in != NULL ? receiveCopy(r, r->in) : YB_ERR_IO;
+  if (err == YB_OK && pthread_create(&r->thread, NULL, replicaLoop, r) != 0)
+    err = YB_ERR_NOMEM;
+  if (err != YB_OK) {
+    if (r->in != NULL)
+      fclose(r->in);
+    else if (r->fd >= 0)
+      close(r->fd);
+    /** closed, replStop() must not shut down a number reused meanwhile */
+    r->in = NULL;
+    r->fd = -1;
+    ybClose(d);
+    return err;
+  }
+  r->running = 1;
+  *db = d;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: replStop - stop the background thread of a primary or replica
+ */
+void replStop(YbDb *db) {
+  Repl *r = db->repl;
+  if (r == NULL)
+    return;
+  pthread_mutex_lock(&r->lock);
+  r->stop = 1;
+  if (r->role == YB_ROLE_REPLICA && r->fd >= 0)
+    shutdown(r->fd, SHUT_RDWR);
+  pthread_mutex_unlock(&r->lock);
+  if (r->role == YB_ROLE_PRIMARY) {
+    if (write(r->wake[1], "x", 1) < 0) {
+      // the thread is awake anyway
+    }
+  }
+  if (r->running)
+    pthread_join(r->thread, NULL);
+  if (r->role == YB_ROLE_PRIMARY) {
+    for (int j = 0; j < r->nfds; j++)
+      close(r->fds[j]);
+    close(r->listenFd);
+    close(r->wake[0]);
+    close(r->wake[1]);
+  }
+  pthread_mutex_destroy(&r->lock);
+  free(r->fds);
+  free(r->out);
+  free(r);
+  db->repl = NULL;
+}
+
+#else
+
+void replAdded(YbDb *db, const Student *x) {}
+void replRemoved(YbDb *db, const char id[]) {}
+void replReset(YbDb *db) {}
+void replStop(YbDb *db) {}
+
+/**
+ * FUNCTION: ybServePrimary / ybOpenReplica - unix sockets only
+ */
+int ybServePrimary(YbDb *db, const char *sockPath) { return YB_ERR_INVALID; }
+
+int ybOpenReplica(const char *sockPath, YbDb **db) {
+  *db = NULL;
+  return YB_ERR_INVALID;
+}
+
+#endif
+
+/**
+ * FUNCTION: replReadOnly - 1 if db is a replica, every write refuses it
+ */
+int replReadOnly(YbDb *db) {
+  return db->repl != NULL && db->repl->role == YB_ROLE_REPLICA;
+}
+
+/**
+ * FUNCTION: ybReplicationStatus - role of a handle and how far behind it is
+ *
+ * - YbReplStatus *st: receives the status
+ *
+ * EXPLAINATION:
+ * a replica is `primarySeq - seq` changes behind. lagMs is how long
+ * its last change took from the primary to being readable here, idleMs
+ * how long ago the primary was heard from (heartbeats come every
+ * second, so more than that means it is gone or stuck).
+ */
+int ybReplicationStatus(YbDb *db, YbReplStatus *st) {
+  Repl *r = db->repl;
+  memset(st, 0, sizeof(*st));
+  if (r == NULL)
+    return YB_OK;
+  pthread_mutex_lock(&r->lock);
+  st->role = r->role;
+  st->seq = r->seq;
+  if (r->role == YB_ROLE_PRIMARY) {
+    st->replicas = r->nfds;
+  }
+  else {
+    st->connected = r->connected;
+    st->primarySeq = r->primarySeq;
+    st->lagMs = r->lagMs;
+    st->idleMs = nowMs() - r->heardMs;
+  }
+  pthread_mutex_unlock(&r->lock);
+  return YB_OK;
+}
@@ -0,0 +1,865 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * resident mode: the whole data file is kept in memory with a hash
+ * index on the packed id, and the file is watched for edits made
+ * outside of this handle (a text editor, ct.sh, another program
+ * appending rows).
+ *
+ * rows are stored append-only, `order` lists the live rows by id so
+ * inserting a row only moves ints, and the hash index only has to be
+ * rebuilt when it grows because row indexes don't change. removed rows stay in
+ * `rows` until the next full load.
+ *
+ * the search keys of every row (folded first name, surname and nick,
+ * see ybSearchKey()) are made once when the row is stored and packed
+ * into `keys`, so a name search is a memcmp per row.
+ *
+ * change detection (ybRefresh()): on linux an inotify watch on the
+ * directory of the data file tells if anything happened to it at all,
+ * elsewhere the file is stat()ed. then:
+ *   same size, inode, mtime and checksums of the first and last
+ *   RES_BLOCK bytes -> nothing changed
+ *   same inode, bigger, same checksum of the first RES_BLOCK bytes and
+ *   same CRC32C of the last VERIFY_BLOCK block the file had when it
+ *   was loaded -> append: only the new bytes are parsed
+ *   anything else -> rewrite: the file is loaded again
+ * so an append costs the new bytes and at most one block, whatever
+ * the size of the file. the price is that a same inode edit in the
+ * middle of the file that also makes it bigger is taken for an append
+ * (editors and ybReplaceFile() put a new file in place, which is a
+ * rewrite). a same size edit inside the file is only noticed through
+ * its mtime, which has a resolution of one second.
+ *
+ * a replica (replica.c) uses the same in-memory rows without a file,
+ * filled from its primary by another thread. so every change takes
+ * `lock` for writing and iterators hold it for reading until closed.
+ */
+
+// bytes at the start and the end of the file covered by the checksums
+#define RES_BLOCK 4096
+#define HASH_EMPTY -1
+#define HASH_DELETED -2
+#define KEY_OF(field) ((field) - YB_BY_FIRSTNAME)
+// Resident.reload: the file was written through this handle, and
+// RELOAD_OUTSIDE: it had an outside edit the replicas didn't get yet
+#define RELOAD_WRITTEN 1
+#define RELOAD_OUTSIDE 2
+
+/**
+ * STRUCT: FileState - what the data file looked like when it was loaded
+ *
+ * - head, tail: checksums of the first and last RES_BLOCK bytes
+ * - last: CRC32C of the last VERIFY_BLOCK block (partial unless the
+ *   size is a multiple of it), see lastCrc()
+ * - partial: the last line had no '\n' yet (an append would change it)
+ */
+typedef struct {
+  long long size;
+  long long ino;
+  long long mtime;
+  uint32_t head;
+  uint32_t tail;
+  uint32_t last;
+  int partial;
+} FileState;
+
+/**
+ * STRUCT: RowKeys - where the search keys of one row are in `keys`
+ *
+ * - off: first name, then surname, then nick
+ * - len: length of each, indexed by KEY_OF(field)
+ */
+typedef struct {
+  int off;
+  unsigned char len[3];
+} RowKeys;
+
+/**
+ * - rows, rowCount: every row loaded so far, removed ones have id ""
+ * - rk, keys, keyLen, keyCap: search keys of each row in `rows`
+ * - order, n: live rows ordered by packed id
+ * - hkey, hval, hcap, hused: open addressing index packed id -> row
+ * - reload: the file was rewritten through this handle, load it again
+ *   before the next read (RELOAD_WRITTEN / RELOAD_OUTSIDE, 0 if not)
+ * - st: the file as loaded, or as written when a reload is pending
+ * - fd, name: inotify descriptor (-1 if not watching) and the file name
+ *   events are filtered on
+ * - lock: readers (iterators, lookups) vs changes, also guards reload,
+ *   st and the watch
+ */
+struct Resident {
+  Student *rows;
+  int rowCount;
+  int rowCap;
+  int *order;
+  int n;
+  RowKeys *rk;
+  char *keys;
+  int keyLen;
+  int keyCap;
+  uint64_t *hkey;
+  int *hval;
+  int hcap;
+  int hused;
+  int reload;
+  FileState st;
+  int fd;
+  char name[256];
+  pthread_rwlock_t lock;
+};
+
+/**
+ * FUNCTION: checksum - FNV-1a of a byte range, used by the file state
+ */
+static uint32_t checksum(const unsigned char *p, size_t n) {
+  uint32_t h = 2166136261u;
+  for (size_t j = 0; j < n; j++) {
+    h ^= p[j];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/**
+ * FUNCTION: rangeSum - checksum of len bytes of a file starting at off
+ *
+ * EXPLAINATION:
+ * return 0 and set *sum if the whole range could be read
+ */
+static int rangeSum(FILE *f, long long off, long long len, uint32_t *sum) {
+  unsigned char buf[RES_BLOCK];
+  if (len > RES_BLOCK || fseek(f, (long)off, SEEK_SET) != 0 ||
+      fread(buf, 1, (size_t)len, f) != (size_t)len)
+    return -1;
+  *sum = checksum(buf, (size_t)len);
+  return 0;
+}
+
+/**
+ * FUNCTION: readFileState - stat the data file and checksum both ends
+ */
+static int readFileState(const char *path, FileState *fs) {
+  struct stat sb;
+  if (stat(path, &sb) != 0)
+    return YB_ERR_IO;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return YB_ERR_IO;
+  fs->size = sb.st_size;
+  fs->ino = (long long)sb.st_ino;
+  fs->mtime = (long long)sb.st_mtime;
+  long long b = fs->size < RES_BLOCK ? fs->size : RES_BLOCK;
+  int last = '\n';
+  if (fs->size > 0 && fseek(f, (long)(fs->size - 1), SEEK_SET) == 0)
+    last = fgetc(f);
+  int bad = rangeSum(f, 0, b, &fs->head) ||
+            rangeSum(f, fs->size - b, b, &fs->tail);
+  fs->partial = last != '\n';
+  fclose(f);
+  return bad ? YB_ERR_IO : YB_OK;
+}
+
+/**
+ * FUNCTION: sameFile - two states of the same file, unchanged
+ */
+static int sameFile(const FileState *a, const FileState *b) {
+  return a->size == b->size && a->ino == b->ino && a->mtime == b->mtime &&
+         a->head == b->head && a->tail == b->tail;
+}
+
+/**
+ * FUNCTION: readCrc - continue a CRC32C over the next len bytes of f
+ *
+ * EXPLAINATION:
+ * return 0 if the whole range could be read
+ */
+static int readCrc(FILE *f, long long len, uint32_t *crc) {
+  unsigned char buf[65536];
+  while (len > 0) {
+    size_t n = len < (long long)sizeof(buf) ? (size_t)len : sizeof(buf);
+    if (fread(buf, 1, n, f) != n)
+      return -1;
+    *crc = ybCrc32c(*crc, buf, n);
+    len -= n;
+  }
+  return 0;
+}
+
+/**
+ * FUNCTION: blockCrc - CRC32C of the last VERIFY_BLOCK block of the
+ * first `end` bytes of f
+ *
+ * EXPLAINATION:
+ * the blocks are the ones of the `.crc` file, so this is what
+ * ybWriteChecksums() wrote for the last block of a file of that size.
+ * return 0 if the whole block could be read
+ */
+static int blockCrc(FILE *f, long long end, uint32_t *crc) {
+  long long start = end > 0 ? (end - 1) / VERIFY_BLOCK * VERIFY_BLOCK : 0;
+  *crc = 0;
+  if (fseek(f, (long)start, SEEK_SET) != 0)
+    return -1;
+  return readCrc(f, end - start, crc);
+}
+
+/**
+ * FUNCTION: lastCrc - set fs->last for the first fs->size bytes of the file
+ */
+static int lastCrc(const char *path, FileState *fs) {
+  FILE *f = fopen(path, "rb");
+  fs->last = 0;
+  if (f == NULL)
+    return YB_ERR_IO;
+  int bad = blockCrc(f, fs->size, &fs->last);
+  fclose(f);
+  return bad ? YB_ERR_IO : YB_OK;
+}
+
+static uint64_t rowKey(const Student *s) { return ybPackId(s->id); }
+
+/**
+ * FUNCTION: hashSlot - slot of a key in the index, or the first free one
+ */
+static int hashSlot(Resident *m, uint64_t key) {
+  int i = (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & (m->hcap - 1);
+  int freeSlot = -1;
+  while (m->hval[i] != HASH_EMPTY) {
+    if (m->hval[i] == HASH_DELETED) {
+      if (freeSlot < 0)
+        freeSlot = i;
+    }
+    else if (m->hkey[i] == key) {
+      return i;
+    }
+    i = (i + 1) & (m->hcap - 1);
+  }
+  return freeSlot >= 0 ? freeSlot : i;
+}
+
+static void hashPut(Resident *m, uint64_t key, int row);
+static void deleteKey(Resident *m, uint64_t key);
+static int pending(Resident *m);
+
+/**
+ * FUNCTION: hashResize - rebuild the index for at least `rows` live rows
+ */
+static void hashResize(Resident *m, int rows) {
+  free(m->hkey);
+  free(m->hval);
+  m->hcap = 1024;
+  while (m->hcap < rows * 2)
+    m->hcap <<= 1;
+  m->hused = 0;
+  m->hkey = malloc(m->hcap * sizeof(uint64_t));
+  m->hval = malloc(m->hcap * sizeof(int));
+  memset(m->hval, 0xFF, m->hcap * sizeof(int)); // HASH_EMPTY
+  for (int j = 0; j < m->n; j++)
+    hashPut(m, rowKey(&m->rows[m->order[j]]), m->order[j]);
+}
+
+/**
+ * FUNCTION: hashPut - point an id at a row, a later row with the same
+ * id (a duplicate in the file) wins
+ */
+static void hashPut(Resident *m, uint64_t key, int row) {
+  if (key == UINT64_MAX)
+    return;
+  if ((m->hused + 1) * 2 > m->hcap) {
+    hashResize(m, m->n + 1);
+    return;
+  }
+  int i = hashSlot(m, key);
+  if (m->hval[i] < 0)
+    m->hused++;
+  m->hkey[i] = key;
+  m->hval[i] = row;
+}
+
+static int hashGet(Resident *m, uint64_t key) {
+  int i = hashSlot(m, key);
+  return m->hval[i] >= 0 ? m->hval[i] : -1;
+}
+
+/**
+ * FUNCTION: pushRow - append a row to storage, returning its index
+ */
+static int pushRow(Resident *m, const Student *s) {
+  if (m->rowCount == m->rowCap) {
+    m->rowCap = m->rowCap ? m->rowCap * 2 : 1024;
+    m->rows = realloc(m->rows, m->rowCap * sizeof(Student));
+    m->order = realloc(m->order, m->rowCap * sizeof(int));
+    m->rk = realloc(m->rk, m->rowCap * sizeof(RowKeys));
+  }
+  /** a row's keys are at most as long as its name and nick */
+  while (m->keyLen + (int)(sizeof(s->name) + sizeof(s->nick)) > m->keyCap) {
+    m->keyCap = m->keyCap ? m->keyCap * 2 : 65536;
+    m->keys = realloc(m->keys, m->keyCap);
+  }
+  RowKeys *k = &m->rk[m->rowCount];
+  int first = ybSearchKey(s, YB_BY_FIRSTNAME, m->keys + m->keyLen);
+  int last = ybSearchKey(s, YB_BY_SURNAME, m->keys + m->keyLen + first);
+  int nick = ybSearchKey(s, YB_BY_NICK, m->keys + m->keyLen + first + last);
+  k->off = m->keyLen;
+  k->len[KEY_OF(YB_BY_FIRSTNAME)] = first;
+  k->len[KEY_OF(YB_BY_SURNAME)] = last;
+  k->len[KEY_OF(YB_BY_NICK)] = nick;
+  m->keyLen += first + last + nick;
+  m->rows[m->rowCount] = *s;
+  return m->rowCount++;
+}
+
+/**
+ * FUNCTION: searchKeyAt - start of one search key of a row in `keys`
+ */
+static const char *searchKeyAt(const Resident *m, int row, YbSearchField f) {
+  const RowKeys *k = &m->rk[row];
+  int off = k->off;
+  if (f != YB_BY_FIRSTNAME)
+    off += k->len[KEY_OF(YB_BY_FIRSTNAME)];
+  if (f == YB_BY_NICK)
+    off += k->len[KEY_OF(YB_BY_SURNAME)];
+  return m->keys + off;
+}
+
+/**
+ * FUNCTION: insertRow - add a row to storage, order and index
+ *
+ * EXPLAINATION:
+ * a row with a bigger id than every other (the usual append) goes to
+ * the end of order, otherwise its place is found by binary search.
+ * rows with the same id keep file order.
+ */
+static void insertRow(Resident *m, const Student *s) {
+  uint64_t key = rowKey(s);
+  int row = pushRow(m, s);
+  int lo = m->n;
+  if (m->n > 0 && rowKey(&m->rows[m->order[m->n - 1]]) > key) {
+    int hi = m->n;
+    lo = 0;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (rowKey(&m->rows[m->order[mid]]) <= key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    memmove(m->order + lo + 1, m->order + lo, (m->n - lo) * sizeof(int));
+  }
+  m->order[lo] = row;
+  m->n++;
+  hashPut(m, key, row);
+}
+
+/**
+ * FUNCTION: watchStart - start an inotify watch on the data file's directory
+ *
+ * EXPLAINATION:
+ * the directory is watched instead of the file because editors and
+ * ybReplaceFile() put a new file in place, which would end a watch on
+ * the old one.
+ */
+static void watchStart(Resident *m, const char *path) {
+  m->fd = -1;
+  const char *slash = strrchr(path, '/');
+  strcpy(m->name, slash != NULL ? slash + 1 : path);
+#if defined(__linux__)
+  char dir[256] = ".";
+  if (slash != NULL) {
+    int dl = slash == path ? 1 : (int)(slash - path);
+    memcpy(dir, path, dl);
+    dir[dl] = '\0';
+  }
+  m->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m->fd >= 0 &&
+      inotify_add_watch(m->fd, dir,
+                        IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO |
+                            IN_DELETE | IN_MOVED_FROM) < 0) {
+    close(m->fd);
+    m->fd = -1;
+  }
+#endif
+}
+
+/**
+ * FUNCTION: watchDrain - read pending events
+ *
+ * EXPLAINATION:
+ * return 1 if one of them was about the data file, or if there is no
+ * watch (then the caller has to look at the file itself)
+ */
+static int watchDrain(Resident *m) {
+#if defined(__linux__)
+  if (m->fd < 0)
+    return 1;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int hit = 0;
+  ssize_t len;
+  while ((len = read(m->fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      struct inotify_event *e = (struct inotify_event *)p;
+      if (e->len > 0 && strcmp(e->name, m->name) == 0)
+        hit = 1;
+      p += sizeof(struct inotify_event) + e->len;
+    }
+  }
+  return hit;
+#else
+  (void)m;
+  return 1;
+#endif
+}
+
+/**
+ * FUNCTION: resLoad - (re)load the whole data file
+ *
+ * - int stale: only if it was rewritten through this handle, see resStale()
+ *
+ * EXPLAINATION:
+ * the write lock is taken before anything is read, so two threads
+ * asking for the same reload (an iterator and the primary's copy
+ * thread, or replay sessions) load the file once. on a primary, a
+ * reload that picks up changes the replicas never got makes them take
+ * a full copy again: any reload that isn't a stale one, a stale one
+ * after an outside edit (RELOAD_OUTSIDE), or a file that changed again
+ * since it was written.
+ */
+static int resLoad(YbDb *db, int stale) {
+  Resident *m = db->mem;
+  char line[LINE_MAX_LEN];
+  Student s;
+  FileState now;
+  pthread_rwlock_wrlock(&m->lock);
+  if (stale && !m->reload) {
+    pthread_rwlock_unlock(&m->lock);
+    return YB_OK;
+  }
+  int outside = !stale || m->reload == RELOAD_OUTSIDE;
+  watchDrain(m);
+  int err = readFileState(db->path, &now);
+  if (err == YB_OK)
+    err = lastCrc(db->path, &now);
+  FILE *f = err == YB_OK ? fopen(db->path, "r") : NULL;
+  if (f == NULL) {
+    pthread_rwlock_unlock(&m->lock);
+    return YB_ERR_IO;
+  }
+  if (!sameFile(&now, &m->st))
+    outside = 1;
+  m->st = now;
+  m->rowCount = m->n = m->keyLen = 0;
+  while (fgets(line, sizeof(line), f))
+    if (ybParseLine(line, &s))
+      pushRow(m, &s);
+  fclose(f);
+
+  uint64_t *keys = malloc((m->rowCount > 0 ? m->rowCount : 1) * sizeof(uint64_t));
+  for (int j = 0; j < m->rowCount; j++)
+    keys[j] = rowKey(&m->rows[j]);
+  if (m->rowCount > 0)
+    ybRadixSortIndex(keys, m->order, m->rowCount);
+  free(keys);
+  m->n = m->rowCount;
+  hashResize(m, m->n);
+  m->reload = 0;
+  pthread_rwlock_unlock(&m->lock);
+  if (outside)
+    replReset(db);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: resAppend - parse the bytes added after the loaded part
+ *
+ * - long long *added: receives amount of new rows
+ */
+static int resAppend(YbDb *db, const FileState *now, long long *added) {
+  Resident *m = db->mem;
+  char line[LINE_MAX_LEN];
+  Student s;
+  FILE *f = fopen(db->path, "r");
+  if (f == NULL || fseek(f, (long)m->st.size, SEEK_SET) != 0) {
+    if (f != NULL)
+      fclose(f);
+    return YB_ERR_IO;
+  }
+  /** a last line without '\n' is still being written, leave it for later */
+  pthread_rwlock_wrlock(&m->lock);
+  while (ftell(f) < now->size && fgets(line, sizeof(line), f)) {
+    if (strchr(line, '\n') != NULL && ybParseLine(line, &s)) {
+      insertRow(m, &s);
+      replAdded(db, &s);
+      (*added)++;
+    }
+  }
+  m->st = *now;
+  pthread_rwlock_unlock(&m->lock);
+  fclose(f);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: isAppend - check if the file only grew since it was loaded
+ *
+ * EXPLAINATION:
+ * the start of the file and the block the old file ended in have to
+ * have the checksums they had when it was loaded. the blocks between
+ * them aren't read (see the top of this file). sets now->last.
+ */
+static int isAppend(const char *path, const FileState *old, FileState *now) {
+  uint32_t head, last;
+  if (now->ino != old->ino || now->size <= old->size || old->partial)
+    return 0;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  long long b = old->size < RES_BLOCK ? old->size : RES_BLOCK;
+  int ok = rangeSum(f, 0, b, &head) == 0 && head == old->head &&
+           blockCrc(f, old->size, &last) == 0 && last == old->last &&
+           blockCrc(f, now->size, &now->last) == 0;
+  fclose(f);
+  return ok;
+}
+
+/**
+ * FUNCTION: ybOpenResident - open a csv data file and keep it in memory
+ *
+ * - const char *path: path of data file
+ * - YbDb **db: receives the handle, free it with ybClose()
+ *
+ * EXPLAINATION:
+ * reads never touch the file again: iterators walk the rows in memory
+ * and a full id search is a hash lookup. writes still go to the file
+ * first. call ybRefresh() to pick up edits made by something else.
+ */
+int ybOpenResident(const char *path, YbDb **db) {
+  int err = ybOpen(path, db);
+  if (err != YB_OK)
+    return err;
+  err = resCreate(*db);
+  if (err != YB_OK) {
+    ybClose(*db);
+    *db = NULL;
+    return err;
+  }
+  watchStart((*db)->mem, path);
+  err = resLoad(*db, 0);
+  if (err != YB_OK) {
+    ybClose(*db);
+    *db = NULL;
+  }
+  return err;
+}
+
+/**
+ * FUNCTION: ybRefresh - pick up changes made to the data file outside of this handle
+ *
+ * - YbRefresh *r: receives what happened (may be NULL)
+ *
+ * EXPLAINATION:
+ * cheap to call before every command: with inotify it is one read()
+ * on a non blocking descriptor when nothing changed. appended rows
+ * cost as much as parsing them, anything else loads the file again.
+ * on a primary, appended rows are sent to the replicas and a reload
+ * makes them take a full copy again.
+ * YB_ERR_INVALID if db isn't resident, YB_ERR_IO if the file is gone
+ * (the rows in memory are kept).
+ */
+int ybRefresh(YbDb *db, YbRefresh *r) {
+  YbRefresh tmp;
+  FileState now;
+  if (r == NULL)
+    r = &tmp;
+  r->kind = YB_REFRESH_NONE;
+  r->rows = 0;
+  if (db->mem == NULL)
+    return YB_ERR_INVALID;
+  /** a replica has no file, its changes come from the primary */
+  if (replReadOnly(db))
+    return YB_OK;
+  Resident *m = db->mem;
+  /**
+   * rewritten through this handle, nothing external to report. if
+   * not, no other thread touches st or the watch until this one
+   * writes the file again, see resEnsure()
+   */
+  if (pending(m))
+    return resLoad(db, 1);
+  if (!watchDrain(m))
+    return YB_OK;
+  if (readFileState(db->path, &now) != YB_OK)
+    return YB_ERR_IO;
+  if (sameFile(&now, &m->st))
+    return YB_OK;
+
+  if (isAppend(db->path, &m->st, &now)) {
+    r->kind = YB_REFRESH_APPEND;
+    return resAppend(db, &now, &r->rows);
+  }
+  r->kind = YB_REFRESH_RELOAD;
+  int err = resLoad(db, 0);
+  r->rows = resRows(db);
+  return err;
+}
+
+/**
+ * FUNCTION: pending - a reload is pending, see resStale()
+ */
+static int pending(Resident *m) {
+  pthread_rwlock_rdlock(&m->lock);
+  int reload = m->reload;
+  pthread_rwlock_unlock(&m->lock);
+  return reload;
+}
+
+/**
+ * FUNCTION: resEnsure - load the file again if it was rewritten through this handle
+ *
+ * EXPLAINATION:
+ * may be called from any thread (iterators, the primary's copy
+ * thread), resLoad() checks again under the write lock
+ */
+int resEnsure(YbDb *db) { return pending(db->mem) ? resLoad(db, 1) : YB_OK; }
+
+/**
+ * FUNCTION: resChanged - the data file isn't the one loaded or last
+ * written through this handle (an outside edit not picked up yet)
+ */
+int resChanged(YbDb *db) {
+  Resident *m = db->mem;
+  FileState now;
+  if (readFileState(db->path, &now) != YB_OK)
+    return 1;
+  pthread_rwlock_rdlock(&m->lock);
+  int changed = !sameFile(&now, &m->st);
+  pthread_rwlock_unlock(&m->lock);
+  return changed;
+}
+
+/**
+ * FUNCTION: resStale - the data file was replaced, see ybReplaceFile()
+ *
+ * - int outside: the replaced file had an outside edit that wasn't
+ *   picked up, so the new one has it too (see resChanged())
+ *
+ * EXPLAINATION:
+ * the new file state is kept, so resLoad() can tell if the file was
+ * changed again before it was loaded
+ */
+void resStale(YbDb *db, int outside) {
+  Resident *m = db->mem;
+  pthread_rwlock_wrlock(&m->lock);
+  if (readFileState(db->path, &m->st) != YB_OK)
+    outside = 1;
+  if (m->reload != RELOAD_OUTSIDE)
+    m->reload = outside ? RELOAD_OUTSIDE : RELOAD_WRITTEN;
+  pthread_rwlock_unlock(&m->lock);
+}
+
+/**
+ * FUNCTION: resCurrent - the data file is still the one in memory
+ *
+ * EXPLAINATION:
+ * checked before a single row write, which is applied to memory as is
+ * only if the rows in memory match the file it was made from
+ */
+int resCurrent(YbDb *db) { return !pending(db->mem) && !resChanged(db); }
+
+/**
+ * FUNCTION: resTrack - remember the file as written by this handle, the
+ * caller holds the write lock
+ *
+ * EXPLAINATION:
+ * called after a write that was also applied to memory, so the events
+ * and the new file state aren't taken for an outside edit
+ */
+static void resTrack(YbDb *db) {
+  watchDrain(db->mem);
+  if (readFileState(db->path, &db->mem->st) != YB_OK ||
+      lastCrc(db->path, &db->mem->st) != YB_OK)
+    db->mem->reload = RELOAD_OUTSIDE;
+}
+
+/**
+ * FUNCTION: resAdded - ybAdd() wrote x to the file, add it to memory too
+ */
+void resAdded(YbDb *db, const Student *x) {
+  pthread_rwlock_wrlock(&db->mem->lock);
+  if (!db->mem->reload) {
+    insertRow(db->mem, x);
+    resTrack(db);
+  }
+  pthread_rwlock_unlock(&db->mem->lock);
+}
+
+/**
+ * FUNCTION: resRemoved - ybRemove() took id out of the file, do the same in memory
+ */
+void resRemoved(YbDb *db, const char id[]) {
+  pthread_rwlock_wrlock(&db->mem->lock);
+  if (!db->mem->reload) {
+    deleteKey(db->mem, ybPackId(id));
+    resTrack(db);
+  }
+  pthread_rwlock_unlock(&db->mem->lock);
+}
+
+/**
+ * FUNCTION: deleteKey - drop every row with a packed id from order and index
+ */
+static void deleteKey(Resident *m, uint64_t key) {
+  int lo = 0, hi = m->n, end;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (rowKey(&m->rows[m->order[mid]]) < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (end = lo; end < m->n && rowKey(&m->rows[m->order[end]]) == key; end++)
+    m->rows[m->order[end]].id[0] = '\0';
+  memmove(m->order + lo, m->order + end, (m->n - end) * sizeof(int));
+  m->n -= end - lo;
+  int i = hashSlot(m, key);
+  if (m->hval[i] >= 0)
+    m->hval[i] = HASH_DELETED;
+}
+
+int resRows(YbDb *db) {
+  pthread_rwlock_rdlock(&db->mem->lock);
+  int n = db->mem->n;
+  pthread_rwlock_unlock(&db->mem->lock);
+  return n;
+}
+
+/**
+ * FUNCTION: resReadLock / resUnlock - held by an iterator from open to close
+ */
+void resReadLock(YbDb *db) { pthread_rwlock_rdlock(&db->mem->lock); }
+
+void resUnlock(YbDb *db) { pthread_rwlock_unlock(&db->mem->lock); }
+
+/**
+ * FUNCTION: resRowAt - row at a position in id order (for iterators,
+ * the caller holds the read lock)
+ */
+int resRowAt(YbDb *db, int pos, Student *out) {
+  if (pos >= db->mem->n)
+    return 0;
+  *out = db->mem->rows[db->mem->order[pos]];
+  return 1;
+}
+
+/**
+ * FUNCTION: resGet - hash lookup of a packed id
+ */
+int resGet(YbDb *db, uint64_t key, Student *out) {
+  pthread_rwlock_rdlock(&db->mem->lock);
+  int row = hashGet(db->mem, key);
+  if (row >= 0)
+    *out = db->mem->rows[row];
+  pthread_rwlock_unlock(&db->mem->lock);
+  return row >= 0;
+}
+
+/**
+ * FUNCTION: resSearch - ybSearchEach() by a name field on the rows in memory
+ *
+ * EXPLAINATION:
+ * only the search keys are read, fn gets the rows that match
+ */
+int resSearch(YbDb *db, const YbQuery *q, YbRowFn fn, void *ctx, int *total) {
+  Resident *m = db->mem;
+  int f = KEY_OF(q->field);
+  *total = 0;
+  pthread_rwlock_rdlock(&m->lock);
+  for (int pos = 0; pos < m->n; pos++) {
+    int row = m->order[pos];
+    if (m->rk[row].len[f] >= q->len &&
+        memcmp(searchKeyAt(m, row, q->field), q->text, q->len) == 0) {
+      fn(&m->rows[row], ctx);
+      (*total)++;
+    }
+  }
+  pthread_rwlock_unlock(&m->lock);
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: resCreate - empty in-memory rows without a file (replicas)
+ */
+int resCreate(YbDb *db) {
+  Resident *m = calloc(1, sizeof(Resident));
+  if (m == NULL)
+    return YB_ERR_NOMEM;
+  m->fd = -1;
+  pthread_rwlock_init(&m->lock, NULL);
+  hashResize(m, 0);
+  db->mem = m;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: resClear - drop every row (a replica about to get a full copy)
+ *
+ * EXPLAINATION:
+ * takes the write lock and keeps it, the caller fills the rows with
+ * resPut() and releases it with resUnlock()
+ */
+void resClear(YbDb *db) {
+  pthread_rwlock_wrlock(&db->mem->lock);
+  db->mem->rowCount = db->mem->n = db->mem->keyLen = 0;
+  hashResize(db->mem, 0);
+}
+
+/**
+ * FUNCTION: resPut - add or replace a row by id, the caller holds the write lock
+ */
+void resPut(YbDb *db, const Student *s) {
+  uint64_t key = rowKey(s);
+  if (key != UINT64_MAX && hashGet(db->mem, key) >= 0)
+    deleteKey(db->mem, key);
+  insertRow(db->mem, s);
+}
+
+/**
+ * FUNCTION: resDelete - remove a row by id if it's there, the caller
+ * holds the write lock
+ */
+void resDelete(YbDb *db, const char id[]) {
+  uint64_t key = ybPackId(id);
+  if (key != UINT64_MAX && hashGet(db->mem, key) >= 0)
+    deleteKey(db->mem, key);
+}
+
+/**
+ * FUNCTION: resWriteLock - exclusive access for resPut() / resDelete()
+ */
+void resWriteLock(YbDb *db) { pthread_rwlock_wrlock(&db->mem->lock); }
+
+void resFree(Resident *m) {
+  if (m == NULL)
+    return;
+#if defined(__linux__)
+  if (m->fd >= 0)
+    close(m->fd);
+#endif
+  free(m->rows);
+  free(m->order);
+  free(m->rk);
+  free(m->keys);
+  free(m->hkey);
+  free(m->hval);
+  pthread_rwlock_destroy(&m->lock);
+  free(m);
+}
@@ -0,0 +1,694 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * compressed roster snapshots
+ *
+ * file layout:
+ *   header   "YBSN", version
+ *   blocks   each one decodable on its own (no state shared between blocks)
+ *   footer   per block: offset, first id, rows. then footer offset, "YBSN"
+ *
+ * block layout (at most SNAP_BLOCK_ROWS rows):
+ *   u32 byte length, u32 rows, then one section per column:
+ *   id       zigzag varint delta from the previous id (+1, 0 = raw string
+ *            follows for ids that aren't 11 digits)
+ *   course   2 bits per row, followed by exceptions for courses outside 0-3
+ *   first    index into the block's first name dictionary
+ *   surname  index into the block's surname dictionary
+ *   nick     index into the block's nickname dictionary
+ *   email    index into the block's domain dictionary (+1, 0 = no '@'),
+ *            then the local part as the length it shares with the
+ *            lowercase first name plus the rest as a string
+ *            ("somchai.sri@..." for SOMCHAI SRISUK is 7 + ".sri")
+ *   phone    varint of the 10 digits (+1, 0 = raw string follows)
+ *
+ * strings are varint length + bytes. dictionaries are stored before the
+ * columns using them.
+ */
+
+#define SNAP_MAGIC "YBSN"
+#define SNAP_VERSION 1
+#define SNAP_BLOCK_ROWS 4096
+
+/**
+ * STRUCT: Buf - growable byte buffer used while encoding
+ */
+typedef struct {
+  unsigned char *p;
+  size_t len;
+  size_t cap;
+} Buf;
+
+static void bufReserve(Buf *b, size_t n) {
+  if (b->len + n <= b->cap)
+    return;
+  while (b->len + n > b->cap)
+    b->cap = b->cap ? b->cap * 2 : 4096;
+  b->p = realloc(b->p, b->cap);
+}
+
+static void bufPut(Buf *b, const void *d, size_t n) {
+  bufReserve(b, n);
+  memcpy(b->p + b->len, d, n);
+  b->len += n;
+}
+
+static void bufVarint(Buf *b, uint64_t v) {
+  bufReserve(b, 10);
+  while (v >= 0x80) {
+    b->p[b->len++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  b->p[b->len++] = (unsigned char)v;
+}
+
+static void bufString(Buf *b, const char *s, size_t n) {
+  bufVarint(b, n);
+  bufPut(b, s, n);
+}
+
+/**
+ * STRUCT: Reader - bounds checked cursor used while decoding
+ *
+ * - bad: set once anything reads past the end, decoding then fails
+ */
+typedef struct {
+  const unsigned char *p;
+  const unsigned char *end;
+  int bad;
+} Reader;
+
+static uint64_t readVarint(Reader *r) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (r->p >= r->end) {
+      r->bad = 1;
+      return 0;
+    }
+    unsigned char c = *r->p++;
+    v |= (uint64_t)(c & 0x7F) << shift;
+    if (c < 0x80)
+      return v;
+  }
+  r->bad = 1;
+  return 0;
+}
+
+/**
+ * FUNCTION: readString - copy a string into dst (truncated to cap - 1)
+ */
+static void readString(Reader *r, char *dst, size_t cap) {
+  uint64_t n = readVarint(r);
+  if (r->bad || n > (uint64_t)(r->end - r->p)) {
+    r->bad = 1;
+    dst[0] = '\0';
+    return;
+  }
+  size_t c = n < cap ? n : cap - 1;
+  memcpy(dst, r->p, c);
+  dst[c] = '\0';
+  r->p += n;
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+/**
+ * STRUCT: Dict - per block string dictionary
+ *
+ * - str, len: distinct strings in insertion order (pointers into rows)
+ * - slot: open addressing table of indexes into str (-1 = empty)
+ */
+typedef struct {
+  const char **str;
+  int *len;
+  int n;
+  int *slot;
+  int nslot;
+} Dict;
+
+static void dictInit(Dict *d, int maxEntries) {
+  d->n = 0;
+  d->nslot = 1;
+  while (d->nslot < maxEntries * 2)
+    d->nslot <<= 1;
+  d->str = malloc(maxEntries * sizeof(char *));
+  d->len = malloc(maxEntries * sizeof(int));
+  d->slot = malloc(d->nslot * sizeof(int));
+  memset(d->slot, -1, d->nslot * sizeof(int));
+}
+
+static void dictFree(Dict *d) {
+  free(d->str);
+  free(d->len);
+  free(d->slot);
+}
+
+/**
+ * FUNCTION: dictIndex - index of a string in the dictionary, added if new
+ */
+static int dictIndex(Dict *d, const char *s, int len) {
+  uint32_t h = 2166136261u;
+  for (int j = 0; j < len; j++) {
+    h ^= (unsigned char)s[j];
+    h *= 16777619u;
+  }
+  int i = h & (d->nslot - 1);
+  while (d->slot[i] >= 0) {
+    int k = d->slot[i];
+    if (d->len[k] == len && memcmp(d->str[k], s, len) == 0)
+      return k;
+    i = (i + 1) & (d->nslot - 1);
+  }
+  d->str[d->n] = s;
+  d->len[d->n] = len;
+  d->slot[i] = d->n;
+  return d->n++;
+}
+
+static void dictWrite(Buf *b, Dict *d) {
+  bufVarint(b, d->n);
+  for (int k = 0; k < d->n; k++)
+    bufString(b, d->str[k], d->len[k]);
+}
+
+/**
+ * FUNCTION: firstNameLen - length of the first name part of a full name
+ */
+static int firstNameLen(const char *name) {
+  const char *sp = strchr(name, ' ');
+  return sp != NULL ? (int)(sp - name) : (int)strlen(name);
+}
+
+/**
+ * FUNCTION: sharedWithFirstName - length of the prefix of an email local
+ * part that is the student's first name in lowercase
+ */
+static int sharedWithFirstName(const char *local, int localLen,
+                               const char *name) {
+  int fl = firstNameLen(name), j = 0;
+  while (j < fl && j < localLen) {
+    char c = name[j];
+    if (c >= 'A' && c <= 'Z')
+      c += 32;
+    if (local[j] != c)
+      break;
+    j++;
+  }
+  return j;
+}
+
+/**
+ * FUNCTION: putDigits - write v as exactly `width` digits (faster than sprintf)
+ */
+static void putDigits(char *dst, uint64_t v, int width) {
+  for (int j = width - 1; j >= 0; j--) {
+    dst[j] = '0' + v % 10;
+    v /= 10;
+  }
+  dst[width] = '\0';
+}
+
+/**
+ * FUNCTION: encodeBlock - encode rows into one block
+ *
+ * - const Student *s: rows of this block
+ * - int n: amount of rows
+ * - Buf *out: block is appended here
+ */
+static void encodeBlock(const Student *s, int n, Buf *out) {
+  Buf b = {0};
+  Dict first, sur, nick, dom;
+  int *fi = malloc(n * sizeof(int)), *si = malloc(n * sizeof(int));
+  int *ni = malloc(n * sizeof(int)), *di = malloc(n * sizeof(int));
+  dictInit(&first, n);
+  dictInit(&sur, n);
+  dictInit(&nick, n);
+  dictInit(&dom, n);
+
+  /** build dictionaries */
+  for (int j = 0; j < n; j++) {
+    int fl = firstNameLen(s[j].name);
+    const char *rest = s[j].name[fl] == ' ' ? s[j].name + fl + 1 : s[j].name + fl;
+    const char *at = strchr(s[j].email, '@');
+    fi[j] = dictIndex(&first, s[j].name, fl);
+    si[j] = dictIndex(&sur, rest, strlen(rest));
+    ni[j] = dictIndex(&nick, s[j].nick, strlen(s[j].nick));
+    di[j] = at != NULL ? dictIndex(&dom, at + 1, strlen(at + 1)) + 1 : 0;
+  }
+  dictWrite(&b, &first);
+  dictWrite(&b, &sur);
+  dictWrite(&b, &nick);
+  dictWrite(&b, &dom);
+
+  /** ids: delta from previous id */
+  int64_t prev = 0;
+  for (int j = 0; j < n; j++) {
+    uint64_t k = ybPackId(s[j].id);
+    if (k == UINT64_MAX) {
+      bufVarint(&b, 0);
+      bufString(&b, s[j].id, strlen(s[j].id));
+      continue;
+    }
+    bufVarint(&b, zigzag((int64_t)k - prev) + 1);
+    prev = (int64_t)k;
+  }
+
+  /** course: 4 rows per byte, then exceptions */
+  int exceptions = 0;
+  bufReserve(&b, (n + 3) / 4);
+  memset(b.p + b.len, 0, (n + 3) / 4);
+  for (int j = 0; j < n; j++) {
+    if (s[j].course < 0 || s[j].course > 3)
+      exceptions++;
+    b.p[b.len + j / 4] |= (s[j].course & 3) << (j % 4 * 2);
+  }
+  b.len += (n + 3) / 4;
+  bufVarint(&b, exceptions);
+  for (int j = 0; j < n; j++) {
+    if (s[j].course < 0 || s[j].course > 3) {
+      bufVarint(&b, j);
+      bufVarint(&b, zigzag(s[j].course));
+    }
+  }
+
+  /** dictionary encoded columns */
+  for (int j = 0; j < n; j++)
+    bufVarint(&b, fi[j]);
+  for (int j = 0; j < n; j++)
+    bufVarint(&b, si[j]);
+  for (int j = 0; j < n; j++)
+    bufVarint(&b, ni[j]);
+  for (int j = 0; j < n; j++) {
+    const char *at = strchr(s[j].email, '@');
+    int ll = at != NULL ? (int)(at - s[j].email) : (int)strlen(s[j].email);
+    int sh = sharedWithFirstName(s[j].email, ll, s[j].name);
+    bufVarint(&b, di[j]);
+    bufVarint(&b, sh);
+    bufString(&b, s[j].email + sh, ll - sh);
+  }
+
+  /** phone: 10 digits fit in a varint */
+  for (int j = 0; j < n; j++) {
+    if (strlen(s[j].phone) == 10 && strspn(s[j].phone, "0123456789") == 10) {
+      bufVarint(&b, strtoull(s[j].phone, NULL, 10) + 1);
+    }
+    else {
+      bufVarint(&b, 0);
+      bufString(&b, s[j].phone, strlen(s[j].phone));
+    }
+  }
+
+  uint32_t hdr[2] = {(uint32_t)b.len, (uint32_t)n};
+  bufPut(out, hdr, sizeof(hdr));
+  bufPut(out, b.p, b.len);
+
+  dictFree(&first);
+  dictFree(&sur);
+  dictFree(&nick);
+  dictFree(&dom);
+  free(fi);
+  free(si);
+  free(ni);
+  free(di);
+  free(b.p);
+}
+
+/**
+ * STRUCT: DecDict - decoded dictionary, strings point into the block
+ */
+typedef struct {
+  const unsigned char **str;
+  int *len;
+  int n;
+} DecDict;
+
+static void readDict(Reader *r, DecDict *d, int maxEntries) {
+  uint64_t n = readVarint(r);
+  d->n = 0;
+  if (n > (uint64_t)maxEntries) {
+    r->bad = 1;
+    return;
+  }
+  for (uint64_t k = 0; k < n && !r->bad; k++) {
+    uint64_t l = readVarint(r);
+    if (l > (uint64_t)(r->end - r->p)) {
+      r->bad = 1;
+      return;
+    }
+    d->str[k] = r->p;
+    d->len[k] = (int)l;
+    r->p += l;
+    d->n++;
+  }
+}
+
+/**
+ * FUNCTION: dictCopy - copy dictionary entry k into dst (truncated to cap - 1)
+ */
+static int dictCopy(Reader *r, DecDict *d, uint64_t k, char *dst, size_t cap) {
+  if (k >= (uint64_t)d->n) {
+    r->bad = 1;
+    return 0;
+  }
+  size_t c = (size_t)d->len[k] < cap ? (size_t)d->len[k] : cap - 1;
+  memcpy(dst, d->str[k], c);
+  dst[c] = '\0';
+  return (int)c;
+}
+
+/**
+ * FUNCTION: decodeBlock - decode one block into rows
+ *
+ * - const unsigned char *p: block body (after the 8 byte block header)
+ * - size_t len: body length
+ * - int n: amount of rows
+ * - Student *out: receives n rows
+ *
+ * EXPLAINATION:
+ * return YB_OK, or YB_ERR_INVALID if the block is corrupt
+ */
+static int decodeBlock(const unsigned char *p, size_t len, int n, Student *out) {
+  Reader r = {p, p + len, 0};
+  DecDict d[4];
+  const unsigned char **strs = malloc(4 * n * sizeof(char *));
+  int *lens = malloc(4 * n * sizeof(int));
+  for (int k = 0; k < 4; k++) {
+    d[k].str = strs + k * n;
+    d[k].len = lens + k * n;
+    readDict(&r, &d[k], n);
+  }
+  memset(out, 0, n * sizeof(Student));
+
+  int64_t prev = 0;
+  for (int j = 0; j < n && !r.bad; j++) {
+    uint64_t v = readVarint(&r);
+    if (v == 0) {
+      readString(&r, out[j].id, sizeof(out[j].id));
+      continue;
+    }
+    prev += unzigzag(v - 1);
+    if (prev < 0 || prev > 99999999999ll) {
+      r.bad = 1;
+      break;
+    }
+    putDigits(out[j].id, (uint64_t)prev, 11);
+  }
+
+  size_t cb = (n + 3) / 4;
+  if (!r.bad && (size_t)(r.end - r.p) >= cb) {
+    for (int j = 0; j < n; j++)
+      out[j].course = (r.p[j / 4] >> (j % 4 * 2)) & 3;
+    r.p += cb;
+  }
+  else {
+    r.bad = 1;
+  }
+  uint64_t ex = readVarint(&r);
+  for (uint64_t k = 0; k < ex && !r.bad; k++) {
+    uint64_t j = readVarint(&r);
+    int64_t c = unzigzag(readVarint(&r));
+    if (j >= (uint64_t)n)
+      r.bad = 1;
+    else
+      out[j].course = (int)c;
+  }
+
+  for (int j = 0; j < n && !r.bad; j++)
+    dictCopy(&r, &d[0], readVarint(&r), out[j].name, sizeof(out[j].name));
+  for (int j = 0; j < n && !r.bad; j++) {
+    char sur[55];
+    int fl = strlen(out[j].name);
+    dictCopy(&r, &d[1], readVarint(&r), sur, sizeof(sur));
+    if (sur[0] != '\0' && fl + 1 < (int)sizeof(out[j].name)) {
+      out[j].name[fl] = ' ';
+      strncpy(out[j].name + fl + 1, sur, sizeof(out[j].name) - fl - 2);
+    }
+  }
+  for (int j = 0; j < n && !r.bad; j++)
+    dictCopy(&r, &d[2], readVarint(&r), out[j].nick, sizeof(out[j].nick));
+  for (int j = 0; j < n && !r.bad; j++) {
+    uint64_t di = readVarint(&r), sh = readVarint(&r);
+    int fl = firstNameLen(out[j].name);
+    if (sh > (uint64_t)fl) {
+      r.bad = 1;
+      break;
+    }
+    for (uint64_t k = 0; k < sh; k++) {
+      char c = out[j].name[k];
+      out[j].email[k] = c >= 'A' && c <= 'Z' ? c + 32 : c;
+    }
+    readString(&r, out[j].email + sh, sizeof(out[j].email) - sh);
+    if (di > 0) {
+      int el = strlen(out[j].email);
+      if (el + 1 < (int)sizeof(out[j].email)) {
+        out[j].email[el] = '@';
+        dictCopy(&r, &d[3], di - 1, out[j].email + el + 1,
+                 sizeof(out[j].email) - el - 1);
+      }
+    }
+  }
+  for (int j = 0; j < n && !r.bad; j++) {
+    uint64_t v = readVarint(&r);
+    if (v == 0)
+      readString(&r, out[j].phone, sizeof(out[j].phone));
+    else
+      putDigits(out[j].phone, (v - 1) % 10000000000ull, 10);
+  }
+  free(strs);
+  free(lens);
+  return r.bad ? YB_ERR_INVALID : YB_OK;
+}
+
+/**
+ * FUNCTION: ybSnapshotWrite - write every student into a compressed snapshot
+ *
+ * - const char *path: snapshot file to write
+ * - YbSnapshotStats *st: receives sizes (may be NULL)
+ *
+ * EXPLAINATION:
+ * rows are read with an iterator in blocks of SNAP_BLOCK_ROWS, each
+ * block is encoded on its own and written, and the block index goes
+ * in the footer so a reader can jump straight to any block.
+ */
+int ybSnapshotWrite(YbDb *db, const char *path, YbSnapshotStats *st) {
+  YbIter *it;
+  Buf out = {0}, footer = {0};
+  Student *rows = malloc(SNAP_BLOCK_ROWS * sizeof(Student));
+  long long total = 0, rawBytes = 0, written = 0;
+  int blocks = 0, err = ybIterOpen(db, &it);
+  if (err != YB_OK) {
+    free(rows);
+    return err;
+  }
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    ybIterClose(it);
+    free(rows);
+    return YB_ERR_IO;
+  }
+  uint32_t version = SNAP_VERSION;
+  fwrite(SNAP_MAGIC, 4, 1, f);
+  fwrite(&version, 4, 1, f);
+  written = 8;
+
+  int more = 1;
+  while (more) {
+    int n = 0;
+    while (n < SNAP_BLOCK_ROWS && (more = ybIterNext(it, &rows[n])))
+      n++;
+    if (n == 0)
+      break;
+
+    for (int j = 0; j < n; j++)
+      rawBytes += strlen(rows[j].id) + strlen(rows[j].name) +
+                  strlen(rows[j].nick) + strlen(rows[j].email) +
+                  strlen(rows[j].phone) + 7;
+
+    uint64_t entry[3] = {(uint64_t)written, ybPackId(rows[0].id), (uint64_t)n};
+    bufPut(&footer, entry, sizeof(entry));
+    out.len = 0;
+    encodeBlock(rows, n, &out);
+    if (fwrite(out.p, out.len, 1, f) != 1)
+      err = YB_ERR_IO;
+    written += out.len;
+    total += n;
+    blocks++;
+  }
+  ybIterClose(it);
+
+  uint64_t tail[2] = {(uint64_t)written, (uint64_t)blocks};
+  bufPut(&footer, tail, sizeof(tail));
+  bufPut(&footer, SNAP_MAGIC, 4);
+  if (fwrite(footer.p, footer.len, 1, f) != 1)
+    err = YB_ERR_IO;
+  written += footer.len;
+  if (fclose(f) != 0)
+    err = YB_ERR_IO;
+
+  if (st != NULL) {
+    st->rows = total;
+    st->blocks = blocks;
+    st->rawBytes = rawBytes;
+    st->snapshotBytes = written;
+  }
+  free(out.p);
+  free(footer.p);
+  free(rows);
+  if (err != YB_OK)
+    remove(path);
+  return err;
+}
+
+/**
+ * STRUCT: SnapReader - state of an iterator over a snapshot
+ */
+struct SnapReader {
+  FILE *f;
+  long long blocksLeft;
+  unsigned char *buf;
+  size_t bufCap;
+  Student *rows;
+  int n;
+  int pos;
+};
+
+/**
+ * FUNCTION: snapOpen - open a snapshot for reading block by block
+ */
+int snapOpen(const char *path, SnapReader **out) {
+  char magic[4];
+  uint32_t version;
+  uint64_t tail[2];
+  *out = NULL;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return YB_ERR_IO;
+  if (fread(magic, 4, 1, f) != 1 || memcmp(magic, SNAP_MAGIC, 4) != 0 ||
+      fread(&version, 4, 1, f) != 1 || version != SNAP_VERSION ||
+      fseek(f, -(long)(sizeof(tail) + 4), SEEK_END) != 0 ||
+      fread(tail, sizeof(tail), 1, f) != 1 || fread(magic, 4, 1, f) != 1 ||
+      memcmp(magic, SNAP_MAGIC, 4) != 0 || fseek(f, 8, SEEK_SET) != 0) {
+    fclose(f);
+    return YB_ERR_INVALID;
+  }
+  SnapReader *s = calloc(1, sizeof(SnapReader));
+  s->f = f;
+  s->blocksLeft = (long long)tail[1];
+  s->rows = malloc(SNAP_BLOCK_ROWS * sizeof(Student));
+  *out = s;
+  return YB_OK;
+}
+
+/**
+ * FUNCTION: snapNext - next row of a snapshot, decoding the next block when needed
+ *
+ * EXPLAINATION:
+ * return 1 for a row, 0 at the end, -1 if the snapshot is corrupt
+ */
+int snapNext(SnapReader *s, Student *out) {
+  while (s->pos >= s->n) {
+    uint32_t hdr[2];
+    if (s->blocksLeft <= 0)
+      return 0;
+    if (fread(hdr, sizeof(hdr), 1, s->f) != 1 || hdr[1] == 0 ||
+        hdr[1] > SNAP_BLOCK_ROWS)
+      return -1;
+    if (hdr[0] > s->bufCap) {
+      s->bufCap = hdr[0];
+      s->buf = realloc(s->buf, s->bufCap);
+    }
+    if (fread(s->buf, hdr[0], 1, s->f) != 1 ||
+        decodeBlock(s->buf, hdr[0], hdr[1], s->rows) != YB_OK)
+      return -1;
+    s->n = hdr[1];
+    s->pos = 0;
+    s->blocksLeft--;
+  }
+  *out = s->rows[s->pos++];
+  return 1;
+}
+
+/**
+ * FUNCTION: snapClose - release a snapshot reader
+ */
+void snapClose(SnapReader *s) {
+  if (s == NULL)
+    return;
+  fclose(s->f);
+  free(s->buf);
+  free(s->rows);
+  free(s);
+}
+
+/**
+ * FUNCTION: ybSnapshotIterOpen - read the rows of a snapshot with an iterator
+ *
+ * - const char *path: snapshot file
+ * - YbIter **it: receives the iterator, use ybIterNext() / ybIterClose()
+ */
+int ybSnapshotIterOpen(const char *path, YbIter **it) {
+  *it = calloc(1, sizeof(YbIter));
+  if (*it == NULL)
+    return YB_ERR_NOMEM;
+  int err = snapOpen(path, &(*it)->snap);
+  if (err != YB_OK) {
+    free(*it);
+    *it = NULL;
+  }
+  return err;
+}
+
+/**
+ * FUNCTION: ybSnapshotRestore - load a snapshot into a database
+ *
+ * - const char *path: snapshot file
+ * - int *rows: receives amount of restored rows
+ *
+ * EXPLAINATION:
+ * csv backend: the data file is replaced by the snapshot's rows.
+ * B+tree backend: rows are added like ybImportCsv(), existing ids are
+ * skipped.
+ */
+int ybSnapshotRestore(YbDb *db, const char *path, int *rows) {
+  SnapReader *s;
+  Student cur;
+  *rows = 0;
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  int r, err = snapOpen(path, &s);
+  if (err != YB_OK)
+    return err;
+
+  if (db->bt != NULL) {
+    while ((r = snapNext(s, &cur)) == 1)
+      if (btAddStudent(db->bt, &cur, 0) == YB_OK)
+        (*rows)++;
+    snapClose(s);
+    err = btCommit(db->bt);
+    return r < 0 ? YB_ERR_INVALID : err;
+  }
+
+  FILE *out = fopen(db->tmpPath, "w");
+  if (out == NULL) {
+    snapClose(s);
+    return YB_ERR_IO;
+  }
+  while ((r = snapNext(s, &cur)) == 1) {
+    ybWriteLine(out, &cur);
+    (*rows)++;
+  }
+  snapClose(s);
+  if (fclose(out) != 0 || r < 0) {
+    remove(db->tmpPath);
+    return r < 0 ? YB_ERR_INVALID : YB_ERR_IO;
+  }
+  err = ybReplaceFile(db);
+  if (err == YB_OK)
+    replReset(db);
+  return err;
+}
@@ -0,0 +1,378 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+#define RADIX_BITS 13
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/**
+ * FUNTCION: ybRadixSortIndex - LSD radix sort on packed ids
+ *
+ * - uint64_t *keys: packed id of each row
+ * - int *idx: index array, output is idx[] ordered by keys[idx[]]
+ * - int n: amount of rows
+ *
+ * EXPLAINATION:
+ * instead of moving whole Student structs around, sort an array of
+ * row indexes. each pass is a stable counting sort on RADIX_BITS bits
+ * of the key, starting from the lowest bits, so after the last pass
+ * the rows are fully ordered in O(n) time. a pass where every key has
+ * the same digit (e.g. the cohort part of the id when everyone is in
+ * the same year) is skipped.
+ */
+void ybRadixSortIndex(uint64_t *keys, int *idx, int n) {
+  int *tmp = malloc((n > 0 ? n : 1) * sizeof(int));
+  int *cnt = malloc(RADIX_SIZE * sizeof(int));
+  for (int j = 0; j < n; j++)
+    idx[j] = j;
+
+  /** 
+   * 3 passes cover the 37 bits of a valid id, the 4th and 5th
+   * only do work when there are invalid ids (UINT64_MAX keys)
+   */
+  for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+    memset(cnt, 0, RADIX_SIZE * sizeof(int));
+    for (int j = 0; j < n; j++)
+      cnt[(keys[j] >> shift) & (RADIX_SIZE - 1)]++;
+
+    /** skip the pass if every key falls into one bucket */
+    if (n == 0 || cnt[(keys[0] >> shift) & (RADIX_SIZE - 1)] == n)
+      continue;
+
+    /** turn counts into starting position of each bucket */
+    for (int b = 0, sum = 0; b < RADIX_SIZE; b++) {
+      int c = cnt[b];
+      cnt[b] = sum;
+      sum += c;
+    }
+    for (int j = 0; j < n; j++)
+      tmp[cnt[(keys[idx[j]] >> shift) & (RADIX_SIZE - 1)]++] = idx[j];
+    memcpy(idx, tmp, n * sizeof(int));
+  }
+  free(tmp);
+  free(cnt);
+}
+
+/**
+ * FUNTCION: sortInMemory - read whole data file, sort it and write it back
+ *
+ * EXPLAINATION:
+ * reading data file into an array, sort it using ybRadixSortIndex()
+ * order by id, then write it to the temp file that replaces the data
+ * file. only rows that could be parsed are written.
+ */
+static int sortInMemory(YbDb *db) {
+  char line[LINE_MAX_LEN];
+  int i = 0, cap = 1024, err = YB_OK;
+
+  FILE *f = fopen(db->path, "r");
+  if (f == NULL)
+    return YB_ERR_IO;
+  Student *d = malloc(cap * sizeof(Student));
+
+  while (fgets(line, sizeof(line), f)) {
+    if (i == cap) {
+      cap *= 2;
+      d = realloc(d, cap * sizeof(Student));
+    }
+    if (ybParseLine(line, &d[i]))
+      i++;
+  }
+  fclose(f);
+
+  uint64_t *keys = malloc((i > 0 ? i : 1) * sizeof(uint64_t));
+  int *idx = malloc((i > 0 ? i : 1) * sizeof(int));
+  for (int j = 0; j < i; j++)
+    keys[j] = ybPackId(d[j].id);
+  ybRadixSortIndex(keys, idx, i);
+  free(keys);
+
+  f = fopen(db->tmpPath, "w");
+  if (f == NULL) {
+    err = YB_ERR_IO;
+  } 
+  else {
+    for (int j = 0; j < i; j++)
+      ybWriteLine(f, &d[idx[j]]);
+    if (fclose(f) != 0)
+      err = YB_ERR_IO;
+  }
+  free(idx);
+  free(d);
+  return err == YB_OK ? ybReplaceFile(db) : err;
+}
+
+/**
+ * STRUCT: MergeNode - heap entry for the k-way merge
+ *
+ * - key: packed id of `line`
+ * - run: index of the run file `line` came from
+ * - line: current line of that run
+ */
+typedef struct {
+  uint64_t key;
+  int run;
+  char line[LINE_MAX_LEN];
+} MergeNode;
+
+/**
+ * FUNCTION: siftDownMergeHeap - restore min-heap order from position i
+ *
+ * - MergeNode **h: heap array (pointers so swapping is cheap)
+ * - int n: heap size
+ * - int i: position to sift down from
+ */
+static void siftDownMergeHeap(MergeNode **h, int n, int i) {
+  while (1) {
+    int l = 2 * i + 1, r = l + 1, m = i;
+    if (l < n && h[l]->key < h[m]->key)
+      m = l;
+    if (r < n && h[r]->key < h[m]->key)
+      m = r;
+    if (m == i)
+      return;
+    MergeNode *t = h[i];
+    h[i] = h[m];
+    h[m] = t;
+    i = m;
+  }
+}
+
+/**
+ * FUNCTION: mergeRunFiles - k-way merge sorted run files into one file
+ *
+ * - char runs[][280]: paths of sorted run files (removed after merging)
+ * - int k: amount of run files
+ * - const char *outPath: path of merged output
+ *
+ * EXPLAINATION:
+ * keep the current line of every run in a min-heap keyed on its packed
+ * id. repeatedly write the smallest line and replace it with the next
+ * line from the same run. memory use is k lines no matter how big the
+ * runs are.
+ */
+static int mergeRunFiles(char runs[][280], int k, const char *outPath) {
+  FILE **in = calloc(k, sizeof(FILE *));
+  MergeNode *nodes = malloc(k * sizeof(MergeNode));
+  MergeNode **h = malloc(k * sizeof(MergeNode *));
+  FILE *out = fopen(outPath, "w");
+  int n = 0, err = out == NULL;
+  char id[12];
+
+  for (int j = 0; j < k && !err; j++) {
+    in[j] = fopen(runs[j], "r");
+    if (in[j] == NULL) {
+      err = 1;
+      break;
+    }
+    if (fgets(nodes[j].line, sizeof(nodes[j].line), in[j])) {
+      sscanf(nodes[j].line, "%11[^,]", id);
+      nodes[j].key = ybPackId(id);
+      nodes[j].run = j;
+      h[n++] = &nodes[j];
+    }
+  }
+  for (int j = n / 2 - 1; j >= 0; j--)
+    siftDownMergeHeap(h, n, j);
+
+  while (n > 0 && !err) {
+    MergeNode *top = h[0];
+    fputs(top->line, out);
+    if (fgets(top->line, sizeof(top->line), in[top->run])) {
+      sscanf(top->line, "%11[^,]", id);
+      top->key = ybPackId(id);
+    } 
+    else {
+      h[0] = h[--n];
+    }
+    siftDownMergeHeap(h, n, 0);
+  }
+
+  for (int j = 0; j < k; j++) {
+    if (in[j] != NULL)
+      fclose(in[j]);
+    remove(runs[j]);
+  }
+  if (out != NULL && fclose(out) != 0)
+    err = 1;
+  free(in);
+  free(nodes);
+  free(h);
+  return err ? YB_ERR_IO : YB_OK;
+}
+
+/**
+ * FUNCTION: sortExternal - sort data file bigger than memory budget
+ *
+ * EXPLAINATION:
+ * read as many rows as the memory budget allows, radix sort them and
+ * write them to a run file. repeat until the data file is consumed,
+ * then merge the runs MERGE_FANIN at a time (more than one round only
+ * if there are a lot of runs) into the final sorted file which
+ * replaces the data file. peak memory is about the memory budget.
+ */
+static int sortExternal(YbDb *db) {
+  char line[LINE_MAX_LEN];
+  long long perRow = sizeof(Student) + sizeof(uint64_t) + 2 * sizeof(int);
+  long long rowsPerRun = db->memBudget / perRow;
+  if (rowsPerRun < 1024)
+    rowsPerRun = 1024;
+  if (rowsPerRun > INT_MAX) // row indexes of a run are ints
+    rowsPerRun = INT_MAX;
+  int runCount = 0, runCap = 16, gen = 0, err = YB_OK, i;
+  char (*runs)[280] = malloc(runCap * sizeof(*runs));
+
+  FILE *f = fopen(db->path, "r");
+  if (f == NULL) {
+    free(runs);
+    return YB_ERR_IO;
+  }
+  Student *d = malloc(rowsPerRun * sizeof(Student));
+  uint64_t *keys = malloc(rowsPerRun * sizeof(uint64_t));
+  int *idx = malloc(rowsPerRun * sizeof(int));
+
+  /**
+   * run generation: fill the buffer, sort it, write it out
+   */
+  int eof = 0;
+  while (!eof && err == YB_OK) {
+    i = 0;
+    while (i < rowsPerRun) {
+      if (!fgets(line, sizeof(line), f)) {
+        eof = 1;
+        break;
+      }
+      if (ybParseLine(line, &d[i])) {
+        keys[i] = ybPackId(d[i].id);
+        i++;
+      }
+    }
+    if (i == 0)
+      break;
+
+    ybRadixSortIndex(keys, idx, i);
+    if (runCount == runCap) {
+      runCap *= 2;
+      runs = realloc(runs, runCap * sizeof(*runs));
+    }
+    /** a cut name could be another run's (or another file's) */
+    if (snprintf(runs[runCount], sizeof(runs[runCount]), "%s.run%d.%d",
+                 db->path, gen, runCount) >= (int)sizeof(runs[runCount])) {
+      err = YB_ERR_INVALID;
+      break;
+    }
+    FILE *r = fopen(runs[runCount], "w");
+    if (r == NULL) {
+      err = YB_ERR_IO;
+      break;
+    }
+    runCount++;
+    for (int j = 0; j < i; j++)
+      ybWriteLine(r, &d[idx[j]]);
+    if (fclose(r) != 0)
+      err = YB_ERR_IO;
+  }
+  fclose(f);
+  free(d);
+  free(keys);
+  free(idx);
+
+  /**
+   * merge rounds: while there are too many runs to open at once,
+   * merge groups of MERGE_FANIN runs into bigger runs
+   */
+  while (runCount > MERGE_FANIN && err == YB_OK) {
+    int next = 0;
+    gen++;
+    for (int j = 0; j < runCount && err == YB_OK; j += MERGE_FANIN) {
+      int k = runCount - j < MERGE_FANIN ? runCount - j : MERGE_FANIN;
+      char merged[280];
+      int from = j;
+      if (snprintf(merged, sizeof(merged), "%s.run%d.%d", db->path, gen,
+                   next) >= (int)sizeof(merged)) {
+        err = YB_ERR_INVALID;
+      }
+      else if ((err = mergeRunFiles(runs + j, k, merged)) != YB_OK) {
+        remove(merged);
+        from = j + k; // mergeRunFiles() removed its inputs
+      }
+      if (err != YB_OK) {
+        /** the failed output and the runs not merged yet are dropped,
+         * the outputs of this round are removed below */
+        for (int r = from; r < runCount; r++)
+          remove(runs[r]);
+        break;
+      }
+      strcpy(runs[next++], merged);
+    }
+    runCount = next;
+  }
+
+  if (err == YB_OK)
+    err = mergeRunFiles(runs, runCount, db->tmpPath);
+  else
+    for (int j = 0; j < runCount; j++)
+      remove(runs[j]);
+  free(runs);
+
+  if (err != YB_OK) {
+    remove(db->tmpPath);
+    return err;
+  }
+  return ybReplaceFile(db);
+}
+
+/**
+ * FUNTCION: ybSort - sort data file by id
+ *
+ * EXPLAINATION:
+ * if the whole data file fits in the memory budget, sort it in memory.
+ * otherwise fall back to the external merge sort. the B+tree
+ * backend is always in id order so there is nothing to do.
+ */
+int ybSort(YbDb *db) {
+  int len;
+  if (db->bt != NULL)
+    return YB_OK;
+  if (replReadOnly(db))
+    return YB_ERR_READONLY;
+  if (ybRowCount(db, &len) != YB_OK)
+    return YB_ERR_IO;
+  long long need = (long long)len *
+                   (sizeof(Student) + sizeof(uint64_t) + 2 * sizeof(int));
+  if (need <= db->memBudget)
+    return sortInMemory(db);
+  return sortExternal(db);
+}
+
+/**
+ * FUNCTION: ybIsSorted - check if data file is ordered by id
+ *
+ * EXPLAINATION:
+ * stream through the data file comparing each packed id with the one
+ * before it. stops at the first row that is out of order. return 1
+ * if sorted (or unreadable), 0 if not.
+ */
+int ybIsSorted(YbDb *db) {
+  char line[LINE_MAX_LEN], id[12];
+  uint64_t prev = 0, k;
+  if (db->bt != NULL || replReadOnly(db))
+    return 1;
+  FILE *f = fopen(db->path, "r");
+  if (f == NULL)
+    return 1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%11[^,]", id) != 1)
+      continue;
+    k = ybPackId(id);
+    if (k < prev) {
+      fclose(f);
+      return 0;
+    }
+    prev = k;
+  }
+  fclose(f);
+  return 1;
+}
@@ -0,0 +1,693 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32) && !defined(__MINGW32__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * integrity checks of a csv data file
+ *
+ * every time libyookbeer writes the data file it also writes
+ * `<data file>.crc`: a CRC32C per VERIFY_BLOCK bytes of the file.
+ * ybVerify() reads the file once, split between threads, and checks
+ * - the block checksums against `.crc` (a block that differs was
+ *   changed outside of yookbeer, or damaged)
+ * - every line: 6 columns, valid fields, course 0-3
+ * - ids going up without duplicates, emails without duplicates
+ * problems are reported with their line number.
+ *
+ * CRC32C uses the SSE4.2 crc32 instruction when the CPU has it, a
+ * slicing-by-8 table otherwise.
+ */
+
+#define CRC_MAGIC "YBCRC1\n"
+#define CRC_POLY 0x82f63b78
+
+/**
+ * STRUCT: CrcHeader - start of a `.crc` file, followed by `blocks` CRCs
+ */
+typedef struct {
+  char magic[8];
+  uint32_t blockSize;
+  uint32_t blocks;
+  uint64_t fileSize;
+} CrcHeader;
+
+static uint32_t crcTable[8][256];
+static int crcHw;
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void crcInit(void) {
+  for (int b = 0; b < 256; b++) {
+    uint32_t c = b;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? (c >> 1) ^ CRC_POLY : c >> 1;
+    crcTable[0][b] = c;
+  }
+  for (int b = 0; b < 256; b++)
+    for (int t = 1; t < 8; t++)
+      crcTable[t][b] = (crcTable[t - 1][b] >> 8) ^
+                       crcTable[0][crcTable[t - 1][b] & 0xff];
+#if defined(__GNUC__) && defined(__x86_64__)
+  crcHw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crcSoft(uint32_t crc, const uint8_t *p, size_t n) {
+  for (; n >= 8; p += 8, n -= 8) {
+    crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+    crc = crcTable[7][crc & 0xff] ^ crcTable[6][(crc >> 8) & 0xff] ^
+          crcTable[5][(crc >> 16) & 0xff] ^ crcTable[4][crc >> 24] ^
+          crcTable[3][p[4]] ^ crcTable[2][p[5]] ^ crcTable[1][p[6]] ^
+          crcTable[0][p[7]];
+  }
+  while (n--)
+    crc = crcTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crcSse(uint32_t crc, const uint8_t *p, size_t n) {
+  uint64_t c = crc, v;
+  for (; n >= 8; p += 8, n -= 8) {
+    memcpy(&v, p, 8);
+    c = __builtin_ia32_crc32di(c, v);
+  }
+  while (n--)
+    c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+  return (uint32_t)c;
+}
+#endif
+
+/**
+ * FUNCTION: ybCrc32c - CRC32C of a block
+ *
+ * - uint32_t crc: 0, or the CRC32C of the bytes before data to continue it
+ */
+uint32_t ybCrc32c(uint32_t crc, const void *data, size_t n) {
+  pthread_once(&crcOnce, crcInit);
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (crcHw)
+    return ~crcSse(~crc, data, n);
+#endif
+  return ~crcSoft(~crc, data, n);
+}
+
+static void crcPath(const YbDb *db, char *out, size_t cap, const char *ext) {
+  snprintf(out, cap, "%s.crc%s", db->path, ext);
+}
+
+/**
+ * FUNCTION: ybWriteChecksums - record the block checksums of the data file
+ *
+ * EXPLAINATION:
+ * done by every write of the library (see ybReplaceFile()), call it
+ * after changing the data file on purpose outside of yookbeer. the
+ * checksums are written to a temp file first and renamed over `.crc`.
+ */
+int ybWriteChecksums(YbDb *db) {
+  char path[300], tmp[300];
+  if (db->bt != NULL || replReadOnly(db))
+    return YB_ERR_INVALID;
+  crcPath(db, path, sizeof(path), "");
+  crcPath(db, tmp, sizeof(tmp), ".tmp");
+  FILE *in = fopen(db->path, "rb");
+  FILE *out = fopen(tmp, "wb");
+  uint8_t *buf = malloc(VERIFY_BLOCK);
+  CrcHeader h = {CRC_MAGIC, VERIFY_BLOCK, 0, 0};
+  size_t n;
+  int err = in == NULL || out == NULL ? YB_ERR_IO : YB_OK;
+  if (buf == NULL)
+    err = YB_ERR_NOMEM;
+  /** header is written again at the end, when the sizes are known */
+  if (err == YB_OK && fwrite(&h, sizeof(h), 1, out) != 1)
+    err = YB_ERR_IO;
+  while (err == YB_OK && (n = fread(buf, 1, VERIFY_BLOCK, in)) > 0) {
+    uint32_t c = ybCrc32c(0, buf, n);
+    if (fwrite(&c, sizeof(c), 1, out) != 1)
+      err = YB_ERR_IO;
+    h.blocks++;
+    h.fileSize += n;
+  }
+  if (err == YB_OK && (fseek(out, 0, SEEK_SET) != 0 ||
+                       fwrite(&h, sizeof(h), 1, out) != 1))
+    err = YB_ERR_IO;
+  if (in != NULL)
+    fclose(in);
+  if (out != NULL && fclose(out) != 0 && err == YB_OK)
+    err = YB_ERR_IO;
+  free(buf);
+#if defined(_WIN32) || defined(__MINGW32__)
+  if (err == YB_OK)
+    remove(path);
+#endif
+  if (err == YB_OK && rename(tmp, path) != 0)
+    err = YB_ERR_IO;
+  if (err != YB_OK) {
+    /** stale checksums would only report false problems */
+    remove(tmp);
+    remove(path);
+  }
+  return err;
+}
+
+/**
+ * FUNCTION: loadChecksums - read `.crc`, NULL when there is none
+ */
+static uint32_t *loadChecksums(const YbDb *db, CrcHeader *h) {
+  char path[300];
+  crcPath(db, path, sizeof(path), "");
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+  uint32_t *crc = NULL;
+  if (fread(h, sizeof(*h), 1, f) == 1 &&
+      memcmp(h->magic, CRC_MAGIC, sizeof(h->magic)) == 0 &&
+      h->blockSize == VERIFY_BLOCK &&
+      (crc = malloc((h->blocks + 1) * sizeof(uint32_t))) != NULL &&
+      fread(crc, sizeof(uint32_t), h->blocks, f) != h->blocks) {
+    free(crc);
+    crc = NULL;
+  }
+  fclose(f);
+  return crc;
+}
+
+/**
+ * STRUCT: Issue - a problem found by a worker, by byte offset of its line
+ *
+ * - other: DUP_*: offset of the first line with the same value
+ */
+typedef struct {
+  YbProblemKind kind;
+  uint64_t off;
+  uint64_t other;
+} Issue;
+
+/**
+ * STRUCT: IssueList - the first `cap` issues in file order, count: all of them
+ */
+typedef struct {
+  Issue *at;
+  int cap;
+  long long count;
+} IssueList;
+
+/**
+ * STRUCT: VerifyTask - one thread's part of the file
+ *
+ * - from, to: byte range, whole blocks. the thread owns the lines
+ *   starting in that range
+ * - hash, off: email hash and line offset of every valid row
+ * - firstKey/firstOff, lastKey/lastOff: ids at the edges of the range,
+ *   to check the order across ranges
+ * - blockIssues, rowIssues: checksum and line problems. kept apart as
+ *   each list has to be in file order
+ * - unsorted: an id is smaller than the one before it
+ * - dupIds: amount of DUP_ID problems (ids repeated on the next row)
+ * - threaded: ran on its own thread, which has to be joined
+ */
+typedef struct {
+  const char *buf;
+  size_t size, from, to;
+  const uint32_t *expect;
+  long long expectBlocks;
+  int *newlines;
+  IssueList blockIssues, rowIssues;
+  uint64_t *hash, *off;
+  long long n, rowCap;
+  uint64_t firstKey, lastKey, firstOff, lastOff;
+  int unsorted;
+  long long dupIds;
+  int nomem;
+  int threaded;
+} VerifyTask;
+
+static void addIssue(IssueList *l, YbProblemKind kind, uint64_t off,
+                     uint64_t other) {
+  if (l->count < l->cap) {
+    l->at[l->count].kind = kind;
+    l->at[l->count].off = off;
+    l->at[l->count].other = other;
+  }
+  l->count++;
+}
+
+static uint64_t hashEmail(const char *s) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (; *s; s++)
+    h = (h ^ (uint8_t)*s) * 0x100000001b3ULL;
+  return h;
+}
+
+static int keepRow(VerifyTask *t, uint64_t hash, uint64_t off) {
+  if (t->n == t->rowCap) {
+    long long cap = t->rowCap ? t->rowCap * 2 : 65536;
+    uint64_t *h = realloc(t->hash, cap * sizeof(uint64_t));
+    if (h != NULL)
+      t->hash = h;
+    uint64_t *o = realloc(t->off, cap * sizeof(uint64_t));
+    if (o != NULL)
+      t->off = o;
+    if (h == NULL || o == NULL)
+      return 0;
+    t->rowCap = cap;
+  }
+  t->hash[t->n] = hash;
+  t->off[t->n++] = off;
+  return 1;
+}
+
+/**
+ * FUNCTION: verifyWorker - thread entry, check one range of the file
+ */
+static void *verifyWorker(void *arg) {
+  VerifyTask *t = arg;
+  char line[LINE_MAX_LEN];
+  Student s;
+  uint64_t prev = 0, prevOff = 0;
+  int havePrev = 0;
+
+  /** block checksums and newlines per block, for line numbers */
+  for (size_t b = t->from; b < t->to; b += VERIFY_BLOCK) {
+    size_t n = t->to - b < VERIFY_BLOCK ? t->to - b : VERIFY_BLOCK;
+    long long blk = b / VERIFY_BLOCK;
+    int nl = 0;
+    for (const char *p = t->buf + b; (p = memchr(p, '\n', t->buf + b + n - p));
+         p++)
+      nl++;
+    t->newlines[blk] = nl;
+    if (t->expect != NULL &&
+        (blk >= t->expectBlocks || ybCrc32c(0, t->buf + b, n) != t->expect[blk]))
+      addIssue(&t->blockIssues, YB_PROBLEM_CHECKSUM, b, 0);
+  }
+
+  /** the first line starting at or after `from` */
+  size_t at = t->from;
+  if (at > 0) {
+    const char *nl = memchr(t->buf + at - 1, '\n', t->size - at + 1);
+    at = nl == NULL ? t->size : (size_t)(nl - t->buf) + 1;
+  }
+  t->firstKey = UINT64_MAX;
+  while (at < t->to && at < t->size) {
+    const char *p = t->buf + at, *nl = memchr(p, '\n', t->size - at);
+    size_t len = nl == NULL ? t->size - at : (size_t)(nl - p), next = at + len + 1;
+    if (len > 0 && p[len - 1] == '\r')
+      len--;
+    if (len == 0) {
+      at = next;
+      continue;
+    }
+    if (len >= LINE_MAX_LEN) {
+      addIssue(&t->rowIssues, YB_PROBLEM_PARSE, at, 0);
+      at = next;
+      continue;
+    }
+    memcpy(line, p, len);
+    line[len] = '\0';
+    if (!ybParseLine(line, &s)) {
+      addIssue(&t->rowIssues, YB_PROBLEM_PARSE, at, 0);
+    }
+    else if (s.course < 0 || s.course > 3) {
+      addIssue(&t->rowIssues, YB_PROBLEM_COURSE, at, 0);
+    }
+    else if (!ybValidStudent(&s)) {
+      addIssue(&t->rowIssues, YB_PROBLEM_FIELD, at, 0);
+    }
+    else {
+      uint64_t k = ybPackId(s.id);
+      if (havePrev && k == prev) {
+        addIssue(&t->rowIssues, YB_PROBLEM_DUP_ID, at, prevOff);
+        t->dupIds++;
+      }
+      else if (havePrev && k < prev) {
+        addIssue(&t->rowIssues, YB_PROBLEM_ORDER, at, prevOff);
+        t->unsorted = 1;
+      }
+      if (t->firstKey == UINT64_MAX) {
+        t->firstKey = k;
+        t->firstOff = at;
+      }
+      prev = t->lastKey = k;
+      prevOff = t->lastOff = at;
+      havePrev = 1;
+      if (!keepRow(t, hashEmail(s.email), at))
+        t->nomem = 1;
+    }
+    at = next;
+  }
+  return NULL;
+}
+
+/**
+ * FUNCTION: idAt - packed id of a valid line at a byte offset
+ */
+static uint64_t idAt(const char *buf, uint64_t off) {
+  char id[12];
+  memcpy(id, buf + off, 11);
+  id[11] = '\0';
+  return ybPackId(id);
+}
+
+/**
+ * FUNCTION: emailAt - email of the line at a byte offset
+ */
+static void emailAt(const char *buf, size_t size, uint64_t off, char out[61]) {
+  char line[LINE_MAX_LEN];
+  Student s;
+  size_t len = size - off < LINE_MAX_LEN - 1 ? size - off : LINE_MAX_LEN - 1;
+  memcpy(line, buf + off, len);
+  line[len] = '\0';
+  out[0] = '\0';
+  if (ybParseLine(line, &s))
+    strcpy(out, s.email);
+}
+
+/**
+ * FUNCTION: findDuplicates - duplicate keys over every valid row
+ *
+ * - uint64_t *keys, *off: key and line offset of each row, in file order
+ * - int email: keys are email hashes, equal hashes are compared as text
+ * - int *first: receives for each row the row it repeats, -1 if none
+ *
+ * EXPLAINATION:
+ * rows are ordered by key with ybRadixSortIndex(), which is stable, so
+ * within a run of equal keys the rows are still in file order and the
+ * first one is the original.
+ */
+static int findDuplicates(uint64_t *keys, const uint64_t *off, int n,
+                          int email, const char *buf, size_t size,
+                          int *first) {
+  int *idx = malloc((n > 0 ? n : 1) * sizeof(int));
+  if (idx == NULL)
+    return YB_ERR_NOMEM;
+  ybRadixSortIndex(keys, idx, n);
+  for (int j = 0; j < n; j++)
+    first[j] = -1;
+  for (int a = 0, b; a < n; a = b) {
+    for (b = a + 1; b < n && keys[idx[b]] == keys[idx[a]]; b++)
+      ;
+    if (b - a == 1)
+      continue;
+    if (!email) {
+      for (int j = a + 1; j < b; j++)
+        first[idx[j]] = idx[a];
+      continue;
+    }
+    /** same hash: compare the emails, usually there is one group */
+    for (int j = a + 1; j < b; j++) {
+      char e[61], o[61];
+      emailAt(buf, size, off[idx[j]], e);
+      for (int k = a; k < j && first[idx[j]] < 0; k++) {
+        if (first[idx[k]] >= 0)
+          continue;
+        emailAt(buf, size, off[idx[k]], o);
+        if (strcmp(e, o) == 0)
+          first[idx[j]] = idx[k];
+      }
+    }
+  }
+  free(idx);
+  return YB_OK;
+}
+
+static int compareIssue(const void *a, const void *b) {
+  const Issue *x = a, *y = b;
+  if (x->off != y->off)
+    return x->off < y->off ? -1 : 1;
+  return (int)x->kind - (int)y->kind;
+}
+
+/**
+ * FUNCTION: lineAt - line number of a byte offset
+ *
+ * - const long long *before: newlines before each block
+ */
+static long long lineAt(const char *buf, uint64_t off, const long long *before) {
+  uint64_t blk = off / VERIFY_BLOCK;
+  long long line = before[blk] + 1;
+  for (const char *p = buf + blk * VERIFY_BLOCK;
+       (p = memchr(p, '\n', buf + off - p)) != NULL; p++)
+    line++;
+  return line;
+}
+
+/**
+ * FUNCTION: ybMapFile - the whole data file in memory, read only
+ *
+ * EXPLAINATION:
+ * mmap where available, otherwise read into a buffer. *mapped tells
+ * ybUnmapFile() which one it was.
+ */
+const char *ybMapFile(const char *path, size_t *size, int *mapped) {
+  *mapped = 0;
+  *size = 0;
+#if !defined(_WIN32) && !defined(__MINGW32__)
+  struct stat st;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+  if (fstat(fileno(f), &st) == 0 && st.st_size > 0) {
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if (p != MAP_FAILED) {
+      fclose(f);
+      *size = st.st_size;
+      *mapped = 1;
+      return p;
+    }
+  }
+  fclose(f);
+#endif
+  FILE *g = fopen(path, "rb");
+  if (g == NULL)
+    return NULL;
+  fseek(g, 0, SEEK_END);
+  long len = ftell(g);
+  fseek(g, 0, SEEK_SET);
+  char *buf = malloc(len > 0 ? len : 1);
+  if (buf != NULL && len > 0 && fread(buf, 1, len, g) != (size_t)len) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(g);
+  *size = buf != NULL && len > 0 ? len : 0;
+  return buf;
+}
+
+void ybUnmapFile(const char *buf, size_t size, int mapped) {
+#if !defined(_WIN32) && !defined(__MINGW32__)
+  if (mapped) {
+    munmap((void *)buf, size);
+    return;
+  }
+#endif
+  free((void *)buf);
+}
+
+/**
+ * FUNCTION: ybVerify - check the data file and its block checksums
+ *
+ * - YbVerifyReport *r: receives the summary
+ * - YbProblem *out, int cap: receive the first `cap` problems in line order
+ *
+ * EXPLAINATION:
+ * the file is split into ranges of whole blocks, one per thread. each
+ * thread checks its blocks and lines and keeps (email hash, offset) of
+ * its valid rows. after joining, the id order is checked across ranges
+ * and the rows of every thread are checked together for duplicate
+ * emails. duplicate ids show up as order problems in a sorted file, in
+ * an unsorted one they are searched for like the emails.
+ * only csv data files can be verified, YB_ERR_INVALID otherwise.
+ */
+int ybVerify(YbDb *db, YbVerifyReport *r, YbProblem *out, int cap) {
+  CrcHeader h;
+  size_t size;
+  int mapped, err = YB_OK;
+  memset(r, 0, sizeof(*r));
+  r->sorted = 1;
+  if (db->bt != NULL || replReadOnly(db))
+    return YB_ERR_INVALID;
+  if (cap < 0)
+    cap = 0;
+  const char *buf = ybMapFile(db->path, &size, &mapped);
+  if (buf == NULL)
+    return YB_ERR_IO;
+  uint32_t *expect = loadChecksums(db, &h);
+  r->checksums = expect != NULL;
+  long long blocks = (size + VERIFY_BLOCK - 1) / VERIFY_BLOCK;
+  r->blocks = blocks;
+
+  int nt = ybThreadCount();
+  if (blocks < nt)
+    nt = blocks > 0 ? blocks : 1;
+  VerifyTask *tasks = calloc(nt, sizeof(VerifyTask));
+  int *newlines = calloc(blocks + 1, sizeof(int));
+  long long *before = malloc((blocks + 1) * sizeof(long long));
+  pthread_t th[MAX_THREADS];
+  if (tasks == NULL || newlines == NULL || before == NULL) {
+    free(tasks);
+    free(newlines);
+    free(before);
+    free(expect);
+    ybUnmapFile(buf, size, mapped);
+    return YB_ERR_NOMEM;
+  }
+  for (int t = 0; t < nt; t++) {
+    VerifyTask *vt = &tasks[t];
+    vt->buf = buf;
+    vt->size = size;
+    vt->from = (size_t)(blocks * t / nt) * VERIFY_BLOCK;
+    vt->to = (size_t)(blocks * (t + 1) / nt) * VERIFY_BLOCK;
+    if (vt->to > size)
+      vt->to = size;
+    vt->expect = expect;
+    vt->expectBlocks = expect != NULL ? h.blocks : 0;
+    vt->newlines = newlines;
+    vt->blockIssues.cap = vt->rowIssues.cap = cap;
+    vt->blockIssues.at = malloc((cap > 0 ? cap : 1) * sizeof(Issue));
+    vt->rowIssues.at = malloc((cap > 0 ? cap : 1) * sizeof(Issue));
+    if (vt->blockIssues.at == NULL || vt->rowIssues.at == NULL) {
+      vt->nomem = 1;
+      continue;
+    }
+    vt->threaded = nt > 1 && pthread_create(&th[t], NULL, verifyWorker, vt) == 0;
+    if (!vt->threaded) // a single range, or no thread available
+      verifyWorker(vt);
+  }
+  for (int t = 0; t < nt; t++)
+    if (tasks[t].threaded)
+      pthread_join(th[t], NULL);
+
+  for (long long b = 0, sum = 0; b <= blocks; b++) {
+    before[b] = sum;
+    sum += newlines[b];
+  }
+
+  /** every issue found, ordered by line, at most cap per source */
+  long long n = 0, all = 0;
+  for (int t = 0; t < nt; t++) {
+    n += tasks[t].n;
+    all += 2LL * cap + 1;
+    if (tasks[t].nomem)
+      err = YB_ERR_NOMEM;
+  }
+  Issue *issues = malloc((all + 2LL * cap + 2) * sizeof(Issue));
+  uint64_t *keys = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+  uint64_t *off = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+  int *first = malloc((n > 0 ? n : 1) * sizeof(int));
+  if (issues == NULL || keys == NULL || off == NULL || first == NULL ||
+      n > INT32_MAX)
+    err = YB_ERR_NOMEM;
+  long long ni = 0, rows = 0, dupIds = 0;
+  if (expect != NULL && h.fileSize > size && size % VERIFY_BLOCK == 0) {
+    /** cut at a block boundary, every block left may still match */
+    r->problems++;
+    if (err == YB_OK && cap > 0)
+      issues[ni++] = (Issue){YB_PROBLEM_CHECKSUM, size, 0};
+  }
+  uint64_t prev = UINT64_MAX, prevOff = 0;
+  for (int t = 0; t < nt && err == YB_OK; t++) {
+    VerifyTask *vt = &tasks[t];
+    for (long long j = 0; j < vt->blockIssues.count && j < cap; j++)
+      issues[ni++] = vt->blockIssues.at[j];
+    for (long long j = 0; j < vt->rowIssues.count && j < cap; j++)
+      issues[ni++] = vt->rowIssues.at[j];
+    r->problems += vt->blockIssues.count + vt->rowIssues.count;
+    dupIds += vt->dupIds;
+    if (vt->unsorted)
+      r->sorted = 0;
+    /** order across ranges: first id of this one against last of the previous */
+    if (vt->firstKey != UINT64_MAX) {
+      if (prev != UINT64_MAX && vt->firstKey <= prev) {
+        if (vt->firstKey == prev)
+          dupIds++;
+        else
+          r->sorted = 0;
+        if (cap > 0)
+          issues[ni++] = (Issue){vt->firstKey == prev ? YB_PROBLEM_DUP_ID
+                                                      : YB_PROBLEM_ORDER,
+                                 vt->firstOff, prevOff};
+        r->problems++;
+      }
+      prev = vt->lastKey;
+      prevOff = vt->lastOff;
+    }
+    memcpy(keys + rows, vt->hash, vt->n * sizeof(uint64_t));
+    memcpy(off + rows, vt->off, vt->n * sizeof(uint64_t));
+    rows += vt->n;
+  }
+  r->rows = rows;
+
+  /** duplicate emails, then duplicate ids when the order didn't catch them */
+  for (int pass = 0; pass < 2 && err == YB_OK; pass++) {
+    YbProblemKind kind = pass == 0 ? YB_PROBLEM_DUP_EMAIL : YB_PROBLEM_DUP_ID;
+    long long listed = 0;
+    if (pass == 1) {
+      if (r->sorted)
+        break;
+      for (long long j = 0; j < rows; j++)
+        keys[j] = idAt(buf, off[j]);
+      /** the search below finds the repeats next to each other again */
+      long long kept = 0;
+      for (long long j = 0; j < ni; j++)
+        if (issues[j].kind != YB_PROBLEM_DUP_ID)
+          issues[kept++] = issues[j];
+      ni = kept;
+      r->problems -= dupIds;
+    }
+    err = findDuplicates(keys, off, (int)rows, pass == 0, buf, size, first);
+    for (long long j = 0; err == YB_OK && j < rows; j++) {
+      if (first[j] < 0)
+        continue;
+      if (listed++ < cap)
+        issues[ni++] = (Issue){kind, off[j], off[first[j]]};
+      r->problems++;
+    }
+  }
+
+  /** line numbers of the first `cap` issues */
+  if (err == YB_OK) {
+    qsort(issues, ni, sizeof(Issue), compareIssue);
+    r->listed = ni < cap ? (int)ni : cap;
+    for (int j = 0; j < r->listed; j++) {
+      out[j].kind = issues[j].kind;
+      out[j].line = lineAt(buf, issues[j].off, before);
+      out[j].other = 0;
+      if (issues[j].kind == YB_PROBLEM_CHECKSUM) {
+        /** last line touching the block */
+        uint64_t end = issues[j].off + VERIFY_BLOCK < size
+                           ? issues[j].off + VERIFY_BLOCK - 1
+                           : (size > 0 ? size - 1 : 0);
+        out[j].other = issues[j].off < size ? lineAt(buf, end, before) : 0;
+      }
+      else if (issues[j].kind != YB_PROBLEM_PARSE &&
+               issues[j].kind != YB_PROBLEM_FIELD &&
+               issues[j].kind != YB_PROBLEM_COURSE) {
+        out[j].other = lineAt(buf, issues[j].other, before);
+      }
+    }
+  }
+
+  for (int t = 0; t < nt; t++) {
+    free(tasks[t].blockIssues.at);
+    free(tasks[t].rowIssues.at);
+    free(tasks[t].hash);
+    free(tasks[t].off);
+  }
+  free(tasks);
+  free(newlines);
+  free(before);
+  free(expect);
+  free(issues);
+  free(keys);
+  free(off);
+  free(first);
+  ybUnmapFile(buf, size, mapped);
+  return err;
+}
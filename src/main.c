@@ -1,8 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "yookbeer.h"
 
 #define DATA_PATH "data/data.csv"
+// directory of the photo store, opened on first use of the photo command
+#define PHOTO_DIR "data/photos"
+// default page cache size of the B+tree backend (4KB pages)
+#define DEFAULT_CACHE_PAGES 256
+// problems listed by the verify command, the check at startup shows fewer
+#define VERIFY_LIST 50
+#define VERIFY_LIST_ON_LOAD 3
 
 // define CLEAR_CMD at compile time depending on platform
 #if defined(_WIN32) || defined(__MINGW32__)
@@ -11,73 +21,74 @@
 #define CLEAR_CMD "clear"
 #endif
 
-typedef struct {
-  int reg;
-  int inter;
-  int hds;
-  int rc;
-} Count;
-
-typedef struct {
-  char id[12];
-  char name[55];
-  char nick[21];
-  int course;
-  char email[61];
-  char phone[11];
-} Student;
-
-typedef struct {
-  int id;
-  int name;
-  int email;
-} CheckDuplicateResponse;
+/**
+ * the opened data file. every command goes through libyookbeer,
+ * this file only does prompting and printing
+ */
+YbDb *db = NULL;
+YbPhotos *photos = NULL;
 
+/**
+ * capture mode (-t): every command and the input it read, one line per
+ * command, prefixed with the ms since the capture started. replay it
+ * with yookbeer-replay
+ */
+FILE *traceFile = NULL;
+struct timespec traceStart;
 
 /**
- * FUNTCION: countDataLine - count each line of data file
+ * FUNCTION: traceCommand - start the trace line of a new command
+ */
+void traceCommand(const char *cmd) {
+  struct timespec now;
+  if (traceFile == NULL)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  fprintf(traceFile, "\n%lld %s",
+          (long long)(now.tv_sec - traceStart.tv_sec) * 1000 +
+              (now.tv_nsec - traceStart.tv_nsec) / 1000000,
+          cmd);
+  fflush(traceFile);
+}
+
+/**
+ * FUNCTION: readToken - read one word of input
  *
- * - int *len: pointer to integer to store line count
+ * - char *buf, int cap: receives the word, at most cap - 1 characters
  *
- *  explanation: 
- *  getc() function get next character from the stream. so the while loop essentialy go through each character one by one, counting '\n'
+ * EXPLAINATION:
+ * every prompt reads through here (or readInt()) so capture mode sees
+ * each argument of a command. returns 0 at the end of input.
  */
-void countDataLine(int *len) {
-  *len = 0;
-  char c;
-  FILE *f = fopen(DATA_PATH, "r");
-
-  /** if pointer to file is null, return -1 which signifies that the data file can't be open */
-  if (f == NULL) {
-    printf("[ERR] Could not open file %s\n", DATA_PATH);
-    *len = -1;
-    return;
+int readToken(char *buf, int cap) {
+  char fmt[16];
+  sprintf(fmt, " %%%ds", cap - 1);
+  if (scanf(fmt, buf) != 1) {
+    buf[0] = '\0';
+    return 0;
   }
-
-  /** loop through each characters in data file to count newline character */
-  while ((c = getc(f)) != EOF) {
-    if (c == '\n')
-      (*len)++;
+  if (traceFile != NULL) {
+    fprintf(traceFile, " %s", buf);
+    fflush(traceFile);
   }
-  fclose(f);
+  return 1;
 }
 
 /**
- * FUNTCION: getCourseName - convert course value in data file from int to its name
- *
- * - char name[]: pointer to character array to store course name value
- * - int course: course value
+ * FUNCTION: readInt - read one word of input as a number
  *
+ * EXPLAINATION:
+ * returns 1 only if the whole word is a number
  */
-void getCourseName(char name[], int course) {
-  if (course == 0)
-    strcpy(name, "REG");
-  else if (course == 1)
-    strcpy(name, "INTER");
-  else if (course == 2)
-    strcpy(name, "HDS");
-  else if (course == 3)
-    strcpy(name, "RC");
+int readInt(int *v) {
+  char buf[32], *end;
+  if (!readToken(buf, sizeof(buf)))
+    return 0;
+  long x = strtol(buf, &end, 10);
+  if (end == buf || *end != '\0')
+    return 0;
+  *v = (int)x;
+  return 1;
 }
 
 /**
@@ -104,388 +115,157 @@ void printResHeader() {
  *  num: amount of characters for that slot
  */
 void printSearchResultLine(Student cur) {
-  char courseName[6];
-  getCourseName(courseName, cur.course);
   printf("%-15s %-32s %-15s %-10s %-34s %-15s\n", cur.id, cur.name, cur.nick,
-         courseName, cur.email, cur.phone);
+         ybCourseName(cur.course), cur.email, cur.phone);
 }
 
 /**
- * FUNCTION: removeTrailingNewLine - remove '\n' from data line
- * 
- *  - char line[]: pointer to data line string
+ * FUNCTION: printErr - print error returned by libyookbeer
+ *
+ * - int err: YbStatus
  */
-void removeTrailingNewline(char line[]) {
-  if (line[strlen(line) - 1] == '\n')
-    line[strlen(line) - 1] = '\0';
+void printErr(int err) {
+  printf("[ERR] %s: %s\n", ybPath(db), ybStrError(err));
 }
 
 /**
- * FUNTCION: removeElementFromArray - as the name suggested, remove specific element from array
- * 
- * - Student *arr: array of Students
- * - int *len: pointer to data line count value
- * - int idx: index of element to be removed
- * 
- * EXPLAINATION:
- * this function remove element from a Student array at the index provided. it work by
- * shifting the next element from idx+1 to len-1 by -1
+ * FUNTCION: printMatch - ybSearchEach() callback printing one match
+ *
+ * - void *ctx: int counting the matches printed so far
  */
-void removeElementFromArray(Student *arr, int *len, int idx) {
-  if (idx >= 0 && idx < *len) {
-    for (int i = idx; i < (*len) - 1; i++)
-      arr[i] = arr[i + 1];
-    (*len)--;
-  }
+void printMatch(const Student *s, void *ctx) {
+  int *m = ctx;
+  if ((*m)++ == 0)
+    printResHeader();
+  printSearchResultLine(*s);
 }
 
 /**
- * FUNTCION: insertionSort - also as the name suggested, insertion sort algorithm
- * 
- * - Student *arr: array of Students
- * - int n: array length
- * 
- * EXPLAINATION:
- * insertion sort works by repeatedly taking an unsorted element 
- * and inserting it into its correct position among the previously sorted elements, 
- * shifting other elements as needed. 
- */
-void insertionSort(Student *arr, int n) {
-  for (int j = 1; j < n; j++) {
-    Student temp = arr[j];
-    int i = j - 1;
-    while (i >= 0 && strcmp(arr[i].id, temp.id) > 0) {
-      arr[i + 1] = arr[i];
-      i--;
-    }
-    arr[i + 1] = temp;
-  }
-}
-
-/**
- * FUNTCION: sortDataFile - open data file and sort it
- * 
- * - int len: data line count value
- * 
+ * FUNTCION: printSearch - print every student matching a query
+ *
+ * - YbQuery *q: prepared query
+ *
  * EXPLAINATION:
- * reading data file into variable, sort it using insertionSort() order by id, 
- * then write it back to data file
+ * the search goes through ybSearchEach() so it uses whatever the
+ * backend has for it (B+tree point lookup, resident id index or
+ * search keys), then the total match count is printed
  */
-int sortDataFile(int len) {
-  /**
-   * declare line to store each line from data file, also declare i to 
-   * use as an iterator
-   */
-  char line[256];
-  int i = 0;
-
-  /**
-   * allocate memory for an array of Students and declare file pointer.
-   * if the file doesn't exist, return out of this function
-   */
-  Student *d = calloc(len, sizeof(Student));
-  FILE *f = fopen(DATA_PATH, "r");
-  if (f == NULL) {
-    printf("[ERR] Cannot read %s while sorting.\n", DATA_PATH);
-    return 1;
-  }
-
-  /**
-   * read data file into student array *d
-   */
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", d[i].id, d[i].name,
-               d[i].nick, &d[i].course, d[i].email, d[i].phone) == 6) {
-      i++;
-    }
+void printSearch(YbQuery *q) {
+  int m = 0, total;
+  printf("Results: \n");
+  int err = ybSearchEach(db, q, printMatch, &m, &total);
+  if (err != YB_OK) {
+    printErr(err);
+    return;
   }
-  fclose(f);
-
-  /** 
-   * sort the array with insertion sort then write the sorted data
-   * back to the data file 
-   */
-  insertionSort(d, i);
-  char *buffer = malloc(170 * i);
-  f = fopen(DATA_PATH, "w");
-  for (int j = 0; j < len; j++) {
-    fprintf(f, "%s,%s,%s,%d,%s,%s\n", d[j].id, d[j].name, d[j].nick,
-            d[j].course, d[j].email, d[j].phone);
-  }
-  fclose(f);
-  free(d);
-  return 0;
+  printf("Total match: %d\n", total);
+  printf("========================================\n");
 }
 
 /**
- * FUNTCION: searchById() 
+ * FUNTCION: searchById()
  * COMMAND: search student by id
- * 
+ *
  * EXPLAINATION:
- * prompt user for id to query, then do a linear search 
- * through the data file, then print search result 
+ * prompt user for id (full 11 digits or last 4 digits) to query,
+ * then print search result
  */
 void searchById() {
-  /**
-   * declare inp as input buffer variable and m as a
-   * match counter, then prompt user for id (or partial id) 
-   * to query 
-   */
   char inp[20];
-  int m = 0;
+  YbQuery q;
   system(CLEAR_CMD);
   printf("==============Search by ID==============\n");
   printf("ID: ");
-  scanf("%s", inp);
-
-  /**
-   * determine if user's input is a full id or partial id
-   * 
-   * full id: 11 digits
-   * partial id: 4 digits
-   * 
-   * if user's input doesn't match either of the above, 
-   * print "Invalid ID" and return to main menu
-   */
-  int inplen = strlen(inp);
-  if (inplen != 11 && inplen != 4) {
+  readToken(inp, 20);
+  if (ybQueryInit(&q, YB_BY_ID, inp) != YB_OK) {
     printf("Invalid ID!\n");
-  } 
-  else {
-    /**
-     * open data file and declare a buffer variable for
-     * 1 line of data, declare a student object to store
-     * student's data from the current line being read
-     */
-    FILE *f = fopen(DATA_PATH, "r");
-    char line[256];
-    Student cur = {0};
-    printf("Results: \n");
-
-    /**
-     * read through the file line by line, parse the data
-     * into `cur` object. if cur.id match user input, print
-     * the result
-     */
-    while (fgets(line, sizeof(line), f)) {
-      removeTrailingNewline(line);
-      if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", cur.id, cur.name,
-                 cur.nick, &cur.course, cur.email, cur.phone) == 6) {
-        /**
-         * for partial id: substring cur.id to last 4 digits in subId
-         */
-        if (inplen == 4) {
-          char subId[5] = {cur.id[7], cur.id[8], cur.id[9], cur.id[10]};
-          if (strcmp(subId, inp) == 0) {
-            if (m == 0)
-              printResHeader();
-            printSearchResultLine(cur);
-            m++;
-          }
-        } 
-        else {
-          if (strcmp(cur.id, inp) == 0) {
-            if (m == 0)
-              printResHeader();
-            printSearchResultLine(cur);
-            m++;
-          }
-        }
-      }
-    }
-    fclose(f);
-    printf("Total match: %d\n", m);
-    printf("========================================\n");
+    return;
   }
+  printSearch(&q);
 }
 
 /**
- * FUNTCION: searchByFirstName() 
+ * FUNTCION: searchByFirstName()
  * COMMAND: search student by firstname
- * 
+ *
  * EXPLAINATION:
- * prompt user for firstname (or partial firstname) to query, 
- * then do a linear search through the data file, then print search result 
+ * prompt user for firstname (or partial firstname) to query,
+ * then print search result. since we allow partial name search,
+ * multiple matches are possible.
  */
 void searchByFirstName() {
-  /**
-   * declare inp as input buffer variable and m as a
-   * match counter, then prompt user for first (or partial firstname) 
-   * to query 
-   */
-  char inp[20];
-  int m = 0, inplen = 0;
+  char inp[64];
+  YbQuery q;
   system(CLEAR_CMD);
   printf("===========Search by Firstname==========\n");
   printf("Name: ");
-  scanf("%s", inp);
-
-  /**
-   * get user's query length and shift any lowercase
-   * character to uppercase
-   */
-  inplen = strlen(inp);
-  for (int j = 0; j < inplen; j++) {
-    if (inp[j] >= 'a' && inp[j] <= 'z')
-      inp[j] -= 32;
+  readToken(inp, 64);
+  if (ybQueryInit(&q, YB_BY_FIRSTNAME, inp) != YB_OK) {
+    printf("Invalid name!\n");
+    return;
   }
+  printSearch(&q);
+}
 
-  /**
-    * open data file and declare a buffer variable for
-    * 1 line of data, declare a student object to store
-    * student's data from the current line being read
-    */
-  FILE *f = fopen(DATA_PATH, "r");
-  char line[256], fnm[16];
-  Student cur = {0};
-  printf("Results: \n");
-
-  /**
-    * read through the file line by line, parse the data
-    * into `cur` object. then substring cur.name into the
-    * same length as user's query to allow partial name search
-    * (subStr). if user's query match subStr, print that student
-    * to result. since we allow partial name search, multiple 
-    * matches are possible.
-    */
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", cur.id, cur.name,
-               cur.nick, &cur.course, cur.email, cur.phone) == 6) {
-      if (sscanf(cur.name, "%s %*s", fnm) == 1) {
-        char *subStr = calloc(inplen, sizeof(char)); // use calloc to allocate a string with inplen size
-        for (int j = 0; j < inplen; j++) {
-          subStr[j] = fnm[j];
-        }
-        subStr[inplen] = '\0';
-        if (strcmp(subStr, inp) == 0) {
-          if (m == 0)
-            printResHeader();
-          printSearchResultLine(cur);
-          m++;
-        }
-      }
-    }
+/**
+ * FUNTCION: searchBySurname()
+ * COMMAND: search student by surname
+ *
+ * EXPLAINATION:
+ * prompt user for surname (or partial surname) to query,
+ * then print search result
+ */
+void searchBySurname() {
+  char inp[64];
+  YbQuery q;
+  system(CLEAR_CMD);
+  printf("===========Search by Surname============\n");
+  printf("Surname: ");
+  readToken(inp, 64);
+  if (ybQueryInit(&q, YB_BY_SURNAME, inp) != YB_OK) {
+    printf("Invalid surname!\n");
+    return;
   }
-  fclose(f);
-  printf("Total match: %d\n", m);
-  printf("========================================\n");
+  printSearch(&q);
 }
 
 /**
  * FUNCTION: searchByNickName
  * COMMAND: search for student(s) by nickname
- * 
+ *
  * EXPLAINATION:
- * prompt user for nickname (or partial nickname) to query, 
- * then do a linear search through the data file, then print search result 
+ * prompt user for nickname (or partial nickname) to query,
+ * then print search result
  */
 void searchByNickName() {
-  /**
-   * declare inp as input buffer variable, line as a buffer for 
-   * data file reading, and m as a match counter, then prompt user 
-   * for nickname (or partial nickname) to query 
-   */
-  char inp[20], line[256];
-  int m = 0, inplen;
+  char inp[64];
+  YbQuery q;
   system(CLEAR_CMD);
   printf("=============Search by Nick=============\n");
   printf("Nickname: ");
-  scanf("%s", inp);
-
-  /**
-   * get user's query length and shift any lowercase
-   * character to uppercase
-   */
-  inplen = strlen(inp);
-  for (int j = 0; j < inplen; j++) {
-    if (inp[j] >= 'a' && inp[j] <= 'z')
-      inp[j] -= 32;
-  }
-
-  /**
-    * open data file and declare a buffer variable for
-    * 1 line of data, declare a student object to store
-    * student's data from the current line being read
-    */
-  FILE *f = fopen(DATA_PATH, "r");
-  Student cur = {0};
-  printf("Results: \n");
-
-  /**
-    * read through the file line by line, parse the data
-    * into `cur` object. then substring cur.nickname into the
-    * same length as user's query to allow partial name search
-    * (subStr). if user's query match subStr, print that student
-    * to result. since we allow partial name search, multiple 
-    * matches are possible.
-    */
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", cur.id, cur.name,
-               cur.nick, &cur.course, cur.email, cur.phone) == 6) {
-      char *subStr = calloc(inplen, sizeof(char)); // use calloc to allocate a string with inplen size
-      for (int j = 0; j < inplen; j++) {
-        subStr[j] = cur.nick[j];
-      }
-      subStr[inplen] = '\0';
-      if (strcmp(subStr, inp) == 0) {
-        if (m == 0)
-          printResHeader();
-        printSearchResultLine(cur);
-        m++;
-      }
-    }
+  readToken(inp, 64);
+  if (ybQueryInit(&q, YB_BY_NICK, inp) != YB_OK) {
+    printf("Invalid nickname!\n");
+    return;
   }
-  fclose(f);
-  printf("Total match: %d\n", m);
-  printf("========================================\n");
+  printSearch(&q);
 }
 
 /**
  * FUNCTION: allStdCount
  * COMMAND: print student count
- * 
+ *
  * EXPLAINATION:
  * count all students in data file then print it.
  * show all sum value and student count in each course
  */
 void allStdCount() {
-  /**
-   * open data file and declare a Count object to store
-   * data. declare cur as an iterator and line as a buffer
-   * for reading each line of data file
-   */
-  FILE *f = fopen(DATA_PATH, "r");
-  Count c = {0};
-  int cur = 0;
-  char line[256];
-
-  /**
-   * read through each line of data file and count each courses'
-   * student using `COURSE` column in the data file
-   * 
-   * 0: Regular program
-   * 1: International program
-   * 2: Health Data Science program
-   * 3: Residential College program
-   * 
-   * then print the result down below
-   */
-  while (fgets(line, sizeof(line), f)) {
-    if (sscanf(line, "%*[^,],%*[^,],%*[^,],%d", &cur) == 1) {
-      if (cur == 0)
-        c.reg++;
-      else if (cur == 1)
-        c.inter++;
-      else if (cur == 2)
-        c.hds++;
-      else if (cur == 3)
-        c.rc++;
-    }
-  }
-  fclose(f);
+  Count c;
+  int err = ybCount(db, &c);
+  if (err != YB_OK) {
+    printErr(err);
+    return;
+  }
   system(CLEAR_CMD);
   printf("=================Count==================\n");
   printf("All: %d\n", c.reg + c.inter + c.hds + c.rc);
@@ -495,78 +275,73 @@ void allStdCount() {
 }
 
 /**
- * FUNCTION: checkduplicate - for addStd()
- * 
- * - Student x: student data to check
- * - int len: data file length
- * 
+ * FUNCTION: groupByCmd
+ * COMMAND: count students grouped by a derived key
+ *
  * EXPLAINATION:
- * check if student (or some of their data) already existed
- * in the data file.
- * 
- * checkDuplicate() is used in the addStd() function to check,
- * if the student user currently adding already existed in
- * the data file. checkDuplicate() focuses on 3 values: id, email, name.
- * it counts for the occurence of these 3 values in the data 
- * file and return it back to addStd() where it determines if 
- * the duplication is acceptable.
+ * prompt user for the group key then print count of every group
+ * and the amount of distinct groups.
+ *
+ * group keys:
+ * 1: course x cohort (first 2 digits of id)
+ * 2: email domain
+ * 3: nickname initial
+ * 4: duplicate full names (only groups with more than 1 student)
  */
-CheckDuplicateResponse checkDuplicate(Student x, int len) {
-  /**
-   * declaure CheckDuplicateResponse object to store results,
-   * line to store each line from data file, and cur to store
-   * data of student from current line being read. then we
-   * search through the file for duplicate and if found,
-   * increment value in result object by 1
-   */
-  CheckDuplicateResponse r = {0};
-  char line[256];
-  FILE *f = fopen(DATA_PATH, "r");
-  Student cur = {0};
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", cur.id, cur.name,
-               cur.nick, &cur.course, cur.email, cur.phone) == 6) {
-      if (strcmp(cur.id, x.id) == 0) {
-        r.id++;
-      }
-
-      if (strcmp(cur.name, x.name) == 0) {
-        r.name++;
-      }
+int groupByCmd() {
+  char inp[20];
+  YbGroup *g;
+  int groups, rows;
+  system(CLEAR_CMD);
+  printf("================Group by================\n");
+  printf("[ 1 ] course x cohort\n");
+  printf("[ 2 ] email domain\n");
+  printf("[ 3 ] nickname initial\n");
+  printf("[ 4 ] duplicate names\n");
+  printf("Group by (x to cancel): ");
+  readToken(inp, 20);
+  int mode = inp[0] - '0';
+  if (mode < 1 || mode > 4 || inp[1] != '\0') {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
 
-      if (strcmp(cur.email, x.email) == 0) {
-        r.email++;
-      }
-    }
+  int err = ybGroupBy(db, (YbGroupKey)mode, &g, &groups, &rows);
+  if (err != YB_OK) {
+    printErr(err);
+    return 1;
   }
-  fclose(f);
-  return r;
+  printf("%-34s %-10s\n", "GROUP", "COUNT");
+  for (int j = 0; j < groups && j < 100; j++)
+    printf("%-34s %-10d\n", g[j].key, g[j].count);
+  if (groups > 100)
+    printf("... and %d more\n", groups - 100);
+  printf("Rows: %d \t Distinct groups: %d\n", rows, groups);
+  printf("========================================\n");
+  ybFreeGroups(g);
+  return 0;
 }
 
 /**
  * FUNCTION: addStd
  * COMMAND: add student to data file
- * 
- * - int *len: pointer to data file line count
- * 
+ *
  * EXPLAINATION:
- * add one student to the data file. will prompt user for 
+ * add one student to the data file. will prompt user for
  * each data required and check for data validity
  */
-int addStd(int *len) {
-  Student *x = malloc(sizeof(Student));
-  char buffer[255];
+int addStd() {
+  Student *x = calloc(1, sizeof(Student));
+  char buffer[255], fnm[21], lnm[31];
   int fd = 0, d = 0;
   system(CLEAR_CMD);
   printf("===============Add Student==============\n");
 
   // getting input for student id
   printf("Student's id (11 digits): ");
-  scanf("%s", buffer);
-  if (buffer[11] == '\n')
-    buffer[11] == '\0';
-  if (strlen(buffer) != 11) {
+  readToken(buffer, 255);
+  if (!ybValidId(buffer)) {
     printf("Invalid id! returning to main menu.\n");
     free(x);
     return 1;
@@ -576,75 +351,45 @@ int addStd(int *len) {
 
   // getting input for student firstname
   printf("Student's firstname: ");
-  scanf("%s", buffer);
-  if (strlen(buffer) > 20) {
-    buffer[20] = '\0';
-  }
-  char *fnm = calloc(21, sizeof(char));
+  readToken(buffer, 255);
+  ybTruncate(buffer, 20);
   strcpy(fnm, buffer);
   // endsection
 
   // getting input for student lastname
   printf("Student's lastname: ");
-  scanf("%s", buffer);
-  if (strlen(buffer) > 30) {
-    buffer[30] = '\0';
-  }
-  char *lnm = calloc(31, sizeof(char));
+  readToken(buffer, 255);
+  ybTruncate(buffer, 30);
   strcpy(lnm, buffer);
   // endsection
 
-  // shift lowercase to uppercase
-  for (int j = 0; j < strlen(fnm); j++) {
-    if (fnm[j] >= 'a' && fnm[j] <= 'z')
-      fnm[j] -= 32;
-  }
-  for (int j = 0; j < strlen(lnm); j++) {
-    if (lnm[j] >= 'a' && lnm[j] <= 'z')
-      lnm[j] -= 32;
-  }
-  // endsection
-
-  // concat firstname and lastname and copy to object, then free fnm and lnm
+  // shift lowercase to uppercase (utf-8 aware), concat firstname and lastname and copy to object
+  ybToUpper(fnm);
+  ybToUpper(lnm);
   sprintf(x->name, "%s %s", fnm, lnm);
-  free(fnm);
-  free(lnm);
   // endsection
 
   // getting input for student nickname
   printf("Student's nickname: ");
-  scanf("%s", buffer);
-  if (strlen(buffer) > 10) {
-    buffer[10] = '\0';
-  }
-  for (int j = 0; j < strlen(buffer); j++) {
-    if (buffer[j] >= 'a' && buffer[j] <= 'z')
-      buffer[j] -= 32;
-  }
+  readToken(buffer, 255);
+  ybTruncate(buffer, 10);
+  ybToUpper(buffer);
   strcpy(x->nick, buffer);
   // endsection
 
   // getting input for student course
   printf("Student's course (0 for REG, 1 for INTER, 2 for HDS, 3 for RC): ");
-  scanf("%d", &x->course);
-  if (x->course < 0 || x->course > 3) {
+  if (readInt(&x->course) != 1 || x->course < 0 || x->course > 3) {
     printf("Invalid course! returning to main menu.\n");
     free(x);
     return 1;
   }
   // endsection
 
-  // getting input for student course
+  // getting input for student email
   printf("Student's email: ");
-  scanf("%s", buffer);
-  int at = 0;
-  for (int i = 0; i < strlen(buffer); i++) {
-    if (buffer[i] == '@')
-      at++;
-  }
-  if (buffer[strlen(buffer) - 1] == '\n')
-    buffer[strlen(buffer) - 1] = '\0';
-  if (at != 1 || strlen(buffer) > 60) {
+  readToken(buffer, 255);
+  if (!ybValidEmail(buffer)) {
     printf("Invalid email! returning to main menu.\n");
     free(x);
     return 1;
@@ -654,10 +399,8 @@ int addStd(int *len) {
 
   // getting input for student phone number
   printf("Student's Thai phone number: ");
-  scanf("%s", buffer);
-  if (buffer[strlen(buffer) - 1] == '\n')
-    buffer[strlen(buffer) - 1] = '\0';
-  if (strlen(buffer) != 10) {
+  readToken(buffer, 255);
+  if (!ybValidPhone(buffer)) {
     printf("Invalid phone number! returning to main menu.\n");
     free(x);
     return 1;
@@ -668,18 +411,24 @@ int addStd(int *len) {
   // data duplication checking
   // fd means fatal duplication: will not allow user to proceed
   // d means duplication: will prompt user for confirmation before proceeding
-  CheckDuplicateResponse dr = checkDuplicate(*x, *len);
-  if (dr.id == 1) {
+  CheckDuplicateResponse dr;
+  int err = ybCheckDuplicate(db, x, &dr);
+  if (err != YB_OK) {
+    printErr(err);
+    free(x);
+    return 1;
+  }
+  if (dr.id > 0) {
     fd = 1;
     printf("[ERR] %s already exist in the database. Cancelling...\n", x->id);
   }
 
-  if (dr.name == 1) {
+  if (dr.name > 0) {
     d = 1;
     printf("[WARN] %s already exist in the database\n", x->name);
   }
 
-  if (dr.email == 1) {
+  if (dr.email > 0) {
     fd = 1;
     printf("[ERR] %s already exist in the database. Cancelling...\n", x->email);
   }
@@ -691,7 +440,7 @@ int addStd(int *len) {
 
   if (d > 0) {
     printf("Do you really want to proceed? (y/N): ");
-    scanf("%s", buffer);
+    readToken(buffer, 255);
   }
 
   if ((d > 0) && (buffer[0] != 'y' && buffer[0] != 'Y')) {
@@ -706,36 +455,21 @@ int addStd(int *len) {
   printResHeader();
   printSearchResultLine(*x);
   printf("Do you want to proceed? (y/N): ");
-  scanf("%s", buffer);
-  if (buffer[0] == 'y' || buffer[0] == 'Y') {
-    FILE *f = fopen(DATA_PATH, "a");
-    if (f == NULL) {
-      printf(
-          "[ERR] Cannot open %s . Cancelling and returning to main menu...\n",
-          DATA_PATH);
-      free(x);
-      return 1;
-    }
-    fprintf(f, "%s,%s,%s,%d,%s,%s\n", x->id, x->name, x->nick, x->course,
-            x->email, x->phone);
-    fclose(f);
-    printf("%s has been added to the data file.\n", x->name);
-    printf("%s written succesfully!\n", DATA_PATH);
-    (*len)++;
-    printf("Sorting data. Please wait!\n");
-    int ss = sortDataFile(*len);
-    if (ss == 1) {
-      printf("Data sorting failed!\n");
-      free(x);
-      return 2;
-    } else {
-      printf("Data sorted successfully, returning to main menu...\n");
-    }
-  } else {
+  readToken(buffer, 255);
+  if (buffer[0] != 'y' && buffer[0] != 'Y') {
     printf("Action cancelled. sending you back to main menu...\n");
     free(x);
     return 2;
   }
+  err = ybAdd(db, x);
+  if (err != YB_OK) {
+    printErr(err);
+    printf("Cancelling and returning to main menu...\n");
+    free(x);
+    return 1;
+  }
+  printf("%s has been added to the data file.\n", x->name);
+  printf("%s written succesfully!\n", ybPath(db));
   // endsection
 
   free(x);
@@ -746,27 +480,27 @@ int addStd(int *len) {
 /**
  * FUNCTION: remStd
  * COMMAND: remove student from data file
- * 
- * - int *len: pointer to data file line count
- * 
+ *
  * EXPLAINATION:
  * remove one student from data file. will prompt user for
  * student id (or shorthand id) of the student to be removed
  */
-int remStd(int *len) {
+int remStd() {
   /**
    * declare input buffer and prompt user for
    * id (or partial id) to remove
    */
   char inp[20];
+  YbQuery q;
+  Student cur;
+  int m;
   system(CLEAR_CMD);
   printf("==============Remove Student============\n");
   printf("ID (x to cancel): ");
-  scanf("%s", inp);
-  int inplen = strlen(inp), idx = -1;
+  readToken(inp, 20);
 
   // check for exit command in user input;
-  if ((inp[0] == 'x' || inp[0] == 'X') && inplen == 1) {
+  if ((inp[0] == 'x' || inp[0] == 'X') && inp[1] == '\0') {
     printf("Action cancelled. sending you back to main menu...\n");
     printf("========================================\n");
     return 2;
@@ -777,143 +511,724 @@ int remStd(int *len) {
    * length, print "Invalid ID" and return to
    * main meny
    */
-  if (inplen != 11 && inplen != 4) {
+  if (ybQueryInit(&q, YB_BY_ID, inp) != YB_OK) {
     printf("Invalid ID!\n");
     printf("========================================\n");
     return 1;
   }
 
   /**
-   * open data file and read the entire file into
-   * Student object array.
+   * look up the student first so a shorthand id can be turned
+   * into the full id and the name can be shown for confirmation
    */
-  FILE *f = fopen(DATA_PATH, "r");
-  char line[256];
-  int i = 0, fnd = 0;
-  Student *d = calloc(*len, sizeof(Student));
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", d[i].id, d[i].name,
-               d[i].nick, &d[i].course, d[i].email, d[i].phone) == 6) {
-      i++;
-    }
+  int err = ybSearch(db, &q, &cur, 1, &m);
+  if (err != YB_OK || m < 1) {
+    if (err != YB_OK)
+      printErr(err);
+    else
+      printf("ID %s not found! returning to main menu...\n", inp);
+    printf("========================================\n");
+    return 1;
   }
-  fclose(f);
 
   /**
-   * search for specified student (if student is found, set `fnd` = 1)
+   * prompt user for confirmation, if user cancelled the
+   * action, return to main menu
    */
-  for (int j = 0; j < i; j++) {
-    /**
-     * for partial id: substring id to last 4 digits before comparing
-     */
-    if (inplen == 4) {
-      char subId[5] = {d[j].id[7], d[j].id[8], d[j].id[9], d[j].id[10], '\0'};
-      if (strcmp(subId, inp) == 0) {
-        idx = j;
-        fnd = 1;
-        break;
-      }
-    } 
-    else {
-      if (strcmp(d[j].id, inp) == 0) {
-        idx = j;
-        fnd = 1;
-        break;
+  printf("Do you want to proceed with the deletion of %s? (y/N): ", cur.name);
+  readToken(inp, 20);
+  if (inp[0] != 'y' && inp[0] != 'Y') {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
+  err = ybRemove(db, cur.id, NULL);
+  if (err != YB_OK) {
+    printErr(err);
+    printf("========================================\n");
+    return 1;
+  }
+  printf("%s has been successfully removed.\n", cur.name);
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: batchRemStd
+ * COMMAND: remove many students from data file at once
+ *
+ * EXPLAINATION:
+ * remove every student matching either an id list file or a rule
+ * (id prefix and/or course). first do a dry-run to show how many
+ * students will be removed, then after confirmation remove them all
+ * with a single write of the data file.
+ */
+int batchRemStd() {
+  YbFilter bf = {NULL, 0, "", -1};
+  char inp[256];
+  int m = 0, skipped, err;
+  system(CLEAR_CMD);
+  printf("===========Batch Remove Students========\n");
+  printf("[ 1 ] remove by id list file\n");
+  printf("[ 2 ] remove by rule (id prefix / course)\n");
+  printf("Mode (x to cancel): ");
+  readToken(inp, 256);
+
+  if (inp[0] == '1') {
+    printf("Path to id file: ");
+    readToken(inp, 256);
+    if (ybFilterLoadIds(&bf, inp, &skipped) != YB_OK) {
+      printf("[ERR] Could not open file %s\n", inp);
+      printf("========================================\n");
+      return 1;
+    }
+    if (skipped > 0)
+      printf("[WARN] %d invalid line(s) in %s were skipped\n", skipped, inp);
+  }
+  else if (inp[0] == '2') {
+    printf("ID prefix (e.g. 640705, - for any): ");
+    readToken(inp, 256);
+    if (inp[0] != '-') {
+      if (strlen(inp) > 11 || strspn(inp, "0123456789") != strlen(inp)) {
+        printf("Invalid ID prefix!\n");
+        printf("========================================\n");
+        return 1;
       }
+      strcpy(bf.prefix, inp);
+    }
+    printf("Course (0 for REG, 1 for INTER, 2 for HDS, 3 for RC, -1 for any): ");
+    if (readInt(&bf.course) != 1 || bf.course < -1 || bf.course > 3) {
+      printf("Invalid course!\n");
+      printf("========================================\n");
+      return 1;
+    }
+    /** refuse a rule that would match (and delete) every student */
+    if (bf.prefix[0] == '\0' && bf.course < 0) {
+      printf("Rule matches every student! returning to main menu...\n");
+      printf("========================================\n");
+      return 1;
     }
   }
+  else {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
 
   /**
-   * if no student is found, return to main menu
+   * dry-run: preview the first few matches and count all of them
    */
-  if (fnd < 1) {
-    printf("ID %s not found! returning to main menu...\n", inp);
+  YbIter *it;
+  Student cur;
+  err = ybIterOpen(db, &it);
+  if (err != YB_OK) {
+    printErr(err);
+    ybFilterFree(&bf);
+    return 1;
+  }
+  while (ybIterNext(it, &cur)) {
+    if (ybFilterMatch(&bf, &cur)) {
+      if (m == 0)
+        printResHeader();
+      if (m < 10)
+        printSearchResultLine(cur);
+      m++;
+    }
+  }
+  ybIterClose(it);
+  if (m > 10)
+    printf("... and %d more\n", m - 10);
+
+  if (m == 0) {
+    printf("No student matched! returning to main menu...\n");
     printf("========================================\n");
-    free(d);
+    ybFilterFree(&bf);
     return 1;
   }
 
-  /**
-   * copy student's name to new variable to use in print 
-   * function after student's data got removed
-   */
-  char *name = calloc(strlen(d[idx].name), sizeof(char));
-  strcpy(name, d[idx].name);
+  printf("Do you want to proceed with the deletion of %d student(s)? (y/N): ", m);
+  readToken(inp, 256);
+  if (inp[0] != 'y' && inp[0] != 'Y') {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    ybFilterFree(&bf);
+    return 2;
+  }
 
-  /**
-   * prompt user for confirmation, if user cancelled the
-   * action, return to main menu
-   */
-  printf("Do you want to proceed with the deletion of %s? (y/N): ", name);
-  scanf("%s", inp);
-  if (inp[0] == 'y' || inp[0] == 'Y') {
+  err = ybRemoveWhere(db, &bf, &m);
+  ybFilterFree(&bf);
+  if (err != YB_OK) {
+    printErr(err);
+    printf("========================================\n");
+    return 1;
+  }
+  printf("%d student(s) have been successfully removed.\n", m);
+  printf("========================================\n");
+  return 0;
+}
 
-    /**
-     * open data file in write mode. if data file cant be opened,
-     * print error and return to main menu.
-     */
-    f = fopen(DATA_PATH, "w");
-    if (f == NULL) {
-      printf(
-          "[ERR] Cannot open %s . Cancelling and returning to main menu...\n",
-          DATA_PATH);
+/**
+ * FUNCTION: diffCmd
+ * COMMAND: compare the data with a new roster and apply the differences
+ *
+ * EXPLAINATION:
+ * write a diff file between the data and another roster (sorting the
+ * roster first if needed), show how many students were added, removed
+ * and changed, then after confirmation apply it in one batched update.
+ * an existing diff file can also be applied directly.
+ */
+int diffCmd() {
+  char inp[256], path[256], diffPath[256], yn[20];
+  int err;
+  YbDiffStats ds;
+  system(CLEAR_CMD);
+  printf("==============Roster Diff===============\n");
+  printf("[ 1 ] compare with another roster\n");
+  printf("[ 2 ] apply an existing diff file\n");
+  printf("Option (x to cancel): ");
+  readToken(inp, 256);
+
+  if (inp[0] == '1') {
+    printf("Path to roster csv file: ");
+    readToken(path, 256);
+    printf("Path to write the diff file to: ");
+    readToken(diffPath, 256);
+
+    /** the merge needs the roster sorted by id, same as the data file */
+    YbDb *other;
+    err = ybOpen(path, &other);
+    if (err != YB_OK) {
+      printf("[ERR] %s: %s\n", path, ybStrError(err));
       printf("========================================\n");
-      free(d);
-      free(name);
       return 1;
     }
-    /**
-     * remove specified student from data array then
-     * write it back to data file, overwriting old data
-     */
-    removeElementFromArray(d, len, idx);
-    for (int k = 0; k < *len; k++) {
-      fprintf(f, "%s,%s,%s,%d,%s,%s\n", d[k].id, d[k].name, d[k].nick,
-              d[k].course, d[k].email, d[k].phone);
-    }
-    fclose(f);
-    free(d);
-    printf("%s has been successfully removed.\n", name);
+    if (!ybIsSorted(other)) {
+      printf("%s is not sorted by id. Sort it now? (y/N): ", path);
+      readToken(yn, 20);
+      if (yn[0] != 'y' && yn[0] != 'Y') {
+        ybClose(other);
+        printf("Action cancelled. sending you back to main menu...\n");
+        printf("========================================\n");
+        return 2;
+      }
+      err = ybSort(other);
+      if (err != YB_OK) {
+        ybClose(other);
+        printf("[ERR] Sorting %s failed: %s\n", path, ybStrError(err));
+        printf("========================================\n");
+        return 1;
+      }
+    }
+    ybClose(other);
+
+    err = ybDiff(db, path, diffPath, &ds);
+    if (err != YB_OK) {
+      printf("[ERR] %s\n", ybStrError(err));
+      printf("========================================\n");
+      return 1;
+    }
+    printf("Added: %lld \t Removed: %lld \t Changed: %lld \t Unchanged: %lld\n",
+           ds.added, ds.removed, ds.changed, ds.unchanged);
+    if (ds.skipped > 0)
+      printf("[WARN] %lld row(s) of %s have an invalid id and were skipped\n",
+             ds.skipped, path);
+    printf("Diff written to %s\n", diffPath);
+    if (ds.added + ds.removed + ds.changed == 0) {
+      printf("Nothing to apply.\n");
+      printf("========================================\n");
+      return 0;
+    }
+  }
+  else if (inp[0] == '2') {
+    printf("Path to diff file: ");
+    readToken(diffPath, 256);
+  }
+  else {
+    printf("Action cancelled. sending you back to main menu...\n");
     printf("========================================\n");
-    free(name);
-    return 0;
-  } 
+    return 2;
+  }
+
+  printf("Apply %s to the data now? (y/N): ", diffPath);
+  readToken(yn, 20);
+  if (yn[0] != 'y' && yn[0] != 'Y') {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
+  err = ybDiffApply(db, diffPath, &ds);
+  if (err != YB_OK) {
+    printf("[ERR] %s: %s\n", diffPath, ybStrError(err));
+    printf("========================================\n");
+    return 1;
+  }
+  printf("%lld added, %lld removed, %lld changed.\n", ds.added, ds.removed,
+         ds.changed);
+  if (ds.skipped > 0)
+    printf("[WARN] %lld operation(s) didn't match the data and were skipped\n",
+           ds.skipped);
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: exportCmd
+ * COMMAND: export students to JSON Lines, TSV or a printable yearbook
+ *
+ * EXPLAINATION:
+ * ask for format, order, an optional rule (id prefix and/or course)
+ * and the output file, then let ybExport() write it.
+ */
+int exportCmd() {
+  YbFilter bf = {NULL, 0, "", -1};
+  YbExportOptions o = {YB_EXPORT_JSONL, YB_ORDER_ID, NULL, 20};
+  char inp[256];
+  long long rows;
+  system(CLEAR_CMD);
+  printf("=============Export Students============\n");
+  printf("[ 1 ] JSON Lines\n");
+  printf("[ 2 ] TSV\n");
+  printf("[ 3 ] yearbook HTML (grouped by course, paged)\n");
+  printf("Format (x to cancel): ");
+  readToken(inp, 256);
+  if (inp[0] < '1' || inp[0] > '3') {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
+  o.format = inp[0] - '1';
+
+  printf("Order (1 for id, 2 for name, 3 for nickname): ");
+  readToken(inp, 256);
+  if (inp[0] < '1' || inp[0] > '3') {
+    printf("Invalid order!\n");
+    printf("========================================\n");
+    return 1;
+  }
+  o.order = inp[0] - '1';
+
+  printf("ID prefix (e.g. 640705, - for any): ");
+  readToken(inp, 256);
+  if (inp[0] != '-') {
+    if (strlen(inp) > 11 || strspn(inp, "0123456789") != strlen(inp)) {
+      printf("Invalid ID prefix!\n");
+      printf("========================================\n");
+      return 1;
+    }
+    strcpy(bf.prefix, inp);
+  }
+  printf("Course (0 for REG, 1 for INTER, 2 for HDS, 3 for RC, -1 for any): ");
+  if (readInt(&bf.course) != 1 || bf.course < -1 || bf.course > 3) {
+    printf("Invalid course!\n");
+    printf("========================================\n");
+    return 1;
+  }
+  if (bf.prefix[0] != '\0' || bf.course >= 0)
+    o.filter = &bf;
+
+  if (o.format == YB_EXPORT_HTML) {
+    printf("Students per page: ");
+    if (readInt(&o.pageSize) != 1 || o.pageSize < 1) {
+      printf("Invalid page size!\n");
+      printf("========================================\n");
+      return 1;
+    }
+  }
+  printf("Path to write to: ");
+  readToken(inp, 256);
+
+  int err = ybExport(db, inp, &o, &rows);
+  if (err != YB_OK) {
+    printf("[ERR] %s: %s\n", inp, ybStrError(err));
+    printf("========================================\n");
+    return 1;
+  }
+  printf("%lld student(s) exported to %s\n", rows, inp);
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: findStudent - look up a student by full or shorthand id
+ *
+ * - Student *out: receives the student
+ *
+ * EXPLAINATION:
+ * prints why when the id is invalid or not found and returns 1
+ */
+int findStudent(const char *inp, Student *out) {
+  YbQuery q;
+  int m;
+  if (ybQueryInit(&q, YB_BY_ID, inp) != YB_OK) {
+    printf("Invalid ID!\n");
+    return 1;
+  }
+  int err = ybSearch(db, &q, out, 1, &m);
+  if (err != YB_OK)
+    printErr(err);
+  else if (m < 1)
+    printf("ID %s not found!\n", inp);
+  return err != YB_OK || m < 1;
+}
+
+/**
+ * FUNCTION: photoCmd
+ * COMMAND: attach portraits to students, thumbnails and contact sheets
+ *
+ * EXPLAINATION:
+ * photos live in their own store next to the data file (PHOTO_DIR).
+ * an image stored before (by any student) isn't stored again.
+ */
+int photoCmd() {
+  char inp[256], path[256];
+  int err, dup, n;
+  Student cur;
+  const void *data;
+  size_t len;
+  system(CLEAR_CMD);
+  if (photos == NULL && (err = ybPhotosOpen(PHOTO_DIR, &photos)) != YB_OK) {
+    printf("[ERR] %s: %s\n", PHOTO_DIR, ybStrError(err));
+    printf("========================================\n");
+    return 1;
+  }
+  printf("=================Photos=================\n");
+  printf("[ 1 ] attach a photo to a student\n");
+  printf("[ 2 ] save a student's photo or thumbnail\n");
+  printf("[ 3 ] contact sheet of a cohort's thumbnails\n");
+  printf("[ 4 ] remove a student's photo\n");
+  printf("[ 5 ] photo store statistics\n");
+  printf("Option (x to cancel): ");
+  readToken(inp, 256);
+
+  if (inp[0] >= '1' && inp[0] <= '4' && inp[0] != '3') {
+    printf("Student ID: ");
+    readToken(inp + 1, 255);
+    if (findStudent(inp + 1, &cur) != 0) {
+      printf("========================================\n");
+      return 1;
+    }
+  }
+  if (inp[0] == '1') {
+    printf("Path to image (PPM/PGM for thumbnails): ");
+    readToken(path, 256);
+    err = ybPhotoPutFile(photos, cur.id, path, &dup);
+    if (err != YB_OK)
+      printf("[ERR] %s: %s\n", path, ybStrError(err));
+    else
+      printf("Photo of %s saved%s.\n", cur.name,
+             dup ? " (same image already stored, not stored again)" : "");
+  }
+  else if (inp[0] == '2') {
+    printf("[ 1 ] photo \t [ 2 ] thumbnail: ");
+    readToken(inp + 1, 20);
+    printf("Path to write to: ");
+    readToken(path, 256);
+    if (inp[1] == '2')
+      err = ybPhotoThumb(photos, cur.id, &data, &len);
+    else
+      err = ybPhotoGet(photos, cur.id, &data, &len);
+    FILE *f = err == YB_OK ? fopen(path, "wb") : NULL;
+    if (err != YB_OK) {
+      printf("[ERR] %s: %s\n", cur.id, ybStrError(err));
+    }
+    else if (f == NULL || fwrite(data, 1, len, f) != len) {
+      printf("[ERR] Could not write %s\n", path);
+    }
+    else {
+      printf("%zu bytes written to %s\n", len, path);
+    }
+    if (f != NULL)
+      fclose(f);
+  }
+  else if (inp[0] == '3') {
+    YbFilter bf = {NULL, 0, "", -1};
+    printf("ID prefix (e.g. 640705, - for any): ");
+    readToken(inp, 256);
+    if (inp[0] != '-') {
+      if (strlen(inp) > 11 || strspn(inp, "0123456789") != strlen(inp)) {
+        printf("Invalid ID prefix!\n");
+        printf("========================================\n");
+        return 1;
+      }
+      strcpy(bf.prefix, inp);
+    }
+    printf("Course (0 for REG, 1 for INTER, 2 for HDS, 3 for RC, -1 for any): ");
+    if (readInt(&bf.course) != 1 || bf.course < -1 || bf.course > 3) {
+      printf("Invalid course!\n");
+      printf("========================================\n");
+      return 1;
+    }
+    printf("Thumbnails per row: ");
+    if (readInt(&n) != 1 || n < 1 || n > 64) {
+      printf("Invalid amount!\n");
+      printf("========================================\n");
+      return 1;
+    }
+    printf("Path to write the sheet (PPM) to: ");
+    readToken(path, 256);
+    err = ybPhotoSheet(photos, db, &bf, n, path, &n);
+    if (err != YB_OK)
+      printf("[ERR] %s: %s\n", path, ybStrError(err));
+    else if (n == 0)
+      printf("No student of that cohort has a PPM/PGM photo.\n");
+    else
+      printf("%d thumbnail(s) written to %s\n", n, path);
+  }
+  else if (inp[0] == '4') {
+    err = ybPhotoRemove(photos, cur.id);
+    if (err != YB_OK)
+      printf("[ERR] %s: %s\n", cur.id, ybStrError(err));
+    else
+      printf("Photo of %s removed.\n", cur.name);
+  }
+  else if (inp[0] == '5') {
+    YbPhotoStats ps;
+    ybPhotoStats(photos, &ps);
+    printf("Students with a photo: %lld \t Thumbnails: %lld\n", ps.students,
+           ps.thumbs);
+    printf("Stored images: %lld \t Segments: %d \t Bytes: %lld\n", ps.blobs,
+           ps.segments, ps.bytes);
+  }
+  else {
+    printf("Action cancelled. sending you back to main menu...\n");
+    printf("========================================\n");
+    return 2;
+  }
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: printProblem - print one problem found by ybVerify()
+ */
+void printProblem(const YbProblem *p) {
+  switch (p->kind) {
+  case YB_PROBLEM_PARSE:
+    printf("line %lld: not a valid data line\n", p->line);
+    break;
+  case YB_PROBLEM_FIELD:
+    printf("line %lld: invalid id, email, phone or empty name\n", p->line);
+    break;
+  case YB_PROBLEM_COURSE:
+    printf("line %lld: course is not 0-3\n", p->line);
+    break;
+  case YB_PROBLEM_ORDER:
+    printf("line %lld: id is smaller than on line %lld\n", p->line, p->other);
+    break;
+  case YB_PROBLEM_DUP_ID:
+    printf("line %lld: same id as line %lld\n", p->line, p->other);
+    break;
+  case YB_PROBLEM_DUP_EMAIL:
+    printf("line %lld: same email as line %lld\n", p->line, p->other);
+    break;
+  case YB_PROBLEM_CHECKSUM:
+    if (p->other > 0)
+      printf("lines %lld-%lld: changed outside of yookbeer (checksum)\n",
+             p->line, p->other);
+    else
+      printf("line %lld: file was cut short here (checksum)\n", p->line);
+    break;
+  }
+}
+
+/**
+ * FUNCTION: verifyCmd
+ * COMMAND: check the data file for damaged or invalid rows
+ *
+ * EXPLAINATION:
+ * list the first VERIFY_LIST problems by line number. when the file was
+ * changed on purpose outside of yookbeer the new checksums can be
+ * recorded so the change isn't reported again.
+ */
+int verifyCmd() {
+  YbVerifyReport vr;
+  YbProblem vp[VERIFY_LIST];
+  char yn[20];
+  system(CLEAR_CMD);
+  printf("================Verify==================\n");
+  int err = ybVerify(db, &vr, vp, VERIFY_LIST);
+  if (err == YB_ERR_INVALID) {
+    printf("Only csv data files can be verified.\n");
+    printf("========================================\n");
+    return 1;
+  }
+  if (err != YB_OK) {
+    printErr(err);
+    printf("========================================\n");
+    return 1;
+  }
+  printf("Rows: %lld \t Blocks: %lld \t Checksums: %s\n", vr.rows, vr.blocks,
+         vr.checksums ? "compared" : "none recorded");
+  for (int j = 0; j < vr.listed; j++)
+    printProblem(&vp[j]);
+  if (vr.problems > vr.listed)
+    printf("... and %lld more\n", vr.problems - vr.listed);
+  if (vr.problems == 0)
+    printf("No problems found.\n");
+  else
+    printf("%lld problem(s) found.\n", vr.problems);
+
+  if (vr.problems > 0 || !vr.checksums) {
+    printf("Record checksums of the file as it is now? (y/N): ");
+    readToken(yn, 20);
+    if (yn[0] == 'y' || yn[0] == 'Y') {
+      err = ybWriteChecksums(db);
+      if (err != YB_OK)
+        printErr(err);
+      else
+        printf("Checksums recorded.\n");
+    }
+  }
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: storageCmd
+ * COMMAND: move data between csv, the B+tree backend and snapshots, show cache stats
+ *
+ * EXPLAINATION:
+ * import and cache stats only make sense when running on a B+tree
+ * file (`-b`), export works for both backends.
+ */
+int storageCmd() {
+  char inp[256];
+  int err, imported, skipped;
+  YbCacheStats cs;
+  YbSnapshotStats ss;
+  system(CLEAR_CMD);
+  printf("================Storage=================\n");
+  printf("[ 1 ] import csv file\n");
+  printf("[ 2 ] export to csv file\n");
+  printf("[ 3 ] page cache statistics\n");
+  printf("[ 4 ] write compressed snapshot\n");
+  printf("[ 5 ] restore compressed snapshot\n");
+  printf("Option (x to cancel): ");
+  readToken(inp, 256);
+
+  if (inp[0] == '1') {
+    printf("Path to csv file: ");
+    readToken(inp, 256);
+    err = ybImportCsv(db, inp, &imported, &skipped);
+    if (err == YB_ERR_INVALID)
+      printf("Import needs a B+tree database, start with -b <file>\n");
+    else if (err != YB_OK)
+      printf("[ERR] %s: %s\n", inp, ybStrError(err));
+    else
+      printf("%d student(s) imported, %d row(s) skipped.\n", imported, skipped);
+  }
+  else if (inp[0] == '2') {
+    printf("Path to csv file: ");
+    readToken(inp, 256);
+    err = ybExportCsv(db, inp);
+    if (err != YB_OK)
+      printf("[ERR] %s: %s\n", inp, ybStrError(err));
+    else
+      printf("%s written succesfully!\n", inp);
+  }
+  else if (inp[0] == '3') {
+    if (ybCacheStats(db, &cs) != YB_OK) {
+      printf("No page cache, start with -b <file> to use the B+tree backend\n");
+    }
+    else {
+      unsigned long long total = cs.hits + cs.misses;
+      printf("Pages in file: %u \t Cache frames: %d\n", cs.pages, cs.frames);
+      printf("Hits: %llu \t Misses: %llu \t Hit rate: %.2f%%\n",
+             (unsigned long long)cs.hits, (unsigned long long)cs.misses,
+             total > 0 ? 100.0 * cs.hits / total : 0.0);
+    }
+  }
+  else if (inp[0] == '4') {
+    printf("Path to snapshot file: ");
+    readToken(inp, 256);
+    err = ybSnapshotWrite(db, inp, &ss);
+    if (err != YB_OK) {
+      printf("[ERR] %s: %s\n", inp, ybStrError(err));
+    }
+    else {
+      printf("%lld student(s) in %d block(s) written to %s\n", ss.rows,
+             ss.blocks, inp);
+      printf("csv: %lld bytes \t snapshot: %lld bytes \t ratio: %.2fx\n",
+             ss.rawBytes, ss.snapshotBytes,
+             ss.snapshotBytes > 0 ? (double)ss.rawBytes / ss.snapshotBytes : 0.0);
+    }
+  }
+  else if (inp[0] == '5') {
+    printf("Path to snapshot file: ");
+    readToken(inp, 256);
+    printf("This replaces the current data (B+tree: adds missing rows). Proceed? (y/N): ");
+    char yn[20];
+    readToken(yn, 20);
+    if (yn[0] != 'y' && yn[0] != 'Y') {
+      printf("Action cancelled. sending you back to main menu...\n");
+      printf("========================================\n");
+      return 2;
+    }
+    err = ybSnapshotRestore(db, inp, &imported);
+    if (err != YB_OK)
+      printf("[ERR] %s: %s\n", inp, ybStrError(err));
+    else
+      printf("%d student(s) restored from %s\n", imported, inp);
+  }
   else {
     printf("Action cancelled. sending you back to main menu...\n");
     printf("========================================\n");
-    free(d);
-    free(name);
     return 2;
   }
+  printf("========================================\n");
+  return 0;
+}
+
+/**
+ * FUNCTION: replStatusCmd
+ * COMMAND: show replication role, connected replicas or replication lag
+ */
+void replStatusCmd() {
+  YbReplStatus rs;
+  ybReplicationStatus(db, &rs);
+  printf("==============Replication===============\n");
+  if (rs.role == YB_ROLE_PRIMARY) {
+    printf("Role: primary \t Replicas: %d \t Last change: #%llu\n",
+           rs.replicas, (unsigned long long)rs.seq);
+  }
+  else if (rs.role == YB_ROLE_REPLICA) {
+    printf("Role: replica (read-only) \t Primary: %s\n",
+           rs.connected ? "connected" : "disconnected, retrying");
+    printf("Applied: #%llu \t Primary at: #%llu \t Behind: %llu change(s)\n",
+           (unsigned long long)rs.seq, (unsigned long long)rs.primarySeq,
+           (unsigned long long)(rs.primarySeq - rs.seq));
+    printf("Lag of last change: %lld ms \t Last heard from primary: %lld ms ago\n",
+           rs.lagMs, rs.idleMs);
+  }
+  else {
+    printf("Not replicating, start with -p <socket> or -f <socket>\n");
+  }
+  printf("========================================\n");
 }
 
 /**
  * FUNCTION: printTheEntireFlippingThing
  * COMMAND: print every row of data file
- * 
+ *
  * EXPLAINATION:
- * this should actually be undocumented as 
+ * this should actually be undocumented as
  * it is just a debug function used in development
  */
 void printTheEntireFuckingThing() {
-  FILE *f = fopen(DATA_PATH, "r");
-  char line[256];
-  Student cur = {0};
+  YbIter *it;
+  Student cur;
   int m = 0;
+  if (ybIterOpen(db, &it) != YB_OK)
+    return;
   printf("===========Print Everyone==========\n");
   printf("Results: \n");
-  while (fgets(line, sizeof(line), f)) {
-    removeTrailingNewline(line);
-    if (sscanf(line, "%[^,],%[^,],%[^,],%d,%[^,],%[^,]", cur.id, cur.name,
-               cur.nick, &cur.course, cur.email, cur.phone) == 6) {
-      if (m == 0)
-        printResHeader();
-      printSearchResultLine(cur);
-      m++;
-    }
+  while (ybIterNext(it, &cur)) {
+    if (m == 0)
+      printResHeader();
+    printSearchResultLine(cur);
+    m++;
   }
-  fclose(f);
+  ybIterClose(it);
   printf("Total match: %d\n", m);
   printf("========================================\n");
 }
@@ -921,70 +1236,229 @@ void printTheEntireFuckingThing() {
 /**
  * FUNCTION: helpCmd
  * COMMAND: show command list
- * 
+ *
  * EXPLAINATION:
  * self explaining. show list of command.
  */
 void helpCmd() {
   printf("==========CPE38 Students List==========\n");
   printf("[ C ] for students count\n");
+  printf("[ G ] to count students grouped by course/cohort, domain, ...\n");
   printf("[ I ] to search by id\n");
   printf("[ N ] to search by nickname\n");
   printf("[ F ] to search by firstname\n");
+  printf("[ U ] to search by surname\n");
   printf("[ A ] to add student\n");
   printf("[ R ] to remove student\n");
+  printf("[ B ] to batch remove students by id list or rule\n");
+  printf("[ D ] to diff against another roster and apply the changes\n");
+  printf("[ O ] to export to JSON Lines, TSV or a yearbook HTML\n");
+  printf("[ P ] to attach photos and make thumbnails/contact sheets\n");
+  printf("[ S ] to import/export csv and show storage stats\n");
+  printf("[ L ] to show replication status and lag\n");
+  printf("[ V ] to verify the data file (checksums, ids, emails)\n");
   printf("[ H ] to display this help message\n");
   printf("[ X ] to exit the program\n");
 }
 
 /**
  * FUNCTION: main - where the magic began
+ *
+ * - options: `-m <MB>` memory budget for sorting and other bulk operations
+ *            `-b <file>` use a B+tree database file instead of the csv
+ *            `-c <pages>` page cache size of the B+tree backend
+ *            `-r` keep the data file in memory and reload it when it
+ *            is edited outside of yookbeer
+ *            `-p <socket>` be a primary, send changes to replicas
+ *            (implies -r for the csv)
+ *            `-f <socket>` be a read-only replica following a primary
+ *            `-t <file>` capture every command and its input to a trace
+ *            file, see yookbeer-replay
  */
-int main() {
-  /**
-   * initiate len to store data file line count.
-   * this will be a main source of truth for
-   * any function that need data line count
-   */
-  int len;
-
+int main(int argc, char *argv[]) {
   /**
-   * initiate buffer to store user input in 
-   * main menu, and initiate c to store 
+   * initiate buffer to store user input in
+   * main menu, and initiate c to store
    * character to be use as commands
    */
   char buf[20];
   char c;
+  long long memBudget = 0;
+  char *btreePath = NULL;
+  char *primarySock = NULL, *followSock = NULL;
+  int cachePages = DEFAULT_CACHE_PAGES, resident = 0, err;
+  YbRefresh rf;
+
+  /**
+   * parse command line options
+   */
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "-m") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+      memBudget = (long long)atoi(argv[++a]) * 1024 * 1024;
+    }
+    else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) {
+      btreePath = argv[++a];
+    }
+    else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc &&
+             atoi(argv[a + 1]) > 0) {
+      cachePages = atoi(argv[++a]);
+    }
+    else if (strcmp(argv[a], "-r") == 0) {
+      resident = 1;
+    }
+    else if (strcmp(argv[a], "-p") == 0 && a + 1 < argc) {
+      primarySock = argv[++a];
+    }
+    else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) {
+      followSock = argv[++a];
+    }
+    else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) {
+      traceFile = fopen(argv[++a], "w");
+      if (traceFile == NULL) {
+        printf("[ERR] Cannot write trace file %s! Exiting...", argv[a]);
+        return 1;
+      }
+      fprintf(traceFile, "# yookbeer trace 1");
+    }
+    else {
+      printf("Usage: %s [-m <memory budget in MB>] [-b <btree file>] "
+             "[-c <cache pages>] [-r] [-p <socket> | -f <socket>] "
+             "[-t <trace file>]\n",
+             argv[0]);
+      return 1;
+    }
+  }
 
   /**
-   * count data lines and store it in len,
-   * if the file does not exist, exit the process
+   * a csv primary is resident so edits made to the data file outside
+   * of yookbeer are seen, and sent to the replicas
    */
-  countDataLine(&len);
-  if (len < 0) {
+  if (primarySock != NULL && btreePath == NULL)
+    resident = 1;
+
+  /**
+   * open the data file, if the file does not exist, exit the process
+   */
+  if (ybApiVersion() != YB_API_VERSION) {
+    printf("[ERR] libyookbeer version mismatch! Exiting...");
+    return 1;
+  }
+  if (followSock != NULL) {
+    err = ybOpenReplica(followSock, &db);
+    if (err != YB_OK) {
+      printf("[ERR] Cannot follow primary at %s: %s! Exiting...", followSock,
+             ybStrError(err));
+      return 1;
+    }
+  }
+  else if (btreePath != NULL) {
+    err = ybOpenBtree(btreePath, cachePages, &db);
+    if (err != YB_OK) {
+      printf("[ERR] Cannot open %s: %s! Exiting...", btreePath, ybStrError(err));
+      return 1;
+    }
+  }
+  else if (resident) {
+    err = ybOpenResident(DATA_PATH, &db);
+    if (err != YB_OK) {
+      printf("[ERR] Cannot load %s: %s! Exiting...", DATA_PATH, ybStrError(err));
+      return 1;
+    }
+  }
+  else if (ybOpen(DATA_PATH, &db) != YB_OK) {
     printf("[ERR] Data file not found! Exiting...");
     return 1;
   }
+  ybSetMemBudget(db, memBudget);
+
+  /**
+   * check the data file once on load (csv only). imported or
+   * hand-edited data files may not be ordered by id, so sort them
+   * once before doing anything else
+   */
+  YbVerifyReport vr;
+  YbProblem vp[VERIFY_LIST_ON_LOAD], dropped[VERIFY_LIST_ON_LOAD];
+  int nDropped = 0;
+  int verified = ybVerify(db, &vr, vp, VERIFY_LIST_ON_LOAD) == YB_OK;
+  if (verified ? !vr.sorted : !ybIsSorted(db)) {
+    /** sorting only keeps lines it can parse, remember what goes */
+    for (int j = 0; verified && j < vr.listed; j++)
+      if (vp[j].kind == YB_PROBLEM_PARSE)
+        dropped[nDropped++] = vp[j];
+    printf("Data file is not sorted. Sorting data. Please wait!\n");
+    if (ybSort(db) != YB_OK) {
+      printf("[ERR] Data sorting failed! Exiting...");
+      ybClose(db);
+      return 1;
+    }
+    verified = ybVerify(db, &vr, vp, VERIFY_LIST_ON_LOAD) == YB_OK;
+  }
+  /** first start with this file: nothing to compare to yet */
+  if (verified && vr.problems == 0 && !vr.checksums)
+    ybWriteChecksums(db);
+
+  if (primarySock != NULL) {
+    err = ybServePrimary(db, primarySock);
+    if (err != YB_OK) {
+      printf("[ERR] Cannot serve replicas on %s: %s! Exiting...", primarySock,
+             ybStrError(err));
+      ybClose(db);
+      return 1;
+    }
+  }
 
   /**
    * clear terminal and display list of commands
    */
   system(CLEAR_CMD);
   helpCmd();
+  if (nDropped > 0) {
+    printf("[WARN] sorting dropped lines that aren't valid rows:\n");
+    for (int j = 0; j < nDropped; j++)
+      printProblem(&dropped[j]);
+  }
+  if (verified && vr.problems > 0) {
+    printf("[WARN] %s: %lld problem(s) found on load\n", ybPath(db),
+           vr.problems);
+    for (int j = 0; j < vr.listed; j++)
+      printProblem(&vp[j]);
+    printf("use 'v' for the full report\n");
+  }
+
+  /** trace timestamps count from the first prompt */
+  clock_gettime(CLOCK_MONOTONIC, &traceStart);
 
   /**
    * main process loop
    */
   while (1) {
     /**
-     * prompt user for commands and store it 
+     * prompt user for commands and store it
      * in buffer variable, then get the first letter
      * for the command
      */
     printf("Command: ");
-    scanf(" %s", buf);
+    if (scanf(" %19s", buf) != 1) // end of input
+      break;
+    traceCommand(buf);
     c = buf[0];
 
+    /**
+     * resident mode: pick up edits made to the data file since the
+     * last command before running this one
+     */
+    if (resident && btreePath == NULL && followSock == NULL) {
+      err = ybRefresh(db, &rf);
+      if (err != YB_OK)
+        printf("[WARN] Could not check %s: %s\n", DATA_PATH, ybStrError(err));
+      else if (rf.kind == YB_REFRESH_APPEND)
+        printf("[INFO] %lld new row(s) appended to %s loaded\n", rf.rows,
+               DATA_PATH);
+      else if (rf.kind == YB_REFRESH_RELOAD)
+        printf("[INFO] %s changed on disk, %lld row(s) reloaded\n", DATA_PATH,
+               rf.rows);
+    }
+
     /**
      * change all lowercase alphabet to uppercase
      */
@@ -992,18 +1466,38 @@ int main() {
       c -= 32;
     if (c == 'X') // exit command
       break;
+    else if (followSock != NULL && strchr("ARB", c)) // no writes on a replica
+      printf("[ERR] This is a read-only replica, make changes on the primary\n");
     else if (c == 'H') // show list of commands
       helpCmd();
     else if (c == 'N') // search by nickname
       searchByNickName();
     else if (c == 'F') // search by firstname
       searchByFirstName();
+    else if (c == 'U') // search by surname
+      searchBySurname();
     else if (c == 'C') // show student count
       allStdCount();
+    else if (c == 'G') // group by aggregation
+      groupByCmd();
     else if (c == 'A') // add student to data file
-      addStd(&len);
+      addStd();
     else if (c == 'R') // remove student file
-      remStd(&len);
+      remStd();
+    else if (c == 'B') // batch remove students from data file
+      batchRemStd();
+    else if (c == 'D') // roster diff and merge
+      diffCmd();
+    else if (c == 'O') // export to jsonl, tsv or yearbook html
+      exportCmd();
+    else if (c == 'P') // photo store
+      photoCmd();
+    else if (c == 'V') // integrity check
+      verifyCmd();
+    else if (c == 'L') // replication status
+      replStatusCmd();
+    else if (c == 'S') // storage: csv import/export, cache stats
+      storageCmd();
     else if (c == 'E') // TODO: remove this
       printTheEntireFuckingThing();
     else if (c == 'I')
@@ -1015,5 +1509,11 @@ int main() {
     }
   }
   printf("Exiting...\n");
+  if (traceFile != NULL) {
+    fputc('\n', traceFile);
+    fclose(traceFile);
+  }
+  ybPhotosClose(photos);
+  ybClose(db);
   return 0;
 }
@@ -0,0 +1,458 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yookbeer.h"
+
+#define DATA_PATH "data/data.csv"
+#define DEFAULT_CACHE_PAGES 256
+#define MAX_SESSIONS 64
+// most input words a command reads (add student reads 9)
+#define MAX_ARGS 16
+
+/**
+ * yookbeer-replay: re-issue a trace captured with `yookbeer -t <file>`
+ * against a roster, from several sessions at once, and print how long
+ * each kind of command took.
+ *
+ * the sessions share the trace (command k is run by session k % n), so
+ * it is replayed once at its own pace with up to n commands in flight
+ * and every add or remove in it happens once.
+ *
+ * the commands are run through libyookbeer the way the CLI runs them,
+ * without the prompting and printing. commands that only make sense
+ * interactively (exports, photos, diff, ...) are skipped. the roster is
+ * changed by adds and removes, so replay against a copy.
+ */
+
+/**
+ * STRUCT: TraceCmd - one line of the trace
+ *
+ * - ms: time since the capture started
+ * - cmd: command letter, upper case
+ * - args: input words the command read
+ */
+typedef struct {
+  long long ms;
+  char cmd;
+  int argc;
+  char *args[MAX_ARGS];
+} TraceCmd;
+
+/**
+ * STRUCT: Samples - latencies (ms) of one command letter
+ *
+ * - ms, n: latencies of the commands that succeeded
+ * - errors, errorMs: amount and total latency of the ones that failed,
+ *   kept apart as a rejected command returns much sooner
+ */
+typedef struct {
+  double *ms;
+  int n, cap;
+  int errors;
+  double errorMs;
+} Samples;
+
+/**
+ * STRUCT: Session - one replaying thread
+ *
+ * - id, stride: runs trace lines id, id + stride, id + 2 * stride, ...
+ */
+typedef struct {
+  int id;
+  int stride;
+  Samples by[26];
+  long long skipped;
+} Session;
+
+YbDb *db = NULL;
+int isBtree = 0;
+TraceCmd *trace = NULL;
+int traceLen = 0;
+double speed = 1;
+struct timespec replayStart;
+
+/**
+ * one writer or many readers at a time, like a server in front of the
+ * library would do. the B+tree page cache changes on reads, so there
+ * every command takes the lock alone.
+ */
+pthread_rwlock_t dbLock = PTHREAD_RWLOCK_INITIALIZER;
+
+static double elapsedMs(const struct timespec *from) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from->tv_sec) * 1e3 + (now.tv_nsec - from->tv_nsec) / 1e6;
+}
+
+static void lockRead(void) {
+  if (isBtree)
+    pthread_rwlock_wrlock(&dbLock);
+  else
+    pthread_rwlock_rdlock(&dbLock);
+}
+
+/**
+ * FUNCTION: loadTrace - read a trace file into `trace`
+ *
+ * EXPLAINATION:
+ * a line is `<ms> <command> <input words...>`, lines starting with '#'
+ * are comments. the lines are kept in memory and split in place.
+ */
+static int loadTrace(const char *path) {
+  char line[2048];
+  int cap = 1024;
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return 0;
+  trace = malloc(cap * sizeof(TraceCmd));
+  while (trace != NULL && fgets(line, sizeof(line), f)) {
+    char *save, *tok = strtok_r(line, " \t\r\n", &save);
+    if (tok == NULL || tok[0] == '#')
+      continue;
+    TraceCmd *c = &trace[traceLen];
+    c->ms = atoll(tok);
+    if ((tok = strtok_r(NULL, " \t\r\n", &save)) == NULL)
+      continue;
+    c->cmd = tok[0] >= 'a' && tok[0] <= 'z' ? tok[0] - 32 : tok[0];
+    c->argc = 0;
+    while (c->argc < MAX_ARGS && (tok = strtok_r(NULL, " \t\r\n", &save)))
+      c->args[c->argc++] = strdup(tok);
+    if (++traceLen == cap) {
+      cap *= 2;
+      TraceCmd *grown = realloc(trace, cap * sizeof(TraceCmd));
+      if (grown == NULL)
+        free(trace);
+      trace = grown;
+    }
+  }
+  fclose(f);
+  return trace != NULL;
+}
+
+static const char *arg(const TraceCmd *c, int j) {
+  return j < c->argc ? c->args[j] : "";
+}
+
+static int search(const TraceCmd *c, YbSearchField field) {
+  YbQuery q;
+  int total;
+  if (ybQueryInit(&q, field, arg(c, 0)) != YB_OK)
+    return YB_ERR_INVALID;
+  lockRead();
+  int err = ybSearch(db, &q, NULL, 0, &total);
+  pthread_rwlock_unlock(&dbLock);
+  return err;
+}
+
+/**
+ * FUNCTION: addStudent - replay of the add command
+ *
+ * EXPLAINATION:
+ * input: id, firstname, lastname, nickname, course, email, phone, then
+ * one or two confirmations. the student is built like addStd() builds
+ * it and only added when the last confirmation was yes.
+ */
+static int addStudent(const TraceCmd *c) {
+  Student x;
+  CheckDuplicateResponse dr;
+  char fnm[256], lnm[256], nick[256];
+  if (c->argc < 8)
+    return YB_ERR_INVALID;
+  snprintf(x.id, sizeof(x.id), "%s", arg(c, 0));
+  snprintf(fnm, sizeof(fnm), "%s", arg(c, 1));
+  snprintf(lnm, sizeof(lnm), "%s", arg(c, 2));
+  snprintf(nick, sizeof(nick), "%s", arg(c, 3));
+  ybTruncate(fnm, 20);
+  ybTruncate(lnm, 30);
+  ybTruncate(nick, 10);
+  ybToUpper(fnm);
+  ybToUpper(lnm);
+  ybToUpper(nick);
+  snprintf(x.name, sizeof(x.name), "%.20s %.30s", fnm, lnm);
+  strcpy(x.nick, nick);
+  x.course = atoi(arg(c, 4));
+  snprintf(x.email, sizeof(x.email), "%s", arg(c, 5));
+  snprintf(x.phone, sizeof(x.phone), "%s", arg(c, 6));
+  const char *yes = arg(c, c->argc - 1);
+
+  pthread_rwlock_wrlock(&dbLock);
+  int err = ybCheckDuplicate(db, &x, &dr);
+  if (err == YB_OK && (dr.id > 0 || dr.email > 0))
+    err = YB_ERR_DUPLICATE;
+  if (err == YB_OK && (yes[0] == 'y' || yes[0] == 'Y'))
+    err = ybAdd(db, &x);
+  pthread_rwlock_unlock(&dbLock);
+  return err;
+}
+
+/**
+ * FUNCTION: removeStudent - replay of the remove command (id, confirmation)
+ */
+static int removeStudent(const TraceCmd *c) {
+  YbQuery q;
+  Student cur;
+  int m;
+  if (ybQueryInit(&q, YB_BY_ID, arg(c, 0)) != YB_OK)
+    return YB_ERR_INVALID;
+  pthread_rwlock_wrlock(&dbLock);
+  int err = ybSearch(db, &q, &cur, 1, &m);
+  if (err == YB_OK && m < 1)
+    err = YB_ERR_NOT_FOUND;
+  if (err == YB_OK && (arg(c, 1)[0] == 'y' || arg(c, 1)[0] == 'Y'))
+    err = ybRemove(db, cur.id, NULL);
+  pthread_rwlock_unlock(&dbLock);
+  return err;
+}
+
+/**
+ * FUNCTION: runCommand - replay one command
+ *
+ * - int *err: receives the YbStatus of the command
+ *
+ * EXPLAINATION:
+ * returns 0 for commands that aren't replayed
+ */
+static int runCommand(const TraceCmd *c, int *err) {
+  Count cnt;
+  YbGroup *g;
+  YbVerifyReport vr;
+  int groups, rows;
+  switch (c->cmd) {
+  case 'I':
+    *err = search(c, YB_BY_ID);
+    return 1;
+  case 'F':
+    *err = search(c, YB_BY_FIRSTNAME);
+    return 1;
+  case 'N':
+    *err = search(c, YB_BY_NICK);
+    return 1;
+  case 'U':
+    *err = search(c, YB_BY_SURNAME);
+    return 1;
+  case 'C':
+    lockRead();
+    *err = ybCount(db, &cnt);
+    pthread_rwlock_unlock(&dbLock);
+    return 1;
+  case 'G':
+    if (atoi(arg(c, 0)) < 1 || atoi(arg(c, 0)) > 4) {
+      *err = YB_ERR_INVALID;
+      return 1;
+    }
+    lockRead();
+    *err = ybGroupBy(db, (YbGroupKey)atoi(arg(c, 0)), &g, &groups, &rows);
+    pthread_rwlock_unlock(&dbLock);
+    if (*err == YB_OK)
+      ybFreeGroups(g);
+    return 1;
+  case 'A':
+    *err = addStudent(c);
+    return 1;
+  case 'R':
+    *err = removeStudent(c);
+    return 1;
+  case 'V':
+    lockRead();
+    *err = ybVerify(db, &vr, NULL, 0);
+    pthread_rwlock_unlock(&dbLock);
+    return 1;
+  }
+  return 0;
+}
+
+static void addSample(Samples *s, double ms, int err) {
+  if (err != YB_OK) {
+    s->errors++;
+    s->errorMs += ms;
+    return;
+  }
+  if (s->n == s->cap) {
+    s->cap = s->cap ? s->cap * 2 : 256;
+    s->ms = realloc(s->ms, s->cap * sizeof(double));
+  }
+  s->ms[s->n++] = ms;
+}
+
+/**
+ * FUNCTION: sessionWorker - thread entry, replay this session's share
+ * of the trace
+ *
+ * EXPLAINATION:
+ * every command waits until its time in the trace (divided by the
+ * speed factor) has come, counted from the start of the replay. a
+ * command that starts late because the one before it was slow runs
+ * right away, like a user who kept typing would.
+ */
+static void *sessionWorker(void *arg) {
+  Session *s = arg;
+  for (int j = s->id; j < traceLen; j += s->stride) {
+    const TraceCmd *c = &trace[j];
+    if (speed > 0) {
+      double wait = c->ms / speed - elapsedMs(&replayStart);
+      if (wait > 0) {
+        struct timespec ts = {(time_t)(wait / 1e3),
+                              (long)(fmod(wait, 1e3) * 1e6)};
+        nanosleep(&ts, NULL);
+      }
+    }
+    struct timespec t0;
+    int err;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (c->cmd < 'A' || c->cmd > 'Z' || !runCommand(c, &err)) {
+      s->skipped++;
+      continue;
+    }
+    addSample(&s->by[c->cmd - 'A'], elapsedMs(&t0), err);
+  }
+  return NULL;
+}
+
+static int compareMs(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * FUNCTION: percentile - nearest rank percentile of sorted samples
+ */
+static double percentile(const double *v, int n, double p) {
+  int rank = (int)ceil(p / 100 * n);
+  return v[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * FUNCTION: main - yookbeer-replay [options] <trace file> [data file]
+ *
+ * - options: `-n <sessions>` sessions sharing the trace
+ *            `-s <speed>` 1: original timing, 10: ten times faster,
+ *            0: no waiting between commands
+ *            `-b` the data file is a B+tree database
+ *            `-r` open the data file in resident mode
+ */
+int main(int argc, char *argv[]) {
+  int sessions = 1, resident = 0, err;
+  char *tracePath = NULL, *dataPath = DATA_PATH;
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "-n") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0 &&
+        atoi(argv[a + 1]) <= MAX_SESSIONS) {
+      sessions = atoi(argv[++a]);
+    }
+    else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc &&
+             atof(argv[a + 1]) >= 0) {
+      speed = atof(argv[++a]);
+    }
+    else if (strcmp(argv[a], "-b") == 0) {
+      isBtree = 1;
+    }
+    else if (strcmp(argv[a], "-r") == 0) {
+      resident = 1;
+    }
+    else if (argv[a][0] != '-' && tracePath == NULL) {
+      tracePath = argv[a];
+    }
+    else if (argv[a][0] != '-') {
+      dataPath = argv[a];
+    }
+    else {
+      tracePath = NULL;
+      break;
+    }
+  }
+  if (tracePath == NULL) {
+    printf("Usage: %s [-n <sessions, max %d>] [-s <speed, 0 = no waiting>] "
+           "[-b | -r] <trace file> [data file]\n",
+           argv[0], MAX_SESSIONS);
+    printf("adds and removes change the data file, replay against a copy\n");
+    return 1;
+  }
+  if (!loadTrace(tracePath)) {
+    printf("[ERR] Cannot read trace file %s! Exiting...\n", tracePath);
+    return 1;
+  }
+  if (isBtree)
+    err = ybOpenBtree(dataPath, DEFAULT_CACHE_PAGES, &db);
+  else if (resident)
+    err = ybOpenResident(dataPath, &db);
+  else
+    err = ybOpen(dataPath, &db);
+  if (err != YB_OK) {
+    printf("[ERR] Cannot open %s: %s! Exiting...\n", dataPath, ybStrError(err));
+    return 1;
+  }
+
+  printf("Replaying %d command(s) from %s with %d session(s) at %gx...\n",
+         traceLen, tracePath, sessions, speed);
+  Session *s = calloc(sessions, sizeof(Session));
+  pthread_t th[MAX_SESSIONS];
+  int threaded[MAX_SESSIONS];
+  clock_gettime(CLOCK_MONOTONIC, &replayStart);
+  for (int j = 0; j < sessions; j++) {
+    s[j].id = j;
+    s[j].stride = sessions;
+    threaded[j] = pthread_create(&th[j], NULL, sessionWorker, &s[j]) == 0;
+  }
+  /** sessions that got no thread run here once the others are going */
+  for (int j = 0; j < sessions; j++)
+    if (!threaded[j])
+      sessionWorker(&s[j]);
+  for (int j = 0; j < sessions; j++)
+    if (threaded[j])
+      pthread_join(th[j], NULL);
+  double wall = elapsedMs(&replayStart);
+
+  /**
+   * merge the samples of every session and print one row per command
+   */
+  long long total = 0, skipped = 0;
+  printf("latencies of successful commands, failed ones on their own\n");
+  printf("%-4s %8s %10s %10s %10s %10s %10s %7s %10s\n", "CMD", "OK",
+         "MEAN(ms)", "P50", "P90", "P99", "MAX", "ERRORS", "ERR MEAN");
+  for (int k = 0; k < 26; k++) {
+    Samples all = {0};
+    for (int j = 0; j < sessions; j++) {
+      for (int i = 0; i < s[j].by[k].n; i++)
+        addSample(&all, s[j].by[k].ms[i], YB_OK);
+      all.errors += s[j].by[k].errors;
+      all.errorMs += s[j].by[k].errorMs;
+      free(s[j].by[k].ms);
+    }
+    if (all.n == 0 && all.errors == 0)
+      continue;
+    printf("%-4c %8d ", 'A' + k, all.n);
+    if (all.n > 0) {
+      double sum = 0;
+      qsort(all.ms, all.n, sizeof(double), compareMs);
+      for (int i = 0; i < all.n; i++)
+        sum += all.ms[i];
+      printf("%10.3f %10.3f %10.3f %10.3f %10.3f ", sum / all.n,
+             percentile(all.ms, all.n, 50), percentile(all.ms, all.n, 90),
+             percentile(all.ms, all.n, 99), all.ms[all.n - 1]);
+    }
+    else
+      printf("%10s %10s %10s %10s %10s ", "-", "-", "-", "-", "-");
+    if (all.errors > 0)
+      printf("%7d %10.3f\n", all.errors, all.errorMs / all.errors);
+    else
+      printf("%7d %10s\n", 0, "-");
+    total += all.n + all.errors;
+    free(all.ms);
+  }
+  for (int j = 0; j < sessions; j++)
+    skipped += s[j].skipped;
+  printf("Replayed: %lld \t Skipped (not replayable): %lld\n", total, skipped);
+  printf("Wall time: %.1f ms \t Throughput: %.1f commands/s\n", wall,
+         wall > 0 ? total * 1e3 / wall : 0.0);
+
+  free(s);
+  for (int j = 0; j < traceLen; j++)
+    for (int i = 0; i < trace[j].argc; i++)
+      free(trace[j].args[i]);
+  free(trace);
+  ybClose(db);
+  return 0;
+}
@@ -0,0 +1,365 @@
+/**
+ * libyookbeer - student list storage, search and editing
+ *
+ * every function here works on a data file opened with ybOpen() and
+ * never prints anything. results go into caller provided buffers or
+ * are read row by row with an iterator. functions returning int return
+ * a YbStatus (YB_OK on success) unless stated otherwise.
+ */
+#ifndef YOOKBEER_H
+#define YOOKBEER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bumped whenever a struct layout or function signature changes
+#define YB_API_VERSION 1
+
+typedef struct {
+  int reg;
+  int inter;
+  int hds;
+  int rc;
+} Count;
+
+typedef struct {
+  char id[12];
+  char name[55];
+  char nick[21];
+  int course;
+  char email[61];
+  char phone[11];
+} Student;
+
+typedef struct {
+  int id;
+  int name;
+  int email;
+} CheckDuplicateResponse;
+
+typedef enum {
+  YB_OK = 0,
+  YB_ERR_IO,
+  YB_ERR_INVALID,
+  YB_ERR_NOT_FOUND,
+  YB_ERR_DUPLICATE,
+  YB_ERR_NOMEM,
+  YB_ERR_READONLY,
+} YbStatus;
+
+typedef enum {
+  YB_BY_ID,        // full 11 digits id or last 4 digits
+  YB_BY_FIRSTNAME, // prefix of first name, case insensitive
+  YB_BY_NICK,      // prefix of nickname, case insensitive
+  YB_BY_SURNAME,   // prefix of surname (name after the first space)
+} YbSearchField;
+
+typedef enum {
+  YB_GROUP_COURSE_COHORT = 1, // course x first 2 digits of id
+  YB_GROUP_EMAIL_DOMAIN,
+  YB_GROUP_NICK_INITIAL,
+  YB_GROUP_DUP_NAME, // only full names shared by more than 1 student
+} YbGroupKey;
+
+/**
+ * a prepared search, see ybQueryInit()
+ */
+typedef struct {
+  YbSearchField field;
+  char text[64];
+  int len;
+} YbQuery;
+
+/**
+ * called by ybSearchEach() with every matching student
+ */
+typedef void (*YbRowFn)(const Student *s, void *ctx);
+
+/**
+ * rule for ybCountWhere() / ybRemoveWhere(). a student matches if its id
+ * is in `ids` (when ids is set), otherwise if it matches both `prefix`
+ * (when not empty) and `course` (when >= 0)
+ */
+typedef struct {
+  char (*ids)[12];
+  int idCount;
+  char prefix[12];
+  int course;
+} YbFilter;
+
+typedef struct {
+  char key[64];
+  int count;
+} YbGroup;
+
+/**
+ * page cache statistics of the B+tree backend, see ybCacheStats()
+ */
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  int frames;
+  uint32_t pages;
+} YbCacheStats;
+
+/**
+ * sizes of a snapshot written by ybSnapshotWrite()
+ *
+ * - rawBytes: size the same rows take as csv
+ * - snapshotBytes: size of the snapshot file
+ */
+typedef struct {
+  long long rows;
+  int blocks;
+  long long rawBytes;
+  long long snapshotBytes;
+} YbSnapshotStats;
+
+/**
+ * result of ybDiff() / ybDiffApply(), see there for what skipped counts
+ */
+typedef struct {
+  long long added;
+  long long removed;
+  long long changed;
+  long long unchanged;
+  long long skipped;
+} YbDiffStats;
+
+/**
+ * what ybRefresh() found
+ *
+ * - rows: APPEND: amount of new rows, RELOAD: amount of rows now loaded
+ */
+typedef enum {
+  YB_REFRESH_NONE,
+  YB_REFRESH_APPEND,
+  YB_REFRESH_RELOAD,
+} YbRefreshKind;
+
+typedef struct {
+  YbRefreshKind kind;
+  long long rows;
+} YbRefresh;
+
+typedef enum {
+  YB_ROLE_NONE,
+  YB_ROLE_PRIMARY,
+  YB_ROLE_REPLICA,
+} YbReplRole;
+
+/**
+ * replication status, see ybReplicationStatus()
+ *
+ * - replicas: primary only, connected replicas
+ * - seq: last published (primary) / applied (replica) change
+ * - connected, primarySeq, lagMs, idleMs: replica only
+ */
+typedef struct {
+  YbReplRole role;
+  int replicas;
+  int connected;
+  uint64_t seq;
+  uint64_t primarySeq;
+  long long lagMs;
+  long long idleMs;
+} YbReplStatus;
+
+typedef enum {
+  YB_EXPORT_JSONL,
+  YB_EXPORT_TSV,
+  YB_EXPORT_HTML,
+} YbExportFormat;
+
+typedef enum {
+  YB_ORDER_ID,
+  YB_ORDER_NAME,
+  YB_ORDER_NICK,
+} YbExportOrder;
+
+/**
+ * options of ybExport()
+ *
+ * - filter: only export matching students, NULL for everyone
+ * - pageSize: HTML only, entries per printed page
+ */
+typedef struct {
+  YbExportFormat format;
+  YbExportOrder order;
+  const YbFilter *filter;
+  int pageSize;
+} YbExportOptions;
+
+/**
+ * a problem found by ybVerify()
+ *
+ * - line: 1 based line of the data file. CHECKSUM: first line of the block
+ * - other: ORDER / DUP_*: line it conflicts with (the earlier one),
+ *   CHECKSUM: last line of the block, 0 otherwise
+ */
+typedef enum {
+  YB_PROBLEM_PARSE,     // not 6 columns (or longer than a data line can be)
+  YB_PROBLEM_FIELD,     // invalid id, email, phone or empty name
+  YB_PROBLEM_COURSE,    // course outside 0-3
+  YB_PROBLEM_ORDER,     // id smaller than the one on the row before
+  YB_PROBLEM_DUP_ID,    // id used by an earlier row
+  YB_PROBLEM_DUP_EMAIL, // email used by an earlier row
+  YB_PROBLEM_CHECKSUM,  // block changed since libyookbeer last wrote the file
+} YbProblemKind;
+
+typedef struct {
+  YbProblemKind kind;
+  long long line;
+  long long other;
+} YbProblem;
+
+/**
+ * result of ybVerify()
+ *
+ * - rows: valid rows
+ * - checksums: 1 if block checksums were recorded and compared
+ * - problems: amount of problems found, listed: how many were returned
+ */
+typedef struct {
+  long long rows;
+  long long blocks;
+  int checksums;
+  int sorted;
+  long long problems;
+  int listed;
+} YbVerifyReport;
+
+/**
+ * size of a photo store, see ybPhotoStats()
+ *
+ * - students: students with a photo
+ * - blobs: stored images, photos and thumbnails, each stored once
+ * - thumbs: photos whose thumbnail was made already
+ * - bytes: size of all segment files
+ */
+typedef struct {
+  long long students;
+  long long blobs;
+  long long thumbs;
+  int segments;
+  long long bytes;
+} YbPhotoStats;
+
+typedef struct YbDb YbDb;
+typedef struct YbIter YbIter;
+typedef struct YbPhotos YbPhotos;
+
+int ybApiVersion(void);
+const char *ybStrError(int status);
+const char *ybCourseName(int course);
+uint64_t ybPackId(const char id[]);
+
+// validation and normalization of user input
+int ybValidId(const char id[]);
+int ybValidEmail(const char email[]);
+int ybValidPhone(const char phone[]);
+void ybToUpper(char s[]);
+void ybTruncate(char s[], int max);
+
+// opening a data file. ybOpen() opens a csv file, ybOpenBtree() opens
+// (or creates) a paged B+tree file with a cache of cachePages pages,
+// ybOpenResident() loads a csv file into memory and watches it for
+// outside edits, picked up by ybRefresh()
+int ybOpen(const char *path, YbDb **db);
+int ybOpenBtree(const char *path, int cachePages, YbDb **db);
+int ybOpenResident(const char *path, YbDb **db);
+int ybRefresh(YbDb *db, YbRefresh *r);
+void ybClose(YbDb *db);
+const char *ybPath(YbDb *db);
+void ybSetMemBudget(YbDb *db, long long bytes);
+int ybRowCount(YbDb *db, int *len);
+
+// reading every row in id order. ybIterNext() returns 1 for a row, 0 at the end
+int ybIterOpen(YbDb *db, YbIter **it);
+int ybIterNext(YbIter *it, Student *out);
+void ybIterClose(YbIter *it);
+
+// searching and counting
+int ybQueryInit(YbQuery *q, YbSearchField field, const char *text);
+int ybQueryMatch(const YbQuery *q, const Student *s);
+int ybSearch(YbDb *db, const YbQuery *q, Student *out, int cap, int *total);
+int ybSearchEach(YbDb *db, const YbQuery *q, YbRowFn fn, void *ctx,
+                 int *total);
+int ybCount(YbDb *db, Count *c);
+int ybCheckDuplicate(YbDb *db, const Student *x, CheckDuplicateResponse *r);
+int ybGroupBy(YbDb *db, YbGroupKey key, YbGroup **out, int *groups,
+              int *rows);
+void ybFreeGroups(YbGroup *groups);
+
+// sorting
+int ybIsSorted(YbDb *db);
+int ybSort(YbDb *db);
+
+// B+tree backend: cache statistics and moving data from/to csv
+int ybCacheStats(YbDb *db, YbCacheStats *s);
+int ybImportCsv(YbDb *db, const char *csvPath, int *imported, int *skipped);
+int ybExportCsv(YbDb *db, const char *csvPath);
+
+// compressed snapshots: delta encoded ids, 2 bit courses and per block
+// dictionaries for names, nicknames and email domains
+int ybSnapshotWrite(YbDb *db, const char *path, YbSnapshotStats *st);
+int ybSnapshotIterOpen(const char *path, YbIter **it);
+int ybSnapshotRestore(YbDb *db, const char *path, int *rows);
+
+// roster diff: compare with another id sorted roster in one merge pass,
+// then apply the diff file as a single batched update
+int ybDiff(YbDb *db, const char *otherPath, const char *diffPath,
+           YbDiffStats *st);
+int ybDiffApply(YbDb *db, const char *diffPath, YbDiffStats *st);
+
+// replication: a primary sends its adds and removes over a unix socket
+// to replicas, which keep an in-memory copy and serve reads only
+int ybServePrimary(YbDb *db, const char *sockPath);
+int ybOpenReplica(const char *sockPath, YbDb **db);
+int ybReplicationStatus(YbDb *db, YbReplStatus *st);
+
+// bulk export to JSON Lines, TSV or a paged HTML yearbook, rows are
+// formatted in parallel and written in large blocks
+int ybExport(YbDb *db, const char *path, const YbExportOptions *o,
+             long long *rows);
+
+// integrity: block checksums (CRC32C) recorded on every write plus row
+// checks (columns, fields, sorted unique ids, unique emails)
+int ybVerify(YbDb *db, YbVerifyReport *r, YbProblem *out, int cap);
+int ybWriteChecksums(YbDb *db);
+
+// photo store: content addressed (SHA-256) images attached to student
+// ids, packed into append-only segment files, thumbnails made on first
+// use. returned image pointers are valid until the next call on the store
+int ybPhotosOpen(const char *dir, YbPhotos **ps);
+void ybPhotosClose(YbPhotos *ps);
+int ybPhotoPut(YbPhotos *ps, const char id[], const void *data, size_t len,
+               int *dup);
+int ybPhotoPutFile(YbPhotos *ps, const char id[], const char *path, int *dup);
+int ybPhotoRemove(YbPhotos *ps, const char id[]);
+int ybPhotoGet(YbPhotos *ps, const char id[], const void **data,
+               size_t *len);
+int ybPhotoThumb(YbPhotos *ps, const char id[], const void **data,
+                 size_t *len);
+int ybPhotoSheet(YbPhotos *ps, YbDb *db, const YbFilter *f, int perRow,
+                 const char *path, int *count);
+int ybPhotoStats(YbPhotos *ps, YbPhotoStats *st);
+
+// editing
+int ybAdd(YbDb *db, const Student *x);
+int ybRemove(YbDb *db, const char id[], Student *removed);
+int ybFilterLoadIds(YbFilter *f, const char *path, int *skipped);
+void ybFilterFree(YbFilter *f);
+int ybFilterMatch(const YbFilter *f, const Student *s);
+int ybCountWhere(YbDb *db, const YbFilter *f, int *matched);
+int ybRemoveWhere(YbDb *db, const YbFilter *f, int *removed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif